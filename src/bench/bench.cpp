@@ -0,0 +1,186 @@
+#include "bench.h"
+
+#include <random>
+#include <string_view>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+namespace bench {
+    struct Benchmark {
+        const char* name;
+        const char* usage;
+        void (*run)(const Args& args);
+    };
+
+    static const Benchmark Benchmarks[] = {
+        { "svo-insert", "[points=2000000] [depth=10]", SvoInsert },
+        { "svo-build", "[points=2000000] [depth=10]", SvoBuild },
+        { "svo-concurrent", "[points=4000000] [depth=10] [threads=hardware]", SvoConcurrent },
+        { "svo-encode", "[points=4000000] [depth=10]", SvoEncode },
+        { "svo-layout", "[points=2000000] [depth=10] [clustered=0]", SvoLayout },
+        { "svo-dag", "[points=2000000] [depth=10] [scene=terrain|uniform|clustered] [tiles=8]", SvoDag },
+        { "svo-file", "[points=4000000] [depth=10] [path=svo-bench.svo]", SvoFile },
+        { "svo-paged", "[points=4000000] [depth=10] [pageDepth=4] [budgetMB=16] [path=svo-bench.svop]", SvoPaged },
+        { "svo-filter", "[points=2000000] [depth=10] [tiles=8]", SvoFilter },
+        { "svo-query", "[points=2000000] [depth=10] [rays=4096]", SvoQueries },
+        { "svo-render", "[points=2000000] [depth=10] [width=1280] [height=720] [path=svo-render.png]", SvoRender },
+        { "svo-bricks", "[points=4000000] [depth=10] [width=1280] [height=720]", SvoBricks },
+        { "svo-64", "[points=2000000] [depth64=5] [rays=65536] [inserts=500000] [width=1280] [height=720] [frames=20]", Svo64 },
+        { "svo-distance", "[points=4000000] [depth=10] [width=1280] [height=720]", SvoDistance },
+        { "svo-wide", "[points=4000000] [depth=12] [width=640] [height=360]", SvoWide },
+        { "svo-edit", "[points=4000000] [depth=10] [brush=4] [strokes=64] [slack=0.25]", SvoEdit },
+        { "svo-snapshot", "[points=2000000] [depth=10] [readers=hardware-1] [seconds=2] [batch=64]", SvoSnapshots },
+        { "svo-import", "[points=20000000] [depth=12] [memoryMB=64] [format=ply|xyz] [path=svo-import.ply]", SvoImport },
+        { "svo-attributes", "[points=4000000] [depth=10] [width=640] [height=360]", SvoAttributes },
+        { "svo-gpu", "[points=2000000] [depth=10] [width=640] [height=360] [frames=120] [swapEvery=10]", SvoGpu },
+        { "svo-beam", "[points=2000000] [depth=10] [frames=20]", SvoBeam },
+        { "svo-traversal", "[points=2000000] [depth=10] [width=1920] [height=1080] [frames=20]", SvoTraversal },
+        { "svo-variants", "[points=2000000] [depth=10] [width=1920] [height=1080] [frames=20]", SvoVariants },
+        { "svo-persistent", "[points=2000000] [depth=10] [width=1920] [height=1080] [frames=20] [groups=device]", SvoPersistent },
+        { "svo-voxelize", "[minDepth=6] [maxDepth=10] [solid=0] [mesh=assets/basicmesh.glb]", SvoVoxelize },
+    };
+
+    int Args::GetInt(size_t index, int fallback) const {
+        return index < values.size() ? std::stoi(values[index]) : fallback;
+    }
+
+    float Args::GetFloat(size_t index, float fallback) const {
+        return index < values.size() ? std::stof(values[index]) : fallback;
+    }
+
+    std::string Args::GetString(size_t index, const std::string& fallback) const {
+        return index < values.size() ? values[index] : fallback;
+    }
+
+    double SecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    size_t ResidentMemory() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.WorkingSetSize;
+#else
+        long pages = 0, resident = 0;
+        if (FILE* statm = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+                resident = 0;
+            std::fclose(statm);
+        }
+        return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    size_t PeakResidentMemory() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize;
+#else
+        size_t peak = 0;
+        if (FILE* status = std::fopen("/proc/self/status", "r")) {
+            char line[256];
+            while (std::fgets(line, sizeof(line), status)) {
+                unsigned long kilobytes = 0;
+                if (std::sscanf(line, "VmHWM: %lu kB", &kilobytes) == 1)
+                    peak = (size_t)kilobytes * 1024;
+            }
+            std::fclose(status);
+        }
+        return peak;
+#endif
+    }
+
+    std::vector<glm::vec3> UniformPoints(size_t count, float extent, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> dist(-extent / 2, std::nextafter(extent / 2, 0.f));
+
+        std::vector<glm::vec3> points(count);
+        for (glm::vec3& p : points)
+            p = glm::vec3(dist(rng), dist(rng), dist(rng));
+
+        return points;
+    }
+
+    std::vector<glm::vec3> ClusteredPoints(size_t count, float extent, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> center(-extent / 4, extent / 4);
+        std::normal_distribution<float> spread(0.f, extent / 256);
+
+        glm::vec3 clusters[4];
+        for (glm::vec3& c : clusters)
+            c = glm::vec3(center(rng), center(rng), center(rng));
+
+        float limit = std::nextafter(extent / 2, 0.f);
+        std::vector<glm::vec3> points(count);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 p = clusters[i % 4] + glm::vec3(spread(rng), spread(rng), spread(rng));
+            points[i] = glm::clamp(p, glm::vec3(-extent / 2), glm::vec3(limit));
+        }
+
+        return points;
+    }
+
+    std::vector<glm::vec3> TiledTerrainPoints(size_t count, float extent, int tiles, uint32_t seed) {
+        std::mt19937 rng(seed);
+        float tile = extent / tiles;
+        std::uniform_real_distribution<float> dist(0.f, std::nextafter(tile, 0.f));
+
+        // Rolling hills over one tile, periodic so neighbouring copies line up
+        constexpr float TwoPi = 6.28318531f;
+        auto height = [&](float x, float z) {
+            float u = x / tile * TwoPi, v = z / tile * TwoPi;
+            return extent / 16 * (std::sin(u) * std::cos(v) + 0.5f * std::sin(2 * u + v));
+        };
+
+        size_t perTile = std::max<size_t>(1, count / ((size_t)tiles * tiles));
+        std::vector<glm::vec3> patch(perTile);
+        for (glm::vec3& p : patch) {
+            float x = dist(rng), z = dist(rng);
+            p = glm::vec3(x, height(x, z), z);
+        }
+
+        std::vector<glm::vec3> points;
+        points.reserve(perTile * tiles * tiles);
+        for (int tx = 0; tx < tiles; tx++) {
+            for (int tz = 0; tz < tiles; tz++) {
+                glm::vec3 origin(-extent / 2 + tx * tile, 0.f, -extent / 2 + tz * tile);
+                for (const glm::vec3& p : patch)
+                    points.push_back(origin + p);
+            }
+        }
+
+        return points;
+    }
+
+    int Run(int argc, char* argv[]) {
+        std::string_view name = argc > 0 ? argv[0] : "";
+
+        for (const Benchmark& benchmark : Benchmarks) {
+            if (name != benchmark.name)
+                continue;
+
+            Args args;
+            for (int i = 1; i < argc; i++)
+                args.values.emplace_back(argv[i]);
+
+            benchmark.run(args);
+            return 0;
+        }
+
+        fmt::println("usage: engine --bench <name> [args...]");
+        for (const Benchmark& benchmark : Benchmarks)
+            fmt::println("  {} {}", benchmark.name, benchmark.usage);
+
+        return 1;
+    }
+}
\ No newline at end of file
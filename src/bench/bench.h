@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vk_types.h>
+#include <chrono>
+
+namespace bench {
+    using Clock = std::chrono::steady_clock;
+
+    struct Args {
+        std::vector<std::string> values;
+
+        int GetInt(size_t index, int fallback) const;
+        float GetFloat(size_t index, float fallback) const;
+        std::string GetString(size_t index, const std::string& fallback) const;
+    };
+
+    double SecondsSince(Clock::time_point start);
+    size_t ResidentMemory();
+    // Highest resident memory of the process so far
+    size_t PeakResidentMemory();
+
+    // Points uniformly distributed in [-extent/2, extent/2)^3
+    std::vector<glm::vec3> UniformPoints(size_t count, float extent, uint32_t seed);
+    // Points packed around a handful of small clusters, the worst case for contention
+    std::vector<glm::vec3> ClusteredPoints(size_t count, float extent, uint32_t seed);
+    // A heightfield terrain made of tiles x tiles copies of the same patch, for repeated geometry
+    std::vector<glm::vec3> TiledTerrainPoints(size_t count, float extent, int tiles, uint32_t seed);
+
+    void SvoInsert(const Args& args);
+    void SvoBuild(const Args& args);
+    void SvoConcurrent(const Args& args);
+    void SvoEncode(const Args& args);
+    void SvoLayout(const Args& args);
+    void SvoDag(const Args& args);
+    void SvoFile(const Args& args);
+    void SvoPaged(const Args& args);
+    void SvoFilter(const Args& args);
+    void SvoQueries(const Args& args);
+    void SvoRender(const Args& args);
+    void SvoBricks(const Args& args);
+    void Svo64(const Args& args);
+    void SvoDistance(const Args& args);
+    void SvoWide(const Args& args);
+    void SvoEdit(const Args& args);
+    void SvoSnapshots(const Args& args);
+    void SvoImport(const Args& args);
+    void SvoAttributes(const Args& args);
+    void SvoGpu(const Args& args);
+    void SvoBeam(const Args& args);
+    void SvoTraversal(const Args& args);
+    void SvoVariants(const Args& args);
+    void SvoPersistent(const Args& args);
+    void SvoVoxelize(const Args& args);
+
+    // Entry point for `engine --bench <name> [args...]`
+    int Run(int argc, char* argv[]);
+}
\ No newline at end of file
@@ -0,0 +1,1993 @@
+#include "bench.h"
+#include <svo.h>
+#include <svo_file.h>
+#include <svo_paged.h>
+#include <svo_query.h>
+#include <svo64.h>
+#include <svo_versioned.h>
+#include <voxel_tree.h>
+#include <cpu_raymarcher.h>
+#include <svo_residency.h>
+#include <raymarch_pipelines.h>
+#include <vk_descriptors.h>
+#include <vk_images.h>
+#include <vk_initializers.h>
+#include <vk_loader.h>
+#include <vk_pipelines.h>
+#include "VkBootstrap.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+
+namespace {
+    // raymarch.comp on a device without a window or swapchain, so it also runs on a software
+    // implementation such as lavapipe. Same descriptor layout and SvoResidency as the engine, with a
+    // storage image and beam buffer of one extent and two frames to record into.
+    class HeadlessRaymarch {
+    public:
+        static constexpr uint32_t FramesInFlight = 2;
+
+        ~HeadlessRaymarch() { Destroy(); }
+
+        // Prints why and returns false without a Vulkan 1.3 device or the shader
+        bool Init(const char* name, VkExtent2D extent, const char* shader = RaymarchShader);
+        void Destroy();
+        // Specializes the pipelines for a tree's constants, retiring the variants built for the last one
+        void SetTree(const SvoShaderConstants& tree);
+
+        // Waits for the slot's previous frame, then begins recording with the image in the GENERAL layout
+        VkCommandBuffer Begin(uint64_t frame);
+        // Raymarches the residency's active version with the variant for features, timed if the device has
+        // timestamps. persistentGroups workgroups take tiles from the queue, 0 dispatches one per block.
+        void Draw(VkCommandBuffer cmd, uint64_t frame, const ComputePushConstants& push, bool beam, uint32_t features = RaymarchProduction, uint32_t persistentGroups = 0);
+        // Submits the frame, copying the image for GetPixels first if readback is set
+        void Submit(VkCommandBuffer cmd, uint64_t frame, bool readback);
+        // Waits for every frame in flight
+        void Wait();
+
+        // The last read back image, after Wait
+        const glm::vec4* GetPixels();
+        // GPU time of the frame's Draw, after its slot was waited for. 0 without timestamps.
+        double GetDrawMilliseconds(uint64_t frame) const;
+
+        std::string deviceName;
+        bool cpuDevice = false;
+        // SvoResidency::GetPersistentGroups for the device
+        uint32_t persistentGroups = 0;
+        VkExtent2D extent = {};
+        SvoResidency* residency = nullptr;
+        RaymarchPipelines* pipelines = nullptr;
+        FrameData frames[FramesInFlight] = {};
+
+    private:
+        vkb::Instance m_Instance;
+        vkb::Device m_VkbDevice;
+        VkDevice m_Device = VK_NULL_HANDLE;
+        VkQueue m_Queue = VK_NULL_HANDLE;
+        VmaAllocator m_Allocator = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_Layout = VK_NULL_HANDLE;
+        DescriptorAllocator m_Descriptors;
+        AllocatedImage m_Image = {};
+        AllocatedBuffer m_Beam = {}, m_Readback = {};
+        VkQueryPool m_Timestamps = VK_NULL_HANDLE;
+        double m_TimestampPeriod = 0;    // ns per tick, 0 without timestamps
+    };
+
+    bool HeadlessRaymarch::Init(const char* name, VkExtent2D drawExtent, const char* shader) {
+        extent = drawExtent;
+        vkb::Result<vkb::Instance> instance = vkb::InstanceBuilder()
+            .set_app_name(name)
+            .set_headless()
+            .require_api_version(1, 3, 0)
+            .build();
+        if (!instance) {
+            fmt::println("{}: no Vulkan 1.3 instance: {}", name, instance.error().message());
+            return false;
+        }
+        m_Instance = instance.value();
+
+        VkPhysicalDeviceVulkan13Features features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+        features.synchronization2 = true;
+        vkb::Result<vkb::PhysicalDevice> physicalDevice = vkb::PhysicalDeviceSelector{ m_Instance }
+            .set_minimum_version(1, 3)
+            .set_required_features_13(features)
+            .select();
+        if (!physicalDevice) {
+            fmt::println("{}: no Vulkan 1.3 device: {}", name, physicalDevice.error().message());
+            Destroy();
+            return false;
+        }
+        deviceName = physicalDevice.value().name;
+        cpuDevice = physicalDevice.value().properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+        persistentGroups = SvoResidency::GetPersistentGroups(physicalDevice.value().physical_device);
+
+        m_VkbDevice = vkb::DeviceBuilder{ physicalDevice.value() }.build().value();
+        m_Device = m_VkbDevice.device;
+        m_Queue = m_VkbDevice.get_queue(vkb::QueueType::graphics).value();
+        uint32_t queueFamily = m_VkbDevice.get_queue_index(vkb::QueueType::graphics).value();
+        if (m_VkbDevice.queue_families[queueFamily].timestampValidBits != 0)
+            m_TimestampPeriod = physicalDevice.value().properties.limits.timestampPeriod;
+
+        VmaAllocatorCreateInfo allocatorInfo = {};
+        allocatorInfo.physicalDevice = physicalDevice.value().physical_device;
+        allocatorInfo.device = m_Device;
+        allocatorInfo.instance = m_Instance.instance;
+        vmaCreateAllocator(&allocatorInfo, &m_Allocator);
+
+        // The engine's descriptor layout, see VulkanEngine::init_descriptors
+        DescriptorLayoutBuilder builder;
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        for (uint32_t i = 0; i < SvoResidency::ArrayCount; i++)
+            builder.add_binding(SvoResidency::FirstBinding + i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.add_binding(SvoResidency::BeamBinding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        builder.add_binding(SvoResidency::QueueBinding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        m_Layout = builder.build(m_Device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SvoResidency::ArrayCount + 2 },
+        };
+        m_Descriptors.init_pool(m_Device, 2, sizes);
+
+        pipelines = new RaymarchPipelines(m_Device, m_Layout, shader);
+        if (!pipelines->IsValid()) {
+            fmt::println("{}: cannot load {}", name, shader);
+            Destroy();
+            return false;
+        }
+
+        // The image the shader writes, the beam buffer for it and a host buffer to read the image back
+        m_Image.imageFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+        m_Image.imageExtent = { extent.width, extent.height, 1 };
+        VkImageCreateInfo imageInfo = vkinit::image_create_info(m_Image.imageFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, m_Image.imageExtent);
+        VmaAllocationCreateInfo gpuAlloc = {};
+        gpuAlloc.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        VK_CHECK(vmaCreateImage(m_Allocator, &imageInfo, &gpuAlloc, &m_Image.image, &m_Image.allocation, nullptr));
+        VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(m_Image.imageFormat, m_Image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        VK_CHECK(vkCreateImageView(m_Device, &viewInfo, nullptr, &m_Image.imageView));
+
+        VkBufferCreateInfo beamInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        beamInfo.size = SvoResidency::GetBeamBufferSize(extent);
+        beamInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        VK_CHECK(vmaCreateBuffer(m_Allocator, &beamInfo, &gpuAlloc, &m_Beam.buffer, &m_Beam.allocation, &m_Beam.info));
+
+        VkBufferCreateInfo readbackInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        readbackInfo.size = (VkDeviceSize)extent.width * extent.height * sizeof(glm::vec4);
+        readbackInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        VmaAllocationCreateInfo readbackAlloc = {};
+        readbackAlloc.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+        readbackAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        VK_CHECK(vmaCreateBuffer(m_Allocator, &readbackInfo, &readbackAlloc, &m_Readback.buffer, &m_Readback.allocation, &m_Readback.info));
+
+        residency = new SvoResidency(m_Device, m_Allocator, m_Layout, m_Descriptors, FramesInFlight);
+        residency->SetTargets(m_Image.imageView, m_Beam.buffer);
+
+        for (FrameData& frame : frames) {
+            VkCommandPoolCreateInfo poolInfo = vkinit::command_pool_create_info(queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+            VK_CHECK(vkCreateCommandPool(m_Device, &poolInfo, nullptr, &frame._commandPool));
+            VkCommandBufferAllocateInfo cmdInfo = vkinit::command_buffer_allocate_info(frame._commandPool, 1);
+            VK_CHECK(vkAllocateCommandBuffers(m_Device, &cmdInfo, &frame._mainCommandBuffer));
+            VkFenceCreateInfo fenceInfo = vkinit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
+            VK_CHECK(vkCreateFence(m_Device, &fenceInfo, nullptr, &frame._renderFence));
+        }
+
+        // Two timestamps around every frame's Draw
+        if (m_TimestampPeriod > 0) {
+            VkQueryPoolCreateInfo queryInfo = { .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+            queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryInfo.queryCount = 2 * FramesInFlight;
+            VK_CHECK(vkCreateQueryPool(m_Device, &queryInfo, nullptr, &m_Timestamps));
+        }
+        return true;
+    }
+
+    void HeadlessRaymarch::Destroy() {
+        if (m_Device != VK_NULL_HANDLE) {
+            Wait();
+            for (FrameData& frame : frames) {
+                frame._deletionQueue.flush();
+                vkDestroyFence(m_Device, frame._renderFence, nullptr);
+                vkDestroyCommandPool(m_Device, frame._commandPool, nullptr);
+                frame = {};
+            }
+            delete residency;
+            residency = nullptr;
+            delete pipelines;
+            pipelines = nullptr;
+
+            if (m_Timestamps != VK_NULL_HANDLE)
+                vkDestroyQueryPool(m_Device, m_Timestamps, nullptr);
+            vmaDestroyBuffer(m_Allocator, m_Readback.buffer, m_Readback.allocation);
+            vmaDestroyBuffer(m_Allocator, m_Beam.buffer, m_Beam.allocation);
+            vkDestroyImageView(m_Device, m_Image.imageView, nullptr);
+            vmaDestroyImage(m_Allocator, m_Image.image, m_Image.allocation);
+            m_Descriptors.destroy_pool(m_Device);
+            vkDestroyDescriptorSetLayout(m_Device, m_Layout, nullptr);
+            vmaDestroyAllocator(m_Allocator);
+            vkb::destroy_device(m_VkbDevice);
+
+            m_Device = VK_NULL_HANDLE;
+            m_Timestamps = VK_NULL_HANDLE;
+            m_TimestampPeriod = 0;
+        }
+        if (m_Instance.instance != VK_NULL_HANDLE)
+            vkb::destroy_instance(m_Instance);
+        m_Instance = {};
+    }
+
+    void HeadlessRaymarch::SetTree(const SvoShaderConstants& tree) {
+        Wait();
+        DeletionQueue retired;
+        pipelines->SetTreeConstants(tree, retired);
+        retired.flush();
+    }
+
+    VkCommandBuffer HeadlessRaymarch::Begin(uint64_t frame) {
+        FrameData& data = frames[frame % FramesInFlight];
+        VK_CHECK(vkWaitForFences(m_Device, 1, &data._renderFence, true, UINT64_MAX));
+        data._deletionQueue.flush();
+        VK_CHECK(vkResetFences(m_Device, 1, &data._renderFence));
+
+        VkCommandBuffer cmd = data._mainCommandBuffer;
+        VK_CHECK(vkResetCommandBuffer(cmd, 0));
+        VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+        // Also orders the beam prepass after the last frame's reads of the beam buffer
+        vkutil::transition_image(cmd, m_Image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        return cmd;
+    }
+
+    void HeadlessRaymarch::Draw(VkCommandBuffer cmd, uint64_t frame, const ComputePushConstants& push, bool beam, uint32_t features, uint32_t groups) {
+        uint32_t query = 2 * (frame % FramesInFlight);
+        if (m_Timestamps != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(cmd, m_Timestamps, query, 2);
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_Timestamps, query);
+        }
+        residency->Dispatch(cmd, pipelines->Get(features), pipelines->GetLayout(), push, extent, beam, groups);
+        if (m_Timestamps != VK_NULL_HANDLE)
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, m_Timestamps, query + 1);
+    }
+
+    void HeadlessRaymarch::Submit(VkCommandBuffer cmd, uint64_t frame, bool readback) {
+        if (readback) {
+            vkutil::transition_image(cmd, m_Image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+            VkBufferImageCopy copy = {};
+            copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            copy.imageExtent = m_Image.imageExtent;
+            vkCmdCopyImageToBuffer(cmd, m_Image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_Readback.buffer, 1, &copy);
+        }
+        VK_CHECK(vkEndCommandBuffer(cmd));
+
+        VkCommandBufferSubmitInfo cmdSubmit = vkinit::command_buffer_submit_info(cmd);
+        VkSubmitInfo2 submit = vkinit::submit_info(&cmdSubmit, nullptr, nullptr);
+        VK_CHECK(vkQueueSubmit2(m_Queue, 1, &submit, frames[frame % FramesInFlight]._renderFence));
+    }
+
+    void HeadlessRaymarch::Wait() {
+        for (FrameData& frame : frames) {
+            if (frame._renderFence != VK_NULL_HANDLE)
+                VK_CHECK(vkWaitForFences(m_Device, 1, &frame._renderFence, true, UINT64_MAX));
+        }
+    }
+
+    const glm::vec4* HeadlessRaymarch::GetPixels() {
+        vmaInvalidateAllocation(m_Allocator, m_Readback.allocation, 0, VK_WHOLE_SIZE);
+        return (const glm::vec4*)m_Readback.info.pMappedData;
+    }
+
+    double HeadlessRaymarch::GetDrawMilliseconds(uint64_t frame) const {
+        if (m_Timestamps == VK_NULL_HANDLE)
+            return 0;
+
+        uint64_t ticks[2];
+        VK_CHECK(vkGetQueryPoolResults(m_Device, m_Timestamps, 2 * (frame % FramesInFlight), 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT));
+        return (ticks[1] - ticks[0]) * m_TimestampPeriod * 1e-6;
+    }
+
+    // Share of pixels whose 8-bit color matches a CpuFrame within a step or two of rounding
+    double MatchingPixels(const glm::vec4* pixels, const CpuFrame& reference) {
+        size_t same = 0, count = (size_t)reference.width * reference.height;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t c = reference.color[i];
+            glm::vec3 expected = glm::vec3(c & 0xFF, (c >> 8) & 0xFF, (c >> 16) & 0xFF) / 255.f;
+            glm::vec3 error = glm::abs(glm::clamp(glm::vec3(pixels[i]), 0.f, 1.f) - expected);
+            same += std::max(error.x, std::max(error.y, error.z)) <= 2.f / 255.f;
+        }
+        return (double)same / std::max<size_t>(count, 1);
+    }
+
+    // Push constants raymarch.comp reads a CpuCamera from, with a 90 degree field of view and LOD off
+    ComputePushConstants RaymarchPushConstants(const CpuCamera& camera) {
+        ComputePushConstants push;
+        push.data1 = glm::vec4(camera.position, 0.f);
+        push.data2 = glm::vec4(camera.forward, 0.f);
+        push.data3 = glm::vec4(camera.right, 0.f);
+        push.data4 = glm::vec4(camera.up, 0.f);
+        return push;
+    }
+
+    // One tree's row of svo-64, measured the same way for either tree type
+    struct TreeTimings {
+        double insert = 0, build = 0, encode = 0, rays = 0;
+        std::vector<SvoRayHit> hits;
+    };
+
+    template<VoxelTree Tree>
+    TreeTimings TimeTree(Tree& tree, std::span<const glm::vec3> points, size_t insertCount, std::span<const SvoRay> rays) {
+        TreeTimings timings;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < insertCount; i++)
+            tree.Insert(points[i], glm::vec3(1.f));
+        timings.insert = SecondsSince(start);
+
+        start = Clock::now();
+        tree.Build(points, {});
+        timings.build = SecondsSince(start);
+
+        start = Clock::now();
+        tree.CreateBuffer();
+        timings.encode = SecondsSince(start);
+
+        typename VoxelTreeTraits<Tree>::Query query(tree);
+        timings.hits.resize(rays.size());
+        query.Raycast(rays, timings.hits);
+        constexpr int Batches = 10;
+        start = Clock::now();
+        for (int b = 0; b < Batches; b++)
+            query.Raycast(rays, timings.hits);
+        timings.rays = SecondsSince(start) / Batches;
+        return timings;
+    }
+
+    // Average GPU time of the tree's kernel over frames, without the beam prepass, and the last frame's
+    // image. False if there is no device or the shader is missing.
+    template<VoxelTree Tree>
+    bool DrawTree(const Tree& tree, const char* shader, const CpuCamera& camera, VkExtent2D extent, int frames, double& milliseconds,
+        std::vector<glm::vec4>& pixels) {
+        HeadlessRaymarch gpu;
+        if (!gpu.Init("svo-64", extent, shader))
+            return false;
+
+        gpu.SetTree(tree.GetShaderConstants());
+        if constexpr (std::same_as<Tree, SparseVoxelOctree>)
+            gpu.residency->Stage(tree);
+        else
+            gpu.residency->Stage(tree.GetShaderConstants(), { tree.m_Buffer, {}, tree.m_Attributes, {}, {} });
+
+        ComputePushConstants push = RaymarchPushConstants(camera);
+        milliseconds = 0;
+        for (int f = 0; f <= frames; f++) {
+            VkCommandBuffer cmd = gpu.Begin(f);
+            gpu.residency->Record(cmd, f, gpu.frames[f % HeadlessRaymarch::FramesInFlight]._deletionQueue);
+            gpu.Draw(cmd, f, push, false);
+            gpu.Submit(cmd, f, f == frames);
+            gpu.Wait();
+            // The first frame uploads the tree and builds the pipeline
+            if (f > 0)
+                milliseconds += gpu.GetDrawMilliseconds(f) / frames;
+        }
+
+        pixels.assign(gpu.GetPixels(), gpu.GetPixels() + (size_t)extent.width * extent.height);
+        return true;
+    }
+}
+
+namespace bench {
+    void SvoInsert(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = UniformPoints(count, (float)size, 1);
+
+        size_t rssBefore = ResidentMemory();
+        SparseVoxelOctree svo(size, depth);
+
+        Clock::time_point start = Clock::now();
+        for (const glm::vec3& p : points)
+            svo.Insert(p, glm::vec3(1.f));
+        double seconds = SecondsSince(start);
+
+        size_t rssAfter = ResidentMemory();
+
+        fmt::println("svo-insert: {} points, depth {}", count, depth);
+        fmt::println("  insert     {:.3f} s ({:.2f} Mpoints/s)", seconds, count / seconds / 1e6);
+        fmt::println("  nodes      {} ({:.1f} MB in pool chunks)", svo.GetNodeCount(), svo.GetNodeMemory() / 1048576.0);
+        fmt::println("  resident   +{:.1f} MB", (rssAfter - rssBefore) / 1048576.0);
+
+        start = Clock::now();
+        svo.Clear();
+        fmt::println("  free       {:.3f} ms", SecondsSince(start) * 1e3);
+    }
+
+    void SvoBuild(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = UniformPoints(count, (float)size, 1);
+        std::vector<glm::vec3> colors(count, glm::vec3(1.f));
+
+        SparseVoxelOctree inserted(size, depth);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < count; i++)
+            inserted.Insert(points[i], colors[i]);
+        double insertSeconds = SecondsSince(start);
+
+        SparseVoxelOctree built(size, depth);
+        start = Clock::now();
+        built.Build(points, colors);
+        double buildSeconds = SecondsSince(start);
+
+        inserted.CreateBuffer();
+        built.CreateBuffer();
+        bool identical = inserted.m_Buffer == built.m_Buffer && inserted.m_Far == built.m_Far && inserted.m_Attributes == built.m_Attributes;
+
+        fmt::println("svo-build: {} points, depth {}", count, depth);
+        fmt::println("  insert     {:.3f} s ({:.2f} Mpoints/s)", insertSeconds, count / insertSeconds / 1e6);
+        fmt::println("  build      {:.3f} s ({:.2f} Mpoints/s, {:.1f}x)", buildSeconds, count / buildSeconds / 1e6, insertSeconds / buildSeconds);
+        fmt::println("  buffers    {}", identical ? "identical" : "DIFFERENT");
+    }
+
+    void SvoConcurrent(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        int maxThreads = args.GetInt(2, std::max(1u, std::thread::hardware_concurrency()));
+        int size = 1024;
+
+        fmt::println("svo-concurrent: {} points, depth {}, up to {} threads", count, depth, maxThreads);
+
+        for (int clustered = 0; clustered < 2; clustered++) {
+            std::vector<glm::vec3> points = clustered ? ClusteredPoints(count, (float)size, 1) : UniformPoints(count, (float)size, 1);
+
+            SparseVoxelOctree reference(size, depth);
+            reference.Build(points, {});
+            reference.CreateBuffer();
+
+            fmt::println("  {} workload, {} nodes", clustered ? "clustered" : "uniform", reference.GetNodeCount());
+
+            double baseline = 0;
+            for (int threads = 1; threads <= maxThreads; threads *= 2) {
+                SparseVoxelOctree svo(size, depth);
+
+                Clock::time_point start = Clock::now();
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; t++) {
+                    workers.emplace_back([&, t]() {
+                        SparseVoxelOctree::ConcurrentInserter inserter(svo);
+                        for (size_t i = t; i < count; i += threads)
+                            inserter.Insert(points[i], glm::vec3(1.f));
+                    });
+                }
+                for (std::thread& worker : workers)
+                    worker.join();
+                double seconds = SecondsSince(start);
+
+                if (threads == 1)
+                    baseline = seconds;
+
+                svo.CreateBuffer();
+                bool identical = svo.m_Buffer == reference.m_Buffer && svo.m_Far == reference.m_Far && svo.m_Attributes == reference.m_Attributes;
+
+                fmt::println("    {} threads  {:.3f} s  {:.2f} Mpoints/s  {:.2f}x  {}", threads, seconds, count / seconds / 1e6,
+                    baseline / seconds, identical ? "ok" : "MISMATCH");
+
+                if (threads < maxThreads && threads * 2 > maxThreads)
+                    threads = maxThreads / 2;
+            }
+        }
+    }
+
+    void SvoEncode(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(UniformPoints(count, (float)size, 1), {});
+
+        fmt::println("svo-encode: {} points, depth {}, {} nodes", count, depth, svo.GetNodeCount());
+
+        Clock::time_point start = Clock::now();
+        svo.CreateBuffer(0);
+        double sequential = SecondsSince(start);
+        std::vector<uint32_t> buffer = svo.m_Buffer, far = svo.m_Far, attributes = svo.m_Attributes;
+        auto matches = [&](const SparseVoxelOctree& tree) {
+            return tree.m_Buffer == buffer && tree.m_Far == far && tree.m_Attributes == attributes;
+        };
+
+        fmt::println("  sequential   {:.3f} s  {} words, {} far", sequential, buffer.size(), far.size());
+
+        for (int split = 1; split < depth; split += 2) {
+            start = Clock::now();
+            svo.CreateBuffer(split);
+            double seconds = SecondsSince(start);
+
+            fmt::println("  split {:2}     {:.3f} s  {:.2f}x  {}", split, seconds, sequential / seconds, matches(svo) ? "identical" : "DIFFERENT");
+        }
+
+        start = Clock::now();
+        svo.CreateBuffer();
+        double automatic = SecondsSince(start);
+        fmt::println("  automatic    {:.3f} s  {:.2f}x  {}", automatic, sequential / automatic,
+            matches(svo) ? "identical" : "DIFFERENT");
+
+        // Two trees encoding at once, which the old file-scope counter did not allow
+        SparseVoxelOctree other(size, depth);
+        other.Build(UniformPoints(count, (float)size, 1), {});
+        std::thread worker([&]() { other.CreateBuffer(); });
+        svo.CreateBuffer();
+        worker.join();
+        fmt::println("  reentrant    {}", matches(svo) && matches(other) ? "identical" : "DIFFERENT");
+    }
+
+    void SvoLayout(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        bool clustered = args.GetInt(2, 0) != 0;
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(clustered ? ClusteredPoints(count, (float)size, 1) : UniformPoints(count, (float)size, 1), {});
+
+        fmt::println("svo-layout: {} {} points, depth {}, {} nodes", count, clustered ? "clustered" : "uniform", depth, svo.GetNodeCount());
+        fmt::println("  {:<14} {:>9} {:>12} {:>10} {:>10} {:>10} {:>10}", "layout", "encode ms", "far ptrs", "back refs", "avg dist", "same line", "same page");
+
+        const std::pair<BufferLayout, const char*> layouts[] = {
+            { BufferLayout::DepthFirst, "depth-first" },
+            { BufferLayout::BreadthFirst, "breadth-first" },
+            { BufferLayout::Clustered, "clustered" },
+        };
+
+        for (auto [layout, name] : layouts) {
+            Clock::time_point start = Clock::now();
+            bool encoded = svo.CreateBuffer(layout);
+            double seconds = SecondsSince(start);
+
+            // Overflowing the far table writes the layout with wide descriptors
+            BufferLayoutStats stats = svo.GetLayoutStats();
+            fmt::println("  {:<14} {:>9.1f} {:>12} {:>10} {:>10.1f} {:>9.1f}% {:>9.1f}%", encoded ? name : fmt::format("{} (wide)", name), seconds * 1e3, stats.farPointers,
+                stats.backReferences, stats.averageDistance, stats.sameCacheLine * 100, stats.samePage * 100);
+        }
+    }
+
+    // Descriptors in the order a full depth-first traversal reaches them, following offsets the way
+    // the shader does, so a DAG buffer expands to the same sequence as the tree it came from
+    static std::vector<uint32_t> ExpandBuffer(const SparseVoxelOctree& svo) {
+        std::vector<uint32_t> expanded;
+        if (svo.m_Buffer.empty())
+            return expanded;
+
+        std::vector<uint32_t> stack = { 0 };
+        while (!stack.empty()) {
+            uint32_t slot = stack.back();
+            stack.pop_back();
+
+            uint32_t desc = svo.m_Buffer[slot];
+            expanded.push_back(desc & 0xFFFF);
+
+            uint32_t interior = (desc & 0xFF) & ~((desc >> 8) & 0xFF);
+            uint32_t offset = (desc & (1 << 16)) ? svo.m_Far[desc >> 17] : desc >> 17;
+            for (int i = std::popcount(interior) - 1; i >= 0; i--)
+                stack.push_back(slot + offset + i);
+        }
+
+        return expanded;
+    }
+
+    void SvoDag(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        std::string scene = args.GetString(2, "terrain");
+        int tiles = args.GetInt(3, 8);
+        int size = 1024;
+
+        std::vector<glm::vec3> points;
+        if (scene == "uniform")
+            points = UniformPoints(count, (float)size, 1);
+        else if (scene == "clustered")
+            points = ClusteredPoints(count, (float)size, 1);
+        else
+            points = TiledTerrainPoints(count, (float)size, tiles, 1);
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(points, {});
+        svo.CreateBuffer();
+
+        uint32_t treeNodes = svo.GetNodeCount();
+        size_t treeNodeMemory = svo.GetNodeMemory();
+        size_t treeBuffer = svo.GetBufferSize() + svo.GetFarBufferSize();
+        int treeVoxels = svo.GetVoxelCount();
+        std::vector<uint32_t> treeExpanded = ExpandBuffer(svo);
+
+        Clock::time_point start = Clock::now();
+        svo.Compress();
+        double compressSeconds = SecondsSince(start);
+
+        start = Clock::now();
+        svo.CreateBuffer();
+        double encodeSeconds = SecondsSince(start);
+
+        size_t dagBuffer = svo.GetBufferSize() + svo.GetFarBufferSize();
+        bool identical = treeVoxels == svo.GetVoxelCount() && treeExpanded == ExpandBuffer(svo);
+
+        fmt::println("svo-dag: {} {} points, depth {}", count, scene, depth);
+        fmt::println("  nodes      {} -> {} ({:.1f}%)", treeNodes, svo.GetNodeCount(), 100.0 * svo.GetNodeCount() / treeNodes);
+        fmt::println("  node pool  {:.1f} MB -> {:.1f} MB", treeNodeMemory / 1048576.0, svo.GetNodeMemory() / 1048576.0);
+        fmt::println("  buffer     {:.2f} MB -> {:.2f} MB ({} far pointers)", treeBuffer / 1048576.0, dagBuffer / 1048576.0, svo.m_Far.size());
+        fmt::println("  compress   {:.1f} ms ({:.1f} Mnodes/s)", compressSeconds * 1e3, treeNodes / compressSeconds / 1e6);
+        fmt::println("  encode     {:.1f} ms", encodeSeconds * 1e3);
+        fmt::println("  traversal  {}", identical ? "identical" : "DIFFERENT");
+    }
+
+    void SvoFile(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        std::string path = args.GetString(2, "svo-bench.svo");
+        int size = 1024;
+
+        std::vector<glm::vec3> points = UniformPoints(count, (float)size, 1);
+
+        Clock::time_point start = Clock::now();
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(points, {});
+        svo.CreateBuffer();
+        double rebuildSeconds = SecondsSince(start);
+
+        start = Clock::now();
+        if (!svo.Save(path))
+            return;
+        double saveSeconds = SecondsSince(start);
+
+        // Copying every word out stands in for the staging upload, so the pages are actually read
+        start = Clock::now();
+        std::optional<MappedSvo> mapped = MappedSvo::Open(path);
+        if (!mapped)
+            return;
+
+        std::vector<uint32_t> staging(mapped->GetBuffer().size() + mapped->GetFar().size() + mapped->GetAttributes().size());
+        auto staged = std::copy(mapped->GetBuffer().begin(), mapped->GetBuffer().end(), staging.begin());
+        staged = std::copy(mapped->GetFar().begin(), mapped->GetFar().end(), staged);
+        std::copy(mapped->GetAttributes().begin(), mapped->GetAttributes().end(), staged);
+        double loadSeconds = SecondsSince(start);
+
+        bool identical = std::ranges::equal(mapped->GetBuffer(), svo.m_Buffer) && std::ranges::equal(mapped->GetFar(), svo.m_Far) &&
+            std::ranges::equal(mapped->GetAttributes(), svo.m_Attributes) && mapped->GetVoxelCount() == (uint64_t)svo.GetVoxelCount() && mapped->GetMaxDepth() == depth && mapped->GetSize() == size;
+
+        fmt::println("svo-file: {} points, depth {}, {:.1f} MB file", count, depth, mapped->GetFileSize() / 1048576.0);
+        fmt::println("  rebuild    {:.3f} s (build and encode)", rebuildSeconds);
+        fmt::println("  save       {:.3f} s", saveSeconds);
+        fmt::println("  load       {:.3f} s (map and copy out, {:.1f}x faster)", loadSeconds, rebuildSeconds / loadSeconds);
+        fmt::println("  contents   {}", identical ? "identical" : "DIFFERENT");
+    }
+
+    void SvoPaged(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        int pageDepth = args.GetInt(2, 4);
+        size_t budget = (size_t)args.GetInt(3, 16) << 20;
+        std::string path = args.GetString(4, "svo-bench.svop");
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(UniformPoints(count, (float)size, 1), {});
+        svo.CreateBuffer();
+
+        Clock::time_point start = Clock::now();
+        if (!svo.SavePaged(path, pageDepth))
+            return;
+        double saveSeconds = SecondsSince(start);
+
+        std::unique_ptr<PagedSvo> paged = PagedSvo::Open(path, budget);
+        if (!paged)
+            return;
+
+        uint64_t pageVoxels = 0;
+        size_t largestPage = 0;
+        for (uint32_t page = 0; page < paged->GetPageCount(); page++) {
+            const PagedSvoPageEntry& entry = paged->GetPageEntry(page);
+            pageVoxels += entry.voxelCount;
+            largestPage = std::max<size_t>(largestPage, (2 * entry.bufferWords + entry.farWords) * sizeof(uint32_t));
+        }
+
+        // Fly through the volume corner to corner, giving the I/O threads a frame's worth of time
+        constexpr int Frames = 600;
+        double updateTotal = 0, updateMax = 0;
+        size_t residentMax = 0;
+        uint32_t nearMisses = 0;
+        for (int frame = 0; frame < Frames; frame++) {
+            float t = (float)frame / (Frames - 1);
+            glm::vec3 camera = glm::vec3((t - 0.5f) * size);
+
+            start = Clock::now();
+            paged->Update(camera);
+            double seconds = SecondsSince(start);
+            updateTotal += seconds;
+            updateMax = std::max(updateMax, seconds);
+
+            // The page under the camera is what a renderer would need first
+            float cells = (float)(1u << pageDepth);
+            glm::uvec3 cell = glm::uvec3(glm::clamp((camera + glm::vec3(size / 2.f)) * (cells / size), glm::vec3(0.f), glm::vec3(cells - 1)));
+            uint32_t page = paged->FindPage(cell);
+            nearMisses += page != PagedSvo::InvalidPage && !paged->GetPage(page);
+
+            residentMax = std::max(residentMax, paged->GetStats().residentBytes);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+
+        PagedSvo::Stats stats = paged->GetStats();
+
+        // What the engine stages after every change to the resident set
+        std::vector<uint32_t> buffer, far, attributes;
+        start = Clock::now();
+        uint32_t spliced = paged->Assemble(buffer, far, attributes);
+        double assembleSeconds = SecondsSince(start);
+
+        fmt::println("svo-paged: {} points, depth {}, page depth {}, {} MB budget", count, depth, paged->GetPageDepth(), budget >> 20);
+        fmt::println("  pages      {} (largest {:.1f} KB), top tree {:.1f} KB", paged->GetPageCount(), largestPage / 1024.0,
+            (paged->GetTopBuffer().size() + paged->GetTopFar().size() + paged->GetTopAttributes().size()) * sizeof(uint32_t) / 1024.0);
+        fmt::println("  save       {:.3f} s", saveSeconds);
+        fmt::println("  update     {:.3f} ms avg, {:.3f} ms max", updateTotal / Frames * 1e3, updateMax * 1e3);
+        fmt::println("  streaming  {} loads, {} evictions, {} frames without the camera's page", stats.loads, stats.evictions, nearMisses);
+        fmt::println("  assemble   {:.3f} ms for {} of {} resident pages, {:.1f} MB", assembleSeconds * 1e3, spliced, stats.residentPages,
+            (buffer.size() + far.size() + attributes.size()) * sizeof(uint32_t) / 1048576.0);
+        fmt::println("  resident   {:.1f} MB peak of {:.1f} MB total", residentMax / 1048576.0,
+            (double)(svo.GetBufferSize() + svo.GetFarBufferSize() + svo.GetAttributeBufferSize()) / 1048576.0);
+        fmt::println("  voxels     {}", pageVoxels == (uint64_t)svo.GetVoxelCount() && paged->GetVoxelCount() == pageVoxels ? "match" : "MISMATCH");
+    }
+
+    void SvoFilter(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        int tiles = args.GetInt(2, 8);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = TiledTerrainPoints(count, (float)size, tiles, 1);
+        std::vector<glm::vec3> colors(count);
+        for (size_t i = 0; i < count; i++)
+            colors[i] = (points[i] + glm::vec3(size / 2.f)) / (float)size;
+
+        // Inserting leaves every interior node to the filter pass, building filters as it goes
+        SparseVoxelOctree inserted(size, depth);
+        for (size_t i = 0; i < count; i++)
+            inserted.Insert(points[i], colors[i]);
+
+        Clock::time_point start = Clock::now();
+        inserted.FilterAttributes();
+        double filterSeconds = SecondsSince(start);
+
+        SparseVoxelOctree built(size, depth);
+        built.Build(points, colors);
+
+        inserted.CreateBuffer();
+        built.CreateBuffer();
+
+        fmt::println("svo-filter: {} terrain points, depth {}, {} nodes", count, depth, inserted.GetNodeCount());
+        fmt::println("  filter     {:.1f} ms ({:.1f} Mnodes/s)", filterSeconds * 1e3, inserted.GetNodeCount() / filterSeconds / 1e6);
+        fmt::println("  attributes {:.2f} MB", inserted.GetAttributeBufferSize() / 1048576.0);
+        fmt::println("  build      {}", inserted.m_Attributes == built.m_Attributes ? "identical" : "DIFFERENT");
+
+        // Coverage by depth, read back from the serialized attributes the way the shader sees them
+        std::vector<double> coverage(depth + 1);
+        std::vector<uint64_t> nodes(depth + 1);
+        std::vector<std::pair<uint32_t, int>> stack = { { 0, 0 } };
+        while (!stack.empty()) {
+            auto [slot, level] = stack.back();
+            stack.pop_back();
+
+            coverage[level] += (inserted.m_Attributes[slot] >> 24) / 255.0;
+            nodes[level]++;
+            if (level == depth)
+                continue;
+
+            uint32_t desc = inserted.m_Buffer[slot];
+            uint32_t offset = (desc & (1 << 16)) ? inserted.m_Far[desc >> 17] : desc >> 17;
+            for (int i = 0; i < std::popcount(desc & 0xFF); i++)
+                stack.push_back({ slot + offset + i, level + 1 });
+        }
+
+        fmt::println("  {:>5} {:>10} {:>10}", "depth", "nodes", "coverage");
+        for (int level = 0; level <= depth; level++)
+            fmt::println("  {:>5} {:>10} {:>10.3f}", level, nodes[level], coverage[level] / std::max<uint64_t>(nodes[level], 1));
+    }
+
+    void SvoQueries(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        size_t rayCount = args.GetInt(2, 4096);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = TiledTerrainPoints(count, (float)size, 8, 1);
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(points, {});
+        svo.CreateBuffer();
+
+        const std::pair<SvoQuery, const char*> backings[] = {
+            { SvoQuery(svo), "nodes" },
+            { SvoQuery(svo.m_Buffer, svo.m_Far, size, depth), "buffer" },
+        };
+
+        // Picking rays from above the terrain and line-of-sight rays between random pairs of points
+        std::vector<SvoRay> rays(rayCount);
+        std::vector<glm::vec3> targets = UniformPoints(rayCount, size * 0.9f, 2), from = UniformPoints(rayCount, (float)size, 3);
+        for (size_t i = 0; i < rayCount; i++) {
+            if (i % 2 == 0)
+                rays[i] = { glm::vec3(from[i].x, size * 0.45f, from[i].z), glm::vec3(targets[i].x * 0.2f, -size * 0.5f, targets[i].z * 0.2f) };
+            else
+                rays[i] = { from[i], targets[i] - from[i], glm::length(targets[i] - from[i]) };
+        }
+
+        std::vector<glm::vec3> probes = UniformPoints(100000, (float)size, 4);
+        std::vector<glm::vec3> boxes = UniformPoints(1000, (float)size, 5);
+
+        fmt::println("svo-query: {} terrain points, depth {}, {} voxels, {} rays per batch", count, depth, svo.GetVoxelCount(), rayCount);
+        fmt::println("  {:<8} {:>12} {:>12} {:>12} {:>14} {:>12}", "backing", "point ns", "box us", "ray us", "batch ms", "Mrays/s");
+
+        std::vector<std::vector<SvoRayHit>> results;
+        std::vector<size_t> occupiedCounts, boxCounts;
+        std::vector<std::pair<double, double>> budgets;
+        bool consistent = true;
+        for (const auto& [query, name] : backings) {
+            size_t occupied = 0;
+            Clock::time_point start = Clock::now();
+            for (const glm::vec3& p : probes)
+                occupied += query.IsOccupied(p);
+            for (size_t i = 0; i < points.size(); i += 97)
+                consistent &= query.IsOccupied(points[i]);
+            double pointSeconds = SecondsSince(start) / (probes.size() + (points.size() + 96) / 97);
+
+            std::vector<glm::uvec3> cells;
+            start = Clock::now();
+            for (const glm::vec3& b : boxes)
+                query.QueryBox(b - glm::vec3(8.f), b + glm::vec3(8.f), cells);
+            double boxSeconds = SecondsSince(start) / boxes.size();
+
+            start = Clock::now();
+            for (size_t i = 0; i < std::min<size_t>(rayCount, 1024); i++)
+                query.Raycast(rays[i]);
+            double raySeconds = SecondsSince(start) / std::min<size_t>(rayCount, 1024);
+
+            std::vector<SvoRayHit> hits(rayCount);
+            query.Raycast(rays, hits);
+            constexpr int Batches = 20;
+            double batchSeconds = 0, batchMax = 0;
+            for (int b = 0; b < Batches; b++) {
+                start = Clock::now();
+                query.Raycast(rays, hits);
+                double seconds = SecondsSince(start);
+                batchSeconds += seconds / Batches;
+                batchMax = std::max(batchMax, seconds);
+            }
+            budgets.push_back({ batchSeconds, batchMax });
+
+            // Every hit is an occupied cell that the ray actually reaches at the reported distance
+            for (size_t i = 0; i < rayCount; i++) {
+                if (!hits[i].Hit())
+                    continue;
+
+                auto [min, max] = query.CellBounds(hits[i].cell);
+                glm::vec3 at = rays[i].origin + glm::normalize(rays[i].direction) * hits[i].distance;
+                consistent &= query.IsOccupied((min + max) / 2.f) && glm::all(glm::greaterThan(at, min - 1e-2f)) && glm::all(glm::lessThan(at, max + 1e-2f));
+            }
+
+            fmt::println("  {:<8} {:>12.1f} {:>12.2f} {:>12.2f} {:>14.3f} {:>12.2f}", name, pointSeconds * 1e9, boxSeconds * 1e6, raySeconds * 1e6,
+                batchSeconds * 1e3, rayCount / batchSeconds / 1e6);
+
+            results.push_back(std::move(hits));
+            occupiedCounts.push_back(occupied);
+            boxCounts.push_back(cells.size());
+        }
+
+        size_t hitCount = 0;
+        bool agree = occupiedCounts[0] == occupiedCounts[1] && boxCounts[0] == boxCounts[1];
+        for (size_t i = 0; i < rayCount; i++) {
+            agree &= results[0][i].Hit() == results[1][i].Hit() && results[0][i].cell == results[1][i].cell;
+            hitCount += results[0][i].Hit();
+        }
+
+        fmt::println("  {} of {} rays hit, {} voxels in boxes", hitCount, rayCount, boxCounts[0]);
+        fmt::println("  results    {}, {}", agree ? "backings agree" : "BACKINGS DIFFER", consistent ? "consistent" : "INCONSISTENT");
+
+        // Gameplay gets 1 ms of CPU per frame for its picking and line-of-sight batch; the worst batch has to fit
+        constexpr double FrameBudget = 1e-3;
+        for (size_t b = 0; b < budgets.size(); b++) {
+            auto [avg, worst] = budgets[b];
+            fmt::println("  budget     {:<8} {} rays in {:.3f} ms worst: {}, ~{} rays fit in 1 ms", backings[b].second, rayCount, worst * 1e3,
+                worst <= FrameBudget ? "within 1 ms" : "OVER 1 ms", (size_t)(rayCount * FrameBudget / avg));
+        }
+    }
+
+    void SvoRender(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        int width = args.GetInt(2, 1280);
+        int height = args.GetInt(3, 720);
+        std::string path = args.GetString(4, "svo-render.png");
+        int size = 1024;
+
+        // Terrain shaded by height, so the image shows the hills
+        std::vector<glm::vec3> points = TiledTerrainPoints(count, (float)size, 8, 1);
+        std::vector<glm::vec3> colors(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+            colors[i] = glm::mix(glm::vec3(0.2f, 0.45f, 0.15f), glm::vec3(0.8f, 0.75f, 0.6f), glm::clamp(points[i].y / (size / 8.f) + 0.5f, 0.f, 1.f));
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(points, colors);
+        svo.CreateBuffer();
+
+        CpuRaymarcher raymarcher(svo);
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), 1.f);
+
+        CpuFrame frame;
+        frame.width = width;
+        frame.height = height;
+
+        fmt::println("svo-render: {} terrain points, depth {}, {}x{}, {} packets of {} rays", count, depth, width, height,
+            CpuRaymarcher::GetInstructionSet(), CpuRaymarcher::GetPacketWidth());
+
+        CpuRenderSettings settings;
+        settings.multithreaded = false;
+        CpuRenderStats single = raymarcher.Render(camera, frame, settings);
+        settings.multithreaded = true;
+        CpuRenderStats multi = raymarcher.Render(camera, frame, settings);
+
+        fmt::println("  1 thread     {:.1f} ms  {:.2f} Mrays/s  {:.1f} box tests per packet", single.seconds * 1e3, single.RaysPerSecond() / 1e6,
+            (double)single.nodeTests / std::max<uint64_t>(single.packets, 1));
+        fmt::println("  {} threads   {:.1f} ms  {:.2f} Mrays/s  {:.2f} Mrays/s per thread  {:.2f}x", multi.threads, multi.seconds * 1e3,
+            multi.RaysPerSecond() / 1e6, multi.RaysPerSecondPerThread() / 1e6, single.seconds / multi.seconds);
+        fmt::println("  image        {} {}", path, frame.WritePng(path) ? "written" : "NOT WRITTEN");
+
+        // Without LOD every primary hit is a leaf, which the scalar query API must find at the same distance
+        settings.lod = false;
+        raymarcher.Render(camera, frame, settings);
+
+        SvoQuery query(svo);
+        float cellSize = (float)size / (1 << depth);
+        size_t sampled = 0, agree = 0;
+        for (int y = 0; y < height; y += 7) {
+            for (int x = 0; x < width; x += 7) {
+                SvoRayHit hit = query.Raycast({ camera.position, camera.Direction(x + 0.5f, y + 0.5f, width, height) });
+                float distance = frame.distance[(size_t)y * width + x];
+                agree += hit.Hit() == (distance != INFINITY) && (!hit.Hit() || std::abs(hit.distance - distance) < cellSize * 0.01f);
+                sampled++;
+            }
+        }
+        fmt::println("  reference    {} of {} sampled pixels match SvoQuery", agree, sampled);
+    }
+
+    void SvoBricks(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        int width = args.GetInt(2, 1280);
+        int height = args.GetInt(3, 720);
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), 1.f);
+        CpuRenderSettings settings;
+        settings.lod = false;
+
+        fmt::println("svo-bricks: {} terrain points, depth {}, {}x{} without LOD", count, depth, width, height);
+        fmt::println("  {:<8} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}", "bricks", "encode ms", "slots", "bricks MB", "total MB", "Mrays/s", "same hits");
+
+        std::vector<float> reference;
+        for (int levels : { 0, 2, 3 }) {
+            svo.SetBrickLevels(levels);
+            Clock::time_point start = Clock::now();
+            svo.CreateBuffer();
+            double seconds = SecondsSince(start);
+
+            CpuFrame frame;
+            frame.width = width;
+            frame.height = height;
+            CpuRaymarcher raymarcher(svo);
+            raymarcher.Render(camera, frame, settings);
+            CpuRenderStats stats = raymarcher.Render(camera, frame, settings);
+
+            // Bricks hold the same voxels, so every pixel hits the same cell face
+            if (levels == 0)
+                reference = frame.distance;
+            size_t same = 0;
+            for (size_t i = 0; i < reference.size(); i++)
+                same += reference[i] == frame.distance[i] || std::abs(reference[i] - frame.distance[i]) < 1e-2f;
+
+            size_t total = svo.GetBufferSize() + svo.GetFarBufferSize() + svo.GetAttributeBufferSize() + svo.GetBrickBufferSize();
+            std::string name = levels == 0 ? "none" : fmt::format("{}^3", 1 << levels);
+            fmt::println("  {:<8} {:>10.1f} {:>10} {:>10.2f} {:>10.2f} {:>10.2f} {:>9.2f}%", name, seconds * 1e3, svo.m_Buffer.size(),
+                svo.GetBrickBufferSize() / 1048576.0, total / 1048576.0, stats.RaysPerSecond() / 1e6, 100.0 * same / reference.size());
+        }
+    }
+
+    void Svo64(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 5);
+        size_t rayCount = args.GetInt(2, 65536);
+        size_t insertCount = std::min<size_t>(count, args.GetInt(3, 500000));
+        uint32_t width = args.GetInt(4, 1280);
+        uint32_t height = args.GetInt(5, 720);
+        int frames = std::max(args.GetInt(6, 20), 1);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = TiledTerrainPoints(count, (float)size, 8, 1);
+
+        std::vector<SvoRay> rays(rayCount);
+        std::vector<glm::vec3> targets = UniformPoints(rayCount, size * 0.9f, 2), from = UniformPoints(rayCount, (float)size, 3);
+        for (size_t i = 0; i < rayCount; i++)
+            rays[i] = { from[i], targets[i] - from[i] };
+
+        // Same resolution, so both trees hold the same voxels
+        SparseVoxelOctree octree(size, 2 * depth);
+        SparseVoxel64Tree tree64(size, depth);
+        TreeTimings octreeTimings = TimeTree(octree, points, insertCount, rays);
+        TreeTimings timings64 = TimeTree(tree64, points, insertCount, rays);
+
+        size_t agree = 0, hitCount = 0;
+        for (size_t i = 0; i < rayCount; i++) {
+            const SvoRayHit& a = octreeTimings.hits[i];
+            const SvoRayHit& b = timings64.hits[i];
+            agree += a.Hit() == b.Hit() && (!a.Hit() || a.cell == b.cell);
+            hitCount += a.Hit();
+        }
+
+        fmt::println("svo-64: {} terrain points, {} levels of 64 vs {} levels of 8, {} voxels", count, depth, 2 * depth, octree.GetVoxelCount());
+        fmt::println("  {:<8} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}", "tree", "insert ms", "build ms", "encode ms", "nodes", "pool MB", "buffer MB", "Mrays/s");
+        auto printRow = [&](const char* name, const auto& tree, const TreeTimings& timings) {
+            fmt::println("  {:<8} {:>10.1f} {:>10.1f} {:>10.1f} {:>10} {:>10.1f} {:>10.2f} {:>10.2f}", name, timings.insert * 1e3, timings.build * 1e3,
+                timings.encode * 1e3, tree.GetNodeCount(), tree.GetNodeMemory() / 1048576.0,
+                (tree.GetBufferSize() + tree.GetFarBufferSize() + tree.GetAttributeBufferSize()) / 1048576.0, rayCount / timings.rays / 1e6);
+        };
+        printRow("octree", octree, octreeTimings);
+        printRow("64-tree", tree64, timings64);
+        fmt::println("  {} of {} rays hit, {} agree, voxels {}", hitCount, rayCount, agree,
+            octree.GetVoxelCount() == tree64.GetVoxelCount() ? "identical" : "DIFFERENT");
+
+        // Each tree's kernel on the same view: raymarch.comp for the octree, raymarch64.comp for the 64-ary tree
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), glm::radians(90.f));
+        double octreeMilliseconds = 0, milliseconds64 = 0;
+        std::vector<glm::vec4> octreePixels, pixels64;
+        if (!DrawTree(octree, RaymarchShader, camera, { width, height }, frames, octreeMilliseconds, octreePixels) ||
+            !DrawTree(tree64, Raymarch64Shader, camera, { width, height }, frames, milliseconds64, pixels64))
+            return;
+
+        // raymarch64.comp leaves its background color wherever the ray misses, which has to be where Svo64Query misses too
+        std::vector<SvoRay> pixelRays((size_t)width * height);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++)
+                pixelRays[(size_t)y * width + x] = { camera.position, camera.Direction(x + 0.5f, y + 0.5f, width, height) };
+        }
+        std::vector<SvoRayHit> pixelHits(pixelRays.size());
+        Svo64Query(tree64).Raycast(pixelRays, pixelHits);
+
+        const glm::vec3 background(0.18f, 0.22f, 0.4f);
+        size_t same = 0;
+        for (size_t i = 0; i < pixelHits.size(); i++) {
+            bool drawn = glm::any(glm::greaterThan(glm::abs(glm::vec3(pixels64[i]) - background), glm::vec3(1.f / 255.f)));
+            same += drawn == pixelHits[i].Hit();
+        }
+
+        fmt::println("  gpu        {}x{}, {} frames: octree {:.3f} ms, 64-tree {:.3f} ms, {:.2f}% of pixels hit where Svo64Query hits",
+            width, height, frames, octreeMilliseconds, milliseconds64, 100.0 * same / pixelHits.size());
+    }
+
+    void SvoDistance(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        int width = args.GetInt(2, 1280);
+        int height = args.GetInt(3, 720);
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+
+        // Open terrain from above, and skimming it towards the far corner where most rays end in the sky
+        struct View {
+            const char* name;
+            CpuCamera camera;
+        };
+        const View views[] = {
+            { "overview", CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), 1.f) },
+            { "horizon", CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.12f, -size * 0.45f), glm::vec3(size * 0.45f, size * 0.06f, size * 0.45f), 1.f) },
+        };
+
+        fmt::println("svo-distance: {} terrain points, depth {}, {}x{}, raymarch.comp's loop without LOD", count, depth, width, height);
+        fmt::println("  {:<6} {:<10} {:>10} {:>10} {:>12} {:>10} {:>10}", "grid", "view", "encode ms", "field KB", "iterations", "at limit", "same hits");
+
+        CpuFrame frame;
+        frame.width = width;
+        frame.height = height;
+        std::vector<std::vector<uint16_t>> referenceIterations(std::size(views));
+        std::vector<std::vector<float>> referenceDistances(std::size(views));
+
+        for (int level : { 0, 4, 5, 6, 7 }) {
+            svo.SetDistanceLevel(level);
+            Clock::time_point start = Clock::now();
+            svo.CreateBuffer();
+            double seconds = SecondsSince(start);
+
+            CpuRaymarcher raymarcher(svo);
+            for (size_t v = 0; v < std::size(views); v++) {
+                std::vector<uint16_t> iterations = raymarcher.CountShaderIterations(views[v].camera, frame, level > 0);
+                if (level == 0) {
+                    referenceIterations[v] = iterations;
+                    referenceDistances[v] = frame.distance;
+                }
+
+                // Skipping only passes over empty cells, so rays that finished before must stop at the same leaf
+                uint64_t total = 0;
+                size_t limited = 0, finished = 0, same = 0;
+                for (size_t i = 0; i < iterations.size(); i++) {
+                    total += iterations[i];
+                    limited += iterations[i] >= CpuRaymarcher::MaxShaderIterations;
+                    if (referenceIterations[v][i] < CpuRaymarcher::MaxShaderIterations) {
+                        float reference = referenceDistances[v][i];
+                        finished++;
+                        same += reference == frame.distance[i] || std::abs(reference - frame.distance[i]) < 1e-2f;
+                    }
+                }
+
+                std::string grid = level == 0 ? "off" : fmt::format("{}^3", 1 << level);
+                fmt::println("  {:<6} {:<10} {:>10.1f} {:>10.1f} {:>12.1f} {:>9.2f}% {:>9.2f}%", grid, views[v].name, seconds * 1e3,
+                    svo.GetDistanceBufferSize() / 1024.0, (double)total / iterations.size(), 100.0 * limited / iterations.size(),
+                    100.0 * same / std::max<size_t>(finished, 1));
+            }
+        }
+    }
+
+    void SvoWide(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 12);
+        int width = args.GetInt(2, 640);
+        int height = args.GetInt(3, 360);
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), 1.f);
+        CpuRenderSettings settings;
+        settings.lod = false;
+        SvoQuery reference(svo);
+
+        fmt::println("svo-wide: {} terrain points, depth {}, {}x{} without LOD", count, depth, width, height);
+        fmt::println("  {:<6} {:<8} {:>10} {:>10} {:>8} {:>10} {:>10} {:>10}", "tree", "format", "encode ms", "slots", "far", "total MB", "Mrays/s", "same hits");
+
+        for (bool compressed : { false, true }) {
+            if (compressed)
+                svo.Compress();
+
+            for (DescriptorFormat format : { DescriptorFormat::Compact, DescriptorFormat::Wide }) {
+                svo.SetDescriptorFormat(format);
+                Clock::time_point start = Clock::now();
+                svo.CreateBuffer();
+                double seconds = SecondsSince(start);
+
+                CpuFrame frame;
+                frame.width = width;
+                frame.height = height;
+                CpuRaymarcher raymarcher(svo);
+                CpuRenderStats stats = raymarcher.Render(camera, frame, settings);
+
+                // Both the buffer query and the renderer must see what the node graph does
+                SvoQuery query(svo.m_Buffer, svo.m_Far, size, depth, svo.GetBufferFormat());
+                size_t sampled = 0, same = 0;
+                for (int y = 0; y < height; y += 5) {
+                    for (int x = 0; x < width; x += 5) {
+                        SvoRay ray{ camera.position, camera.Direction(x + 0.5f, y + 0.5f, width, height) };
+                        SvoRayHit expected = reference.Raycast(ray), hit = query.Raycast(ray);
+                        float distance = frame.distance[(size_t)y * width + x];
+                        same += hit.Hit() == expected.Hit() && hit.cell == expected.cell && expected.Hit() == (distance != INFINITY) &&
+                            (!expected.Hit() || std::abs(expected.distance - distance) < 1e-2f);
+                        sampled++;
+                    }
+                }
+
+                size_t total = svo.GetBufferSize() + svo.GetFarBufferSize() + svo.GetAttributeBufferSize();
+                fmt::println("  {:<6} {:<8} {:>10.1f} {:>10} {:>8} {:>10.2f} {:>10.2f} {:>9.2f}%", compressed ? "dag" : "tree",
+                    format == DescriptorFormat::Wide ? "wide" : "compact", seconds * 1e3, svo.m_Attributes.size(), svo.m_Far.size(),
+                    total / 1048576.0, stats.RaysPerSecond() / 1e6, 100.0 * same / sampled);
+            }
+        }
+    }
+
+    void SvoEdit(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        float brush = args.GetFloat(2, 4.f);
+        int strokes = args.GetInt(3, 64);
+        float slack = args.GetFloat(4, 0.25f);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = TiledTerrainPoints(count, (float)size, 8, 1);
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(points, {});
+        svo.SetDistanceLevel(6);
+        svo.SetEditSlack(slack);
+
+        Clock::time_point start = Clock::now();
+        svo.CreateBuffer();
+        double fullSeconds = SecondsSince(start);
+
+        fmt::println("svo-edit: {} terrain points, depth {}, {} strokes of radius {}, slack {}", count, depth, strokes, brush, slack);
+        fmt::println("  full encode   {:.1f} ms, {:.1f} MB", fullSeconds * 1e3,
+            (svo.GetBufferSize() + svo.GetFarBufferSize() + svo.GetAttributeBufferSize() + svo.GetDistanceBufferSize()) / 1048576.0);
+
+        // Strokes alternate between adding a ball of voxels on the terrain and carving one out
+        float cell = (float)size / (1 << depth);
+        std::mt19937 rng(7);
+        double editSeconds = 0, updateSeconds = 0, worstUpdate = 0;
+        uint64_t uploadedBytes = 0, edits = 0;
+        int fullUpdates = 0;
+        std::vector<SvoDirtyRange> ranges;
+        for (int stroke = 0; stroke < strokes; stroke++) {
+            glm::vec3 center = points[rng() % points.size()];
+            bool add = stroke % 2 == 0;
+
+            start = Clock::now();
+            for (float z = -brush; z <= brush; z += cell) {
+                for (float y = -brush; y <= brush; y += cell) {
+                    for (float x = -brush; x <= brush; x += cell) {
+                        if (x * x + y * y + z * z > brush * brush)
+                            continue;
+                        glm::vec3 p = center + glm::vec3(x, y, z);
+                        if (add) {
+                            svo.Insert(p, glm::vec3(1.f, 0.3f, 0.2f));
+                            edits++;
+                        }
+                        else
+                            edits += svo.Remove(p);
+                    }
+                }
+            }
+            editSeconds += SecondsSince(start);
+
+            start = Clock::now();
+            SvoBufferUpdate update = svo.UpdateBuffer();
+            double seconds = SecondsSince(start);
+            updateSeconds += seconds;
+            worstUpdate = std::max(worstUpdate, seconds);
+
+            if (update.full) {
+                fullUpdates++;
+                uploadedBytes += svo.GetBufferSize() + svo.GetFarBufferSize() + svo.GetAttributeBufferSize() + svo.GetDistanceBufferSize();
+                continue;
+            }
+            for (const std::vector<SvoDirtyRange>* list : { &update.buffer, &update.far, &update.attributes, &update.distances }) {
+                for (const SvoDirtyRange& range : *list)
+                    uploadedBytes += range.count * sizeof(uint32_t);
+            }
+        }
+
+        fmt::println("  edits         {} voxels, {:.2f} ms per stroke", edits, editSeconds * 1e3 / strokes);
+        fmt::println("  update        {:.3f} ms per stroke, worst {:.3f} ms, {} full", updateSeconds * 1e3 / strokes, worstUpdate * 1e3, fullUpdates);
+        fmt::println("  upload        {:.1f} KB per stroke", uploadedBytes / 1024.0 / strokes);
+
+        // The patched buffer must trace exactly like the edited node graph
+        SvoQuery reference(svo);
+        SvoQuery patched(svo.m_Buffer, svo.m_Far, size, depth, svo.GetBufferFormat());
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), 1.f);
+        size_t sampled = 0, same = 0;
+        for (int y = 0; y < 360; y += 2) {
+            for (int x = 0; x < 640; x += 2) {
+                SvoRay ray{ camera.position, camera.Direction(x + 0.5f, y + 0.5f, 640, 360) };
+                SvoRayHit expected = reference.Raycast(ray), hit = patched.Raycast(ray);
+                same += hit.Hit() == expected.Hit() && hit.cell == expected.cell;
+                sampled++;
+            }
+        }
+        fmt::println("  same hits     {:.2f}%", 100.0 * same / sampled);
+    }
+
+    void SvoSnapshots(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        int readers = args.GetInt(2, std::max(1, (int)std::thread::hardware_concurrency() - 1));
+        float duration = args.GetFloat(3, 2.f);
+        int batch = args.GetInt(4, 64);
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+        uint32_t nodesBefore = svo.GetNodeCount();
+
+        // The writer toggles pairs of voxels in empty space, always both in the same version, so a
+        // reader that sees only one of a pair saw a torn version
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> across(-size * 0.45f, size * 0.45f), above(size * 0.3f, size * 0.45f);
+        SvoQuery initial(svo);
+        std::vector<std::pair<glm::vec3, glm::vec3>> pairs;
+        while (pairs.size() < 4096) {
+            glm::vec3 a(across(rng), above(rng), across(rng)), b(-a.x, a.y, -a.z);
+            if (!initial.IsOccupied(a) && !initial.IsOccupied(b))
+                pairs.push_back({ a, b });
+        }
+
+        VersionedSvo versions(svo, readers);
+        std::atomic<bool> stop = false;
+        std::atomic<uint64_t> torn = 0;
+        std::vector<std::vector<float>> pinNanoseconds(readers), queryNanoseconds(readers);
+
+        std::vector<std::thread> threads;
+        for (int r = 0; r < readers; r++) {
+            threads.emplace_back([&, r]() {
+                uint32_t reader = versions.RegisterReader();
+                std::mt19937 local(100 + r);
+                std::uniform_real_distribution<float> spread = across;
+                for (uint64_t op = 0; !stop.load(std::memory_order_relaxed); op++) {
+                    const auto& [a, b] = pairs[local() % pairs.size()];
+                    SvoRay ray{ glm::vec3(spread(local), size * 0.4f, spread(local)), glm::vec3(0.3f, -1.f, 0.2f) };
+
+                    Clock::time_point start = Clock::now();
+                    SvoSnapshot snapshot = versions.Pin(reader);
+                    Clock::time_point pinned = Clock::now();
+                    SvoQuery query = snapshot.Query();
+                    torn += query.IsOccupied(a) != query.IsOccupied(b);
+                    query.Raycast(ray);
+                    snapshot.Release();
+                    Clock::time_point end = Clock::now();
+
+                    // Every 16th read is enough for the percentiles and keeps the samples small
+                    if (op % 16 == 0) {
+                        pinNanoseconds[r].push_back(std::chrono::duration<float, std::nano>(pinned - start).count());
+                        queryNanoseconds[r].push_back(std::chrono::duration<float, std::nano>(end - start).count());
+                    }
+                }
+                versions.UnregisterReader(reader);
+            });
+        }
+
+        // One writer: batches of pair toggles, each published as one version
+        std::vector<bool> present(pairs.size());
+        std::vector<float> publishNanoseconds;
+        uint64_t edits = 0;
+        Clock::time_point begin = Clock::now();
+        while (SecondsSince(begin) < duration) {
+            for (int i = 0; i < batch; i++) {
+                size_t k = rng() % pairs.size();
+                if (present[k]) {
+                    versions.Remove(pairs[k].first);
+                    versions.Remove(pairs[k].second);
+                }
+                else {
+                    versions.Insert(pairs[k].first, glm::vec3(1.f, 0.f, 0.f));
+                    versions.Insert(pairs[k].second, glm::vec3(0.f, 0.f, 1.f));
+                }
+                present[k] = !present[k];
+                edits += 2;
+            }
+
+            Clock::time_point start = Clock::now();
+            versions.Publish();
+            publishNanoseconds.push_back(std::chrono::duration<float, std::nano>(Clock::now() - start).count());
+        }
+        double seconds = SecondsSince(begin);
+        stop = true;
+        for (std::thread& thread : threads)
+            thread.join();
+
+        auto report = [](const char* name, std::vector<float> samples) {
+            std::sort(samples.begin(), samples.end());
+            auto at = [&](double q) { return samples.empty() ? 0.f : samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))]; };
+            fmt::println("  {:<10} {:>10} {:>9.0f} {:>9.0f} {:>9.0f} {:>9.0f} {:>9.0f}", name, samples.size(), at(0.5), at(0.9), at(0.99),
+                at(0.999), samples.empty() ? 0.f : samples.back());
+        };
+
+        std::vector<float> pins, queries;
+        for (int r = 0; r < readers; r++) {
+            pins.insert(pins.end(), pinNanoseconds[r].begin(), pinNanoseconds[r].end());
+            queries.insert(queries.end(), queryNanoseconds[r].begin(), queryNanoseconds[r].end());
+        }
+
+        fmt::println("svo-snapshot: {} terrain points, depth {}, 1 writer and {} readers for {:.1f} s, {} edits per version", count, depth,
+            readers, seconds, batch);
+        fmt::println("  versions   {} ({:.0f}/s), {:.2f} Medits/s", versions.GetVersion(), versions.GetVersion() / seconds, edits / seconds / 1e6);
+        fmt::println("  nodes      {} -> {} in the pool, {} retired, {} free", nodesBefore, svo.GetNodeCount(), versions.GetRetiredNodes(),
+            versions.GetFreeNodes());
+        fmt::println("  torn reads {}", torn.load());
+        fmt::println("  {:<10} {:>10} {:>9} {:>9} {:>9} {:>9} {:>9}", "ns", "samples", "p50", "p90", "p99", "p99.9", "max");
+        report("pin", pins);
+        report("read", queries);
+        report("publish", publishNanoseconds);
+    }
+
+    void SvoImport(const Args& args) {
+        size_t count = args.GetInt(0, 20000000);
+        int depth = args.GetInt(1, 12);
+        size_t memoryBytes = (size_t)args.GetInt(2, 64) << 20;
+        std::string format = args.GetString(3, "ply");
+        std::string path = args.GetString(4, format == "xyz" ? "svo-import.xyz" : "svo-import.ply");
+        int size = 1024;
+
+        // A synthetic scan: rolling terrain with a little noise, colored by height, generated and
+        // written block by block so the cloud is never in memory as a whole
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> across(-size * 0.49f, size * 0.49f), noise(-0.5f, 0.5f);
+        auto next = [&](glm::vec3& p, glm::uvec3& color) {
+            float x = across(rng), z = across(rng);
+            float height = size / 12.f * (std::sin(x / 97.f) * std::cos(z / 131.f) + 0.3f * std::sin((x + z) / 23.f));
+            p = glm::vec3(x, height + noise(rng), z);
+            float t = glm::clamp(height / (size / 6.f) + 0.5f, 0.f, 1.f);
+            color = glm::uvec3(glm::vec3(60 + 160 * t, 120 + 80 * t, 60 + 40 * t));
+        };
+
+        Clock::time_point start = Clock::now();
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (format == "xyz") {
+                std::string text;
+                for (size_t i = 0; i < count; i++) {
+                    glm::vec3 p;
+                    glm::uvec3 color;
+                    next(p, color);
+                    fmt::format_to(std::back_inserter(text), "{} {} {} {} {} {}\n", p.x, p.y, p.z, color.r, color.g, color.b);
+                    if (text.size() > (1 << 20) || i + 1 == count) {
+                        file.write(text.data(), (std::streamsize)text.size());
+                        text.clear();
+                    }
+                }
+            }
+            else {
+                std::string header = fmt::format("ply\nformat binary_little_endian 1.0\nelement vertex {}\nproperty float x\nproperty float y\n"
+                    "property float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n", count);
+                file.write(header.data(), (std::streamsize)header.size());
+
+                constexpr size_t Stride = 15;
+                std::vector<char> block;
+                for (size_t i = 0; i < count; i++) {
+                    glm::vec3 p;
+                    glm::uvec3 color;
+                    next(p, color);
+                    size_t at = block.size();
+                    block.resize(at + Stride);
+                    memcpy(block.data() + at, &p, 12);
+                    block[at + 12] = (char)color.r;
+                    block[at + 13] = (char)color.g;
+                    block[at + 14] = (char)color.b;
+                    if (block.size() > (1 << 20) || i + 1 == count) {
+                        file.write(block.data(), (std::streamsize)block.size());
+                        block.clear();
+                    }
+                }
+            }
+            if (!file) {
+                fmt::println("svo-import: failed to write {}", path);
+                return;
+            }
+        }
+        double writeSeconds = SecondsSince(start);
+        uint64_t fileBytes = std::filesystem::file_size(path);
+
+        fmt::println("svo-import: {} synthetic points, depth {}, {} MB budget", count, depth, memoryBytes >> 20);
+        fmt::println("  file       {} {:.1f} MB, written in {:.1f} s", path, fileBytes / 1048576.0, writeSeconds);
+
+        SparseVoxelOctree svo(size, depth);
+        PointCloudImportSettings settings;
+        settings.memoryBytes = memoryBytes;
+        Clock::time_point lastReport = Clock::now();
+        start = Clock::now();
+        settings.progress = [&](const PointCloudImportProgress& progress) {
+            if (SecondsSince(lastReport) < 1.0)
+                return;
+            lastReport = Clock::now();
+            double seconds = SecondsSince(start);
+            fmt::println("  {:<6} {:>5.1f}%  {:>11} points  {:>6.2f} Mpoints/s  {} runs  {:.0f} MB resident", progress.phase,
+                100.0 * progress.bytesRead / std::max<uint64_t>(progress.totalBytes, 1), progress.points, progress.points / seconds / 1e6,
+                progress.runs, ResidentMemory() / 1048576.0);
+        };
+
+        PointCloudImportStats stats = svo.Import(path, settings);
+        double seconds = SecondsSince(start);
+        size_t peak = PeakResidentMemory();
+        if (!stats.ok)
+            return;
+
+        fmt::println("  points     {} ({} outside), {} voxels, {} nodes", stats.points, stats.outside, stats.voxels, svo.GetNodeCount());
+        fmt::println("  runs       {}, {:.1f} MB spilled", stats.runs, stats.spilledBytes / 1048576.0);
+        fmt::println("  import     {:.2f} s (sort {:.2f} s, merge {:.2f} s), {:.2f} Mpoints/s, {:.1f} MB/s", seconds, stats.sortSeconds,
+            stats.mergeSeconds, stats.points / seconds / 1e6, fileBytes / seconds / 1048576.0);
+        fmt::println("  peak RSS   {:.1f} MB", peak / 1048576.0);
+
+        // Small clouds are rebuilt in memory from the same points, the buffers must match exactly
+        if (count <= 10000000) {
+            rng.seed(3);
+            std::vector<glm::vec3> points(count), colors(count);
+            for (size_t i = 0; i < count; i++) {
+                glm::uvec3 color;
+                next(points[i], color);
+                colors[i] = glm::vec3(color) / 255.f;
+            }
+
+            SparseVoxelOctree reference(size, depth);
+            reference.Build(points, colors);
+            reference.CreateBuffer();
+            svo.CreateBuffer();
+            bool identical = svo.m_Buffer == reference.m_Buffer && svo.m_Far == reference.m_Far && svo.m_Attributes == reference.m_Attributes;
+            fmt::println("  in-memory  {}", identical ? "identical" : "MISMATCH");
+        }
+
+        std::filesystem::remove(path);
+    }
+
+    void SvoAttributes(const Args& args) {
+        size_t count = args.GetInt(0, 4000000);
+        int depth = args.GetInt(1, 10);
+        int width = args.GetInt(2, 640);
+        int height = args.GetInt(3, 360);
+        int size = 1024;
+
+        std::vector<glm::vec3> points = TiledTerrainPoints(count, (float)size, 8, 1);
+        std::vector<glm::vec3> colors(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+            colors[i] = glm::clamp(points[i] / (float)size + 0.5f, 0.f, 1.f);
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(points, colors);
+
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), 1.f);
+        CpuRenderSettings settings;
+        settings.lod = false;
+
+        // Stands in for a mapped staging buffer, faulted in before anything is timed
+        std::vector<uint8_t> staging;
+        auto upload = [&](const void* data, size_t bytes) {
+            staging.resize(std::max(staging.size(), bytes));
+            std::memset(staging.data(), 0, bytes);
+            double best = INFINITY;
+            for (int i = 0; i < 5; i++) {
+                Clock::time_point start = Clock::now();
+                std::memcpy(staging.data(), data, bytes);
+                best = std::min(best, SecondsSince(start));
+            }
+            return best;
+        };
+
+        fmt::println("svo-attributes: {} terrain points, depth {}, {}x{} without LOD", count, depth, width, height);
+        fmt::println("  {:<12} {:>10} {:>10} {:>10} {:>12} {:>10} {:>10}", "format", "encode ms", "slots", "MB", "bytes/voxel", "upload ms", "Mrays/s");
+
+        std::vector<uint32_t> rgba8;
+        for (AttributeFormat format : { AttributeFormat::RGBA8, AttributeFormat::ColorNormal }) {
+            svo.SetAttributeFormat(format);
+            Clock::time_point start = Clock::now();
+            svo.CreateBuffer();
+            double seconds = SecondsSince(start);
+
+            CpuFrame frame;
+            frame.width = width;
+            frame.height = height;
+            CpuRaymarcher raymarcher(svo);
+            CpuRenderStats stats = raymarcher.Render(camera, frame, settings);
+
+            size_t bytes = svo.GetAttributeBufferSize();
+            fmt::println("  {:<12} {:>10.1f} {:>10} {:>10.2f} {:>12.2f} {:>10.2f} {:>10.2f}", format == AttributeFormat::RGBA8 ? "rgba8" : "color-normal",
+                seconds * 1e3, svo.m_Attributes.size(), bytes / 1048576.0, (double)bytes / svo.GetVoxelCount(),
+                upload(svo.m_Attributes.data(), bytes) * 1e3, stats.RaysPerSecond() / 1e6);
+
+            if (format == AttributeFormat::RGBA8)
+                rgba8 = svo.m_Attributes;
+        }
+
+        // The same attributes as float32: color, coverage and normal
+        struct FloatAttributes {
+            glm::vec3 color;
+            float coverage;
+            glm::vec3 normal;
+        };
+        std::vector<FloatAttributes> floats(svo.m_Attributes.size());
+        double colorError = 0;
+        for (size_t i = 0; i < floats.size(); i++) {
+            uint32_t word = svo.m_Attributes[i];
+            floats[i].color = glm::vec3(word & 31, (word >> 5) & 63, (word >> 11) & 31) / glm::vec3(31.f, 63.f, 31.f);
+            floats[i].coverage = (word >> 28) / 15.f;
+            floats[i].normal = UnpackNormal((word >> 16) & 0xFFF);
+
+            glm::vec3 reference = glm::vec3(rgba8[i] & 0xFF, (rgba8[i] >> 8) & 0xFF, (rgba8[i] >> 16) & 0xFF) / 255.f;
+            glm::vec3 error = glm::abs(floats[i].color - reference);
+            colorError += std::max(error.x, std::max(error.y, error.z));
+        }
+
+        size_t floatBytes = floats.size() * sizeof(FloatAttributes);
+        fmt::println("  {:<12} {:>10} {:>10} {:>10.2f} {:>12.2f} {:>10.2f} {:>10}", "float32", "-", floats.size(), floatBytes / 1048576.0,
+            (double)floatBytes / svo.GetVoxelCount(), upload(floats.data(), floatBytes) * 1e3, "-");
+        fmt::println("  color-normal colors are off rgba8 by {:.2f}/255 on average", 255.0 * colorError / std::max<size_t>(floats.size(), 1));
+    }
+
+    // Frames go through SvoResidency exactly as in the engine, two in flight, with a new version staged
+    // every swapEvery frames; the last frame is read back and compared with CpuRaymarcher.
+    void SvoGpu(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        uint32_t width = args.GetInt(2, 640);
+        uint32_t height = args.GetInt(3, 360);
+        int frames = args.GetInt(4, 120);
+        int swapEvery = std::max(args.GetInt(5, 10), 1);
+        int size = 1024;
+
+        HeadlessRaymarch gpu;
+        if (!gpu.Init("svo-gpu", { width, height }))
+            return;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+        svo.CreateBuffer();
+        gpu.SetTree(svo.GetShaderConstants());
+
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), glm::radians(90.f));
+        ComputePushConstants push = RaymarchPushConstants(camera);
+
+        fmt::println("svo-gpu: {} on {}", gpu.deviceName, gpu.cpuDevice ? "CPU" : "GPU");
+        fmt::println("  {} terrain points, depth {}, {}x{}, {} frames, a new version every {}", count, depth, width, height, frames, swapEvery);
+
+        gpu.residency->Stage(svo);
+        double stageSeconds = 0, swapFrameSeconds = 0;
+        int swapFrames = 0;
+        Clock::time_point start = Clock::now();
+        for (int f = 0; f <= frames; f++) {
+            VkCommandBuffer cmd = gpu.Begin(f);
+            Clock::time_point frameStart = Clock::now();
+            if (f > 0 && f % swapEvery == 0) {
+                Clock::time_point stageStart = Clock::now();
+                gpu.residency->Stage(svo);
+                stageSeconds += SecondsSince(stageStart);
+            }
+
+            bool swapped = gpu.residency->Record(cmd, f, gpu.frames[f % HeadlessRaymarch::FramesInFlight]._deletionQueue);
+            gpu.Draw(cmd, f, push, true);
+            // The extra frame after the timed ones is read back
+            gpu.Submit(cmd, f, f == frames);
+
+            if (swapped && f > 0 && f < frames) {
+                swapFrameSeconds += SecondsSince(frameStart);
+                swapFrames++;
+            }
+        }
+        double seconds = SecondsSince(start);
+        gpu.Wait();
+
+        // The same view on the CPU
+        CpuFrame reference;
+        reference.width = width;
+        reference.height = height;
+        CpuRenderSettings settings;
+        settings.lod = false;
+        CpuRaymarcher(svo).Render(camera, reference, settings);
+
+        fmt::println("  frames     {:.2f} ms each, {} versions swapped in", seconds * 1e3 / (frames + 1), gpu.residency->GetVersion());
+        fmt::println("  stage      {:.2f} ms per version ({:.2f} MB), swap frames {:.2f} ms to record", stageSeconds * 1e3 / std::max(frames / swapEvery, 1),
+            gpu.residency->GetUploadedBytes() / 1048576.0, swapFrameSeconds * 1e3 / std::max(swapFrames, 1));
+        fmt::println("  resident   {:.2f} MB for both versions", gpu.residency->GetResidentBytes() / 1048576.0);
+        fmt::println("  same as CPU {:.2f}% of pixels", 100.0 * MatchingPixels(gpu.GetPixels(), reference));
+    }
+
+    // The raymarch with and without the beam prepass at 1080p and 4K: GPU time of both passes together,
+    // the full-resolution pass's iterations per pixel, and how many pixels the prepass changed
+    void SvoBeam(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        int frames = std::max(args.GetInt(2, 20), 1);
+        int size = 1024;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+        svo.CreateBuffer();
+
+        struct View {
+            const char* name;
+            CpuCamera camera;
+        };
+        View views[] = {
+            { "overview", CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), glm::radians(90.f)) },
+            { "grazing", CpuCamera::LookAt(glm::vec3(-size * 0.45f, -size * 0.05f, -size * 0.45f), glm::vec3(size * 0.5f, -size * 0.1f, size * 0.5f), glm::radians(90.f)) },
+        };
+        VkExtent2D extents[] = { { 1920, 1080 }, { 3840, 2160 } };
+
+        fmt::println("svo-beam: {} terrain points, depth {}, {}x{} beam tiles, {} timed frames", count, depth, SvoResidency::BeamTileSize, SvoResidency::BeamTileSize, frames);
+        for (VkExtent2D extent : extents) {
+            HeadlessRaymarch gpu;
+            if (!gpu.Init("svo-beam", extent))
+                return;
+            gpu.SetTree(svo.GetShaderConstants());
+            gpu.residency->Stage(svo);
+            fmt::println("  {}x{} on {}", extent.width, extent.height, gpu.deviceName);
+
+            uint64_t frame = 0;
+            // Renders one frame at a time and returns its GPU time, reading the image back if asked
+            auto render = [&](const ComputePushConstants& push, bool beam, bool readback, uint32_t features = RaymarchProduction) {
+                VkCommandBuffer cmd = gpu.Begin(frame);
+                gpu.residency->Record(cmd, frame, gpu.frames[frame % HeadlessRaymarch::FramesInFlight]._deletionQueue);
+                gpu.Draw(cmd, frame, push, beam, features);
+                gpu.Submit(cmd, frame, readback);
+                gpu.Wait();
+                return gpu.GetDrawMilliseconds(frame++);
+            };
+
+            for (const View& view : views) {
+                size_t pixels = (size_t)extent.width * extent.height;
+                double milliseconds[2] = {}, iterations[2] = {};
+                std::vector<glm::vec4> colors[2];
+                for (int beam = 0; beam < 2; beam++) {
+                    ComputePushConstants push = RaymarchPushConstants(view.camera);
+                    render(push, beam, false);
+                    for (int f = 0; f < frames; f++)
+                        milliseconds[beam] += render(push, beam, false) / frames;
+
+                    render(push, beam, true);
+                    colors[beam].assign(gpu.GetPixels(), gpu.GetPixels() + pixels);
+
+                    render(push, beam, true, RaymarchProduction | RaymarchHeatmap);
+                    const glm::vec4* counts = gpu.GetPixels();
+                    for (size_t i = 0; i < pixels; i++)
+                        iterations[beam] += counts[i].x * RaymarchMaxIterations;
+                    iterations[beam] /= pixels;
+                }
+
+                size_t changed = 0;
+                for (size_t i = 0; i < pixels; i++)
+                    changed += glm::any(glm::greaterThan(glm::abs(colors[0][i] - colors[1][i]), glm::vec4(1.f / 255.f)));
+
+                fmt::println("    {:<9} {:7.2f} -> {:7.2f} iterations/pixel, {:7.3f} -> {:7.3f} ms, {} pixels changed", view.name,
+                    iterations[0], iterations[1], milliseconds[0], milliseconds[1], changed);
+            }
+        }
+    }
+
+    // The production variant with and without RaymarchEsvo on the same frames, without the beam prepass:
+    // GPU time, iterations per pixel and how many pixels the kernels disagree on. Deeper trees show
+    // where float child selection starts to lose precision.
+    void SvoTraversal(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        uint32_t width = args.GetInt(2, 1920);
+        uint32_t height = args.GetInt(3, 1080);
+        int frames = std::max(args.GetInt(4, 20), 1);
+        int size = 1024;
+
+        HeadlessRaymarch gpu;
+        if (!gpu.Init("svo-traversal", { width, height }))
+            return;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+        svo.CreateBuffer();
+        gpu.SetTree(svo.GetShaderConstants());
+        gpu.residency->Stage(svo);
+
+        struct View {
+            const char* name;
+            CpuCamera camera;
+        };
+        constexpr size_t ViewCount = 3;
+        View views[ViewCount] = {
+            { "overview", CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), glm::radians(90.f)) },
+            { "grazing", CpuCamera::LookAt(glm::vec3(-size * 0.45f, -size * 0.05f, -size * 0.45f), glm::vec3(size * 0.5f, -size * 0.1f, size * 0.5f), glm::radians(90.f)) },
+            { "close", CpuCamera::LookAt(glm::vec3(size * 0.1f, -size * 0.1f, size * 0.1f), glm::vec3(size * 0.2f, -size * 0.2f, size * 0.25f), glm::radians(90.f)) },
+        };
+        uint32_t kernels[] = { RaymarchProduction, RaymarchProduction | RaymarchEsvo };
+
+        fmt::println("svo-traversal: {} on {}", gpu.deviceName, gpu.cpuDevice ? "CPU" : "GPU");
+        fmt::println("  {} terrain points, depth {}, {}x{}, {} timed frames, stack -> esvo", count, depth, width, height, frames);
+
+        uint64_t frame = 0;
+        // Renders one frame at a time and returns its GPU time, reading the image back if asked
+        auto render = [&](const ComputePushConstants& push, uint32_t features, bool readback) {
+            VkCommandBuffer cmd = gpu.Begin(frame);
+            gpu.residency->Record(cmd, frame, gpu.frames[frame % HeadlessRaymarch::FramesInFlight]._deletionQueue);
+            gpu.Draw(cmd, frame, push, false, features);
+            gpu.Submit(cmd, frame, readback);
+            gpu.Wait();
+            return gpu.GetDrawMilliseconds(frame++);
+        };
+
+        size_t pixels = (size_t)width * height;
+        double milliseconds[ViewCount][2] = {}, iterations[ViewCount][2] = {};
+        std::vector<glm::vec4> colors[ViewCount][2];
+        for (int k = 0; k < 2; k++) {
+            for (size_t v = 0; v < ViewCount; v++) {
+                ComputePushConstants push = RaymarchPushConstants(views[v].camera);
+                render(push, kernels[k], false);
+                for (int f = 0; f < frames; f++)
+                    milliseconds[v][k] += render(push, kernels[k], false) / frames;
+
+                render(push, kernels[k], true);
+                colors[v][k].assign(gpu.GetPixels(), gpu.GetPixels() + pixels);
+
+                render(push, kernels[k] | RaymarchHeatmap, true);
+                const glm::vec4* counts = gpu.GetPixels();
+                for (size_t i = 0; i < pixels; i++)
+                    iterations[v][k] += counts[i].x * RaymarchMaxIterations;
+                iterations[v][k] /= pixels;
+            }
+        }
+
+        for (size_t v = 0; v < ViewCount; v++) {
+            size_t changed = 0;
+            for (size_t i = 0; i < pixels; i++)
+                changed += glm::any(glm::greaterThan(glm::abs(colors[v][0][i] - colors[v][1][i]), glm::vec4(1.f / 255.f)));
+
+            fmt::println("  {:<9} {:7.2f} -> {:7.2f} iterations/pixel, {:7.3f} -> {:7.3f} ms, {} pixels differ", views[v].name,
+                iterations[v][0], iterations[v][1], milliseconds[v][0], milliseconds[v][1], changed);
+        }
+    }
+
+    // Every RaymarchFeature combination: how long its variant takes to build through the shared pipeline
+    // cache, and its GPU time on the same frames with the beam prepass
+    void SvoVariants(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        uint32_t width = args.GetInt(2, 1920);
+        uint32_t height = args.GetInt(3, 1080);
+        int frames = std::max(args.GetInt(4, 20), 1);
+        int size = 1024;
+
+        HeadlessRaymarch gpu;
+        if (!gpu.Init("svo-variants", { width, height }))
+            return;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+        svo.CreateBuffer();
+        gpu.SetTree(svo.GetShaderConstants());
+        gpu.residency->Stage(svo);
+
+        CpuCamera camera = CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), glm::radians(90.f));
+        ComputePushConstants push = RaymarchPushConstants(camera);
+
+        fmt::println("svo-variants: {} on {}", gpu.deviceName, gpu.cpuDevice ? "CPU" : "GPU");
+        fmt::println("  {} terrain points, depth {}, {}x{}, {} timed frames", count, depth, width, height, frames);
+        fmt::println("  {:<6} {:<9} {:<8} {:>10} {:>10}", "esvo", "heatmap", "lighting", "build ms", "frame ms");
+
+        uint64_t frame = 0;
+        for (uint32_t features = 0; features <= RaymarchFeatureMask; features++) {
+            Clock::time_point start = Clock::now();
+            gpu.pipelines->Get(features);
+            double buildSeconds = SecondsSince(start);
+
+            double milliseconds = 0;
+            for (int f = 0; f <= frames; f++) {
+                VkCommandBuffer cmd = gpu.Begin(frame);
+                gpu.residency->Record(cmd, frame, gpu.frames[frame % HeadlessRaymarch::FramesInFlight]._deletionQueue);
+                gpu.Draw(cmd, frame, push, true, features);
+                gpu.Submit(cmd, frame, false);
+                gpu.Wait();
+                // The first frame warms up
+                if (f > 0)
+                    milliseconds += gpu.GetDrawMilliseconds(frame) / frames;
+                frame++;
+            }
+
+            fmt::println("  {:<6} {:<9} {:<8} {:>10.2f} {:>10.3f}", (features & RaymarchEsvo) ? "yes" : "no", (features & RaymarchHeatmap) ? "yes" : "no",
+                (features & RaymarchLighting) ? "yes" : "no", buildSeconds * 1e3, milliseconds);
+        }
+        fmt::println("  {} variants cached", gpu.pipelines->GetVariantCount());
+    }
+
+    // One workgroup per 32x32 block against persistent workgroups taking 8x8 tiles from the queue, on the
+    // same frames with the beam prepass: GPU time and how many pixels differ, which should be none. groups
+    // overrides the device's SvoResidency::GetPersistentGroups, and the sweep tries a few around it.
+    void SvoPersistent(const Args& args) {
+        size_t count = args.GetInt(0, 2000000);
+        int depth = args.GetInt(1, 10);
+        uint32_t width = args.GetInt(2, 1920);
+        uint32_t height = args.GetInt(3, 1080);
+        int frames = std::max(args.GetInt(4, 20), 1);
+        int groupsArg = args.GetInt(5, 0);
+        int size = 1024;
+
+        HeadlessRaymarch gpu;
+        if (!gpu.Init("svo-persistent", { width, height }))
+            return;
+        uint32_t groups = groupsArg > 0 ? (uint32_t)groupsArg : gpu.persistentGroups;
+
+        SparseVoxelOctree svo(size, depth);
+        svo.Build(TiledTerrainPoints(count, (float)size, 8, 1), {});
+        svo.CreateBuffer();
+        gpu.SetTree(svo.GetShaderConstants());
+        gpu.residency->Stage(svo);
+
+        struct View {
+            const char* name;
+            CpuCamera camera;
+        };
+        View views[] = {
+            { "overview", CpuCamera::LookAt(glm::vec3(-size * 0.45f, size * 0.2f, -size * 0.45f), glm::vec3(0.f, -size * 0.05f, 0.f), glm::radians(90.f)) },
+            { "grazing", CpuCamera::LookAt(glm::vec3(-size * 0.45f, -size * 0.05f, -size * 0.45f), glm::vec3(size * 0.5f, -size * 0.1f, size * 0.5f), glm::radians(90.f)) },
+            { "close", CpuCamera::LookAt(glm::vec3(size * 0.1f, -size * 0.1f, size * 0.1f), glm::vec3(size * 0.2f, -size * 0.2f, size * 0.25f), glm::radians(90.f)) },
+        };
+        uint32_t blocks = ((width + SvoResidency::GroupSize - 1) / SvoResidency::GroupSize) * ((height + SvoResidency::GroupSize - 1) / SvoResidency::GroupSize);
+
+        fmt::println("svo-persistent: {} on {}, {} persistent groups", gpu.deviceName, gpu.cpuDevice ? "CPU" : "GPU", groups);
+        fmt::println("  {} terrain points, depth {}, {}x{} ({} blocks), {} timed frames", count, depth, width, height, blocks, frames);
+
+        uint64_t frame = 0;
+        // Renders one frame at a time and returns its GPU time, reading the image back if asked
+        auto render = [&](const ComputePushConstants& push, uint32_t persistentGroups, bool readback) {
+            VkCommandBuffer cmd = gpu.Begin(frame);
+            gpu.residency->Record(cmd, frame, gpu.frames[frame % HeadlessRaymarch::FramesInFlight]._deletionQueue);
+            gpu.Draw(cmd, frame, push, true, RaymarchProduction, persistentGroups);
+            gpu.Submit(cmd, frame, readback);
+            gpu.Wait();
+            return gpu.GetDrawMilliseconds(frame++);
+        };
+        auto time = [&](const ComputePushConstants& push, uint32_t persistentGroups) {
+            double milliseconds = 0;
+            render(push, persistentGroups, false);
+            for (int f = 0; f < frames; f++)
+                milliseconds += render(push, persistentGroups, false) / frames;
+            return milliseconds;
+        };
+
+        size_t pixels = (size_t)width * height;
+        for (const View& view : views) {
+            ComputePushConstants push = RaymarchPushConstants(view.camera);
+            double milliseconds[2];
+            std::vector<glm::vec4> colors[2];
+            for (int persistent = 0; persistent < 2; persistent++) {
+                uint32_t persistentGroups = persistent ? groups : 0;
+                milliseconds[persistent] = time(push, persistentGroups);
+                render(push, persistentGroups, true);
+                colors[persistent].assign(gpu.GetPixels(), gpu.GetPixels() + pixels);
+            }
+
+            size_t changed = 0;
+            for (size_t i = 0; i < pixels; i++)
+                changed += colors[0][i] != colors[1][i];
+
+            fmt::println("  {:<9} grid {:7.3f} ms -> persistent {:7.3f} ms, {} pixels differ", view.name, milliseconds[0], milliseconds[1], changed);
+        }
+
+        // How the first view's time depends on the number of persistent groups
+        ComputePushConstants push = RaymarchPushConstants(views[0].camera);
+        fmt::println("  {} with persistent groups", views[0].name);
+        for (uint32_t scale : { 1u, 2u, 4u, 8u }) {
+            uint32_t persistentGroups = std::max(groups * scale / 4, 1u);
+            fmt::println("  {:>6} groups {:7.3f} ms", persistentGroups, time(push, persistentGroups));
+        }
+    }
+
+    void SvoVoxelize(const Args& args) {
+        int minDepth = args.GetInt(0, 6);
+        int maxDepth = args.GetInt(1, 10);
+        bool solid = args.GetInt(2, 0) != 0;
+        std::string path = args.GetString(3, "assets/basicmesh.glb");
+        int size = 1024;
+
+        std::optional<std::vector<MeshData>> meshes = loadGltfMeshData(path);
+        if (!meshes || meshes->empty())
+            return;
+
+        // The mesh with the most triangles, scaled to fill 90% of the volume
+        const MeshData& mesh = *std::max_element(meshes->begin(), meshes->end(),
+            [](const MeshData& a, const MeshData& b) { return a.indices.size() < b.indices.size(); });
+
+        glm::vec3 min(INFINITY), max(-INFINITY);
+        for (const Vertex& v : mesh.vertices) {
+            min = glm::min(min, v.position);
+            max = glm::max(max, v.position);
+        }
+
+        float scale = 0.9f * size / std::max({ max.x - min.x, max.y - min.y, max.z - min.z });
+        glm::vec3 center = (min + max) / 2.f;
+        glm::mat4 transform(scale);
+        transform[3] = glm::vec4(-center * scale, 1.f);
+
+        size_t triangles = mesh.indices.size() / 3;
+        fmt::println("svo-voxelize: {} '{}', {} triangles, {}", path, mesh.name, triangles, solid ? "solid" : "surface");
+        fmt::println("  {:>5} {:>10} {:>10} {:>12} {:>12}", "depth", "voxels", "ms", "Mtris/s", "Mvoxels/s");
+
+        for (int depth = minDepth; depth <= maxDepth; depth++) {
+            SparseVoxelOctree svo(size, depth);
+
+            Clock::time_point start = Clock::now();
+            uint64_t voxels = svo.Voxelize(mesh.vertices, mesh.indices, transform, solid);
+            double seconds = SecondsSince(start);
+
+            fmt::println("  {:>5} {:>10} {:>10.1f} {:>12.2f} {:>12.2f}", depth, voxels, seconds * 1e3, triangles / seconds / 1e6, voxels / seconds / 1e6);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "morton.h"
+
+void morton::RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int bits) {
+    constexpr int DigitBits = 11;
+    constexpr int Buckets = 1 << DigitBits;
+    constexpr int MaxPasses = (64 + DigitBits - 1) / DigitBits;
+
+    size_t count = keys.size();
+    int passes = (bits + DigitBits - 1) / DigitBits;
+    if (count < 2 || passes == 0)
+        return;
+
+    // One read of the keys builds the histograms for every pass
+    std::vector<size_t> offsets(MaxPasses * Buckets);
+    for (uint64_t key : keys) {
+        for (int pass = 0; pass < passes; pass++)
+            offsets[pass * Buckets + ((key >> (pass * DigitBits)) & (Buckets - 1))]++;
+    }
+
+    std::vector<uint64_t> keyScratch(count);
+    std::vector<uint32_t> valueScratch(count);
+
+    for (int pass = 0; pass < passes; pass++) {
+        int shift = pass * DigitBits;
+        size_t* histogram = &offsets[pass * Buckets];
+
+        // Every key shares this digit, the pass would be a copy
+        if (histogram[(keys[0] >> shift) & (Buckets - 1)] == count)
+            continue;
+
+        size_t sum = 0;
+        for (int i = 0; i < Buckets; i++) {
+            size_t c = histogram[i];
+            histogram[i] = sum;
+            sum += c;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t dst = histogram[(keys[i] >> shift) & (Buckets - 1)]++;
+            keyScratch[dst] = keys[i];
+            valueScratch[dst] = values[i];
+        }
+
+        keys.swap(keyScratch);
+        values.swap(valueScratch);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vk_types.h>
+
+namespace morton {
+    // 21 bits per axis fit in a 64-bit code
+    constexpr int MaxBitsPerAxis = 21;
+
+    // Spreads the low 21 bits of v so that bit i lands on bit 3i
+    inline uint64_t Spread(uint32_t v) {
+        uint64_t x = v & 0x1FFFFF;
+        x = (x | x << 32) & 0x001F00000000FFFFull;
+        x = (x | x << 16) & 0x001F0000FF0000FFull;
+        x = (x | x << 8) & 0x100F00F00F00F00Full;
+        x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+        x = (x | x << 2) & 0x1249249249249249ull;
+        return x;
+    }
+
+    inline uint32_t Compact(uint64_t x) {
+        x &= 0x1249249249249249ull;
+        x = (x ^ (x >> 2)) & 0x10C30C30C30C30C3ull;
+        x = (x ^ (x >> 4)) & 0x100F00F00F00F00Full;
+        x = (x ^ (x >> 8)) & 0x001F0000FF0000FFull;
+        x = (x ^ (x >> 16)) & 0x001F00000000FFFFull;
+        x = (x ^ (x >> 32)) & 0x1FFFFF;
+        return (uint32_t)x;
+    }
+
+    // x occupies the lowest bit of every triple, matching the octree child index (x | y << 1 | z << 2)
+    inline uint64_t Encode(glm::uvec3 p) {
+        return Spread(p.x) | (Spread(p.y) << 1) | (Spread(p.z) << 2);
+    }
+
+    inline glm::uvec3 Decode(uint64_t code) {
+        return glm::uvec3(Compact(code), Compact(code >> 1), Compact(code >> 2));
+    }
+
+    // Stable LSD radix sort of codes, carrying values along. Only the low `bits` of each key are sorted.
+    void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int bits);
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vk_types.h>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <type_traits>
+
+using NodeIndex = uint32_t;
+constexpr NodeIndex InvalidNode = UINT32_MAX;
+
+// Chunked arena addressed by 32-bit indices. Chunks never move once allocated, so references
+// stay valid while the pool grows, and the whole pool is released in O(chunks).
+// Reserve may be called from many threads at once; each caller owns the indices it gets back.
+template<typename T, uint32_t ChunkShift = 15>
+class ChunkedPool {
+    static_assert(std::is_trivially_destructible_v<T>, "ChunkedPool never runs destructors");
+
+public:
+    static constexpr uint32_t ChunkSize = 1u << ChunkShift;
+    static constexpr uint32_t ChunkMask = ChunkSize - 1;
+    static constexpr uint32_t MaxChunks = 1u << (32 - ChunkShift);
+
+    ChunkedPool() : m_Chunks(std::make_unique<std::atomic<T*>[]>(MaxChunks)) {}
+    ~ChunkedPool() { Clear(); }
+
+    ChunkedPool(const ChunkedPool&) = delete;
+    ChunkedPool& operator=(const ChunkedPool&) = delete;
+
+    NodeIndex Allocate() {
+        NodeIndex index = Reserve(1);
+        new (&(*this)[index]) T();
+        return index;
+    }
+
+    // Hands out `count` consecutive, unconstructed slots. Running out of 32-bit indices aborts, in
+    // release builds too, since the wrapped indices would alias live nodes.
+    NodeIndex Reserve(uint32_t count) {
+        NodeIndex first = m_Count.fetch_add(count, std::memory_order_relaxed);
+        if ((uint64_t)first + count >= InvalidNode) {
+            fmt::println("ChunkedPool ran out of indices reserving {} after {}", count, first);
+            abort();
+        }
+
+        for (uint32_t chunk = first >> ChunkShift; chunk <= (first + count - 1) >> ChunkShift; chunk++) {
+            if (m_Chunks[chunk].load(std::memory_order_acquire) != nullptr)
+                continue;
+
+            T* fresh = static_cast<T*>(::operator new(sizeof(T) * ChunkSize));
+            T* expected = nullptr;
+            if (!m_Chunks[chunk].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+                ::operator delete(fresh);
+        }
+
+        return first;
+    }
+
+    void Clear() {
+        uint32_t chunks = (m_Count.load(std::memory_order_relaxed) + ChunkMask) >> ChunkShift;
+        for (uint32_t chunk = 0; chunk < chunks; chunk++)
+            ::operator delete(m_Chunks[chunk].exchange(nullptr, std::memory_order_relaxed));
+
+        m_Count.store(0, std::memory_order_relaxed);
+    }
+
+    // Not thread-safe, neither pool may be in use
+    void Swap(ChunkedPool& other) {
+        m_Chunks.swap(other.m_Chunks);
+        uint32_t count = m_Count.load(std::memory_order_relaxed);
+        m_Count.store(other.m_Count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        other.m_Count.store(count, std::memory_order_relaxed);
+    }
+
+    T& operator[](NodeIndex index) { return m_Chunks[index >> ChunkShift].load(std::memory_order_relaxed)[index & ChunkMask]; }
+    const T& operator[](NodeIndex index) const { return m_Chunks[index >> ChunkShift].load(std::memory_order_relaxed)[index & ChunkMask]; }
+
+    uint32_t Size() const { return m_Count.load(std::memory_order_relaxed); }
+    size_t ReservedBytes() const { return (size_t)((Size() + ChunkMask) >> ChunkShift) * sizeof(T) * ChunkSize; }
+
+private:
+    std::unique_ptr<std::atomic<T*>[]> m_Chunks;
+    std::atomic<uint32_t> m_Count = 0;
+};
@@ -1,97 +1,256 @@
 #include "svo.h"
 
-static int childCount = 0;
-static const int PointerOffsetFarMax = std::exp2(15);
+#include <bit>
+#include <atomic>
+#include <cassert>
 
 SparseVoxelOctree::SparseVoxelOctree(int size, int maxDepth) {
     m_Size = size;
     m_MaxDepth = maxDepth;
-    m_Root = nullptr;
+    m_VoxelCount = 0;
+    m_BrickLevels = 0;
+    m_BufferBrickLevels = 0;
+    m_DistanceLevel = 0;
+    m_BufferDistanceLevel = 0;
+    m_Format = DescriptorFormat::Compact;
+    m_BufferFormat = DescriptorFormat::Compact;
+    m_AttributeFormat = AttributeFormat::RGBA8;
+    m_BufferAttributeFormat = AttributeFormat::RGBA8;
+    m_Compressed = false;
+    m_AbandonedNodes = 0;
+    m_AttributesDirty = false;
+    m_EditSlack = 0;
+    m_Editable = false;
+    m_UsedSlots = 0;
+    m_DistanceMax = 0;
+    m_Root = InvalidNode;
+}
+
+bool SparseVoxelOctree::Quantize(glm::vec3 point, glm::uvec3& cell) const {
+    float cells = (float)(1u << m_MaxDepth);
+    glm::vec3 p = glm::floor((point + glm::vec3(m_Size) / glm::vec3(2)) * (cells / m_Size));
+
+    if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= cells || p.y >= cells || p.z >= cells)
+        return false;
+
+    cell = glm::uvec3(p);
+    return true;
 }
 
 void SparseVoxelOctree::Insert(glm::vec3 point, glm::vec3 color) {
-    point += glm::vec3(m_Size) / glm::vec3(2);
-    Insert(&m_Root, point, color, glm::vec3(0), 0);
+    glm::uvec3 cell;
+    if (!Quantize(point, cell))
+        return;
+
+    if (m_Root == InvalidNode)
+        m_Root = m_Compressed ? AllocateShared() : m_Nodes.Allocate();
+    m_AttributesDirty = true;
+
+    NodeIndex node = m_Root;
+    for (int depth = 0; depth < m_MaxDepth; depth++) {
+        // Chunks never move, so this reference survives the allocation below
+        Node& n = m_Nodes[node];
+
+        int shift = m_MaxDepth - depth - 1;
+        int childIndex = ((cell.x >> shift) & 1) | (((cell.y >> shift) & 1) << 1) | (((cell.z >> shift) & 1) << 2);
+
+        if (n.children[childIndex] == InvalidNode)
+            n.children[childIndex] = m_Compressed ? AllocateShared() : m_Nodes.Allocate();
+        else if (m_Compressed)
+            Unshare(node, childIndex);
+
+        node = n.children[childIndex];
+    }
+
+    // UpdateBuffer keeps an editable buffer's voxel count current
+    if (m_Editable) {
+        m_VoxelCount += !m_Nodes[node].IsLeaf;
+        m_EditedCells.push_back(cell);
+    }
+
+    m_Nodes[node].IsLeaf = true;
+    m_Nodes[node].data.color = color;
 }
 
-void SparseVoxelOctree::Insert(Node** node, glm::vec3 point, glm::vec3 color, glm::ivec3 parentCenter, int depth) {
-    if (*node == nullptr) {
-        *node = new Node;
+void SparseVoxelOctree::Build(std::span<const glm::vec3> points, std::span<const glm::vec3> colors) {
+    std::vector<uint64_t> codes;
+    std::vector<uint32_t> order;
+    codes.reserve(points.size());
+    order.reserve(points.size());
+
+    for (size_t i = 0; i < points.size(); i++) {
+        glm::uvec3 cell;
+        if (Quantize(points[i], cell)) {
+            codes.push_back(morton::Encode(cell));
+            order.push_back((uint32_t)i);
+        }
+    }
+
+    // Stable, so repeated points stay in input order and the last one wins
+    morton::RadixSort(codes, order, 3 * m_MaxDepth);
+
+    SortedBuilder builder(*this);
+    for (size_t i = 0; i < codes.size(); i++) {
+        // Only the last of a run of repeated points survives, skip fetching the others' colors
+        if (i + 1 < codes.size() && codes[i + 1] == codes[i])
+            continue;
+
+        builder.Add(codes[i], colors.empty() ? glm::vec3(1.f) : colors[order[i]]);
     }
+    builder.Finish();
+}
+
+SparseVoxelOctree::SortedBuilder::SortedBuilder(SparseVoxelOctree& tree) : m_Tree(tree) {
+    assert(tree.m_MaxDepth <= morton::MaxBitsPerAxis);
+    m_Tree.Clear();
+}
+
+void SparseVoxelOctree::SortedBuilder::Add(uint64_t code, glm::vec3 color, float coverage) {
+    int maxDepth = m_Tree.m_MaxDepth;
+    int start = 1;
 
-    if (depth == m_MaxDepth) {
-        (*node)->IsLeaf = true;
-        (*node)->data.color = color;
+    if (m_Empty) {
+        m_Tree.m_Root = m_Tree.m_Nodes.Allocate();
+        m_Path[0] = m_Tree.m_Root;
+        m_Empty = false;
+    }
+    else if (code == m_Previous) {
+        m_Tree.m_Nodes[m_Path[maxDepth]].data = { color, coverage };
         return;
     }
+    else {
+        assert(code > m_Previous);
 
-    (*node)->data.color = color;
+        // The highest differing bit tells how deep the new leaf shares its path with the previous one
+        int msb = 63 - std::countl_zero(code ^ m_Previous);
+        start = maxDepth - msb / 3;
+        for (int depth = maxDepth; depth >= start; depth--)
+            Close(depth);
+    }
+
+    for (int depth = start; depth <= maxDepth; depth++) {
+        NodeIndex node = m_Tree.m_Nodes.Allocate();
+        int childIndex = (code >> (3 * (maxDepth - depth))) & 7;
+        m_Tree.m_Nodes[m_Path[depth - 1]].children[childIndex] = node;
+        m_Path[depth] = node;
+    }
 
-    float size = m_Size / std::exp2(depth);
-    glm::ivec3 childPos = glm::vec3(
-        (int)std::round((point.x - ((float)parentCenter.x * size)) / size),
-        (int)std::round((point.y - ((float)parentCenter.y * size)) / size),
-        (int)std::round((point.z - ((float)parentCenter.z * size)) / size)
-    );
+    Node& leaf = m_Tree.m_Nodes[m_Path[maxDepth]];
+    leaf.IsLeaf = true;
+    leaf.data = { color, coverage };
+    m_Previous = code;
+}
 
-    int childIndex = (childPos.x << 0) | (childPos.y << 1) | (childPos.z << 2);
+// Every child of a closed node is closed already
+void SparseVoxelOctree::SortedBuilder::Close(int depth) {
+    if (!m_Tree.m_Nodes[m_Path[depth]].IsLeaf)
+        m_Tree.FilterNode(m_Path[depth]);
+}
+
+void SparseVoxelOctree::SortedBuilder::Finish() {
+    if (m_Empty)
+        return;
 
-    parentCenter = glm::ivec3(
-        (parentCenter.x << 1) | childPos.x,
-        (parentCenter.y << 1) | childPos.y,
-        (parentCenter.z << 1) | childPos.z
-    );
+    for (int depth = m_Tree.m_MaxDepth; depth >= 0; depth--)
+        Close(depth);
 
-    Insert(&(*node)->children[childIndex], point, color, parentCenter, ++depth);
+    m_Empty = true;
 }
 
-void SparseVoxelOctree::CreateBuffer() {
-    int i = 0;
-    CreateBuffer(m_Root, i);
+SparseVoxelOctree::ConcurrentInserter::ConcurrentInserter(SparseVoxelOctree& tree) : m_Tree(tree) {
+    assert(!tree.m_Compressed);
+    tree.m_AttributesDirty = true;
+    // Its inserts are not recorded for UpdateBuffer
+    tree.m_Editable = false;
 }
 
-void SparseVoxelOctree::CreateBuffer(Node* node, int& index) {
-    if (node == m_Root)
-        m_Buffer.push_back(CreateDescriptor(node, ++index, 0));
-
-    int pIndex = index - childCount;
-    m_Buffer.resize(index);
-    for (int i = 0; i < 8; i++) {
-        if (Node* child = node->children[i]) {
-            if (!child->IsLeaf) {
-                m_Buffer.at(pIndex) = CreateDescriptor(child, index, pIndex);
-                pIndex++;
-                CreateBuffer(child, index);
-            }
+NodeIndex SparseVoxelOctree::ConcurrentInserter::Allocate(bool leaf) {
+    NodeIndex node = m_Spare;
+    m_Spare = InvalidNode;
+
+    if (node == InvalidNode) {
+        if (m_Next == m_End) {
+            m_Next = m_Tree.m_Nodes.Reserve(BlockSize);
+            m_End = m_Next + BlockSize;
         }
+        node = m_Next++;
     }
+
+    new (&m_Tree.m_Nodes[node]) Node();
+    m_Tree.m_Nodes[node].IsLeaf = leaf;
+    return node;
 }
 
-uint32_t SparseVoxelOctree::CreateDescriptor(Node* node, int& index, int pIndex) {
-    uint32_t childDesc = 0;
-    int ValidChildCount = 0;
-    for (int i = 0; i < 8; i++) {
-        if (Node* child = node->children[i]) {
-            childDesc |= 1 << i;
-            if (child->IsLeaf) {
-                childDesc |= 1 << (i + 8);
-                m_VoxelCount++;
-            }
-            else if (ValidChildCount == 0) {
-                int indexOffset = index - pIndex;
-                if (indexOffset >= PointerOffsetFarMax) {
-                    childDesc |= 1 << 16;
-                    m_Far.push_back(indexOffset);
-                    childDesc |= m_Far.size() - 1 << 17;
-                }
-                else
-                    childDesc |= indexOffset << 17;
-            }
-            ValidChildCount++;
-        }
+void SparseVoxelOctree::ConcurrentInserter::Finish() {
+    uint32_t unused = (m_End - m_Next) + (m_Spare != InvalidNode);
+    if (unused > 0)
+        std::atomic_ref<uint32_t>(m_Tree.m_AbandonedNodes).fetch_add(unused, std::memory_order_relaxed);
+
+    m_Next = m_End = 0;
+    m_Spare = InvalidNode;
+}
+
+NodeIndex SparseVoxelOctree::ConcurrentInserter::Claim(NodeIndex& slot, bool leaf) {
+    std::atomic_ref<NodeIndex> ref(slot);
+
+    NodeIndex current = ref.load(std::memory_order_acquire);
+    if (current != InvalidNode)
+        return current;
+
+    // The node is fully initialized before the release publishes it
+    NodeIndex fresh = Allocate(leaf);
+    if (ref.compare_exchange_strong(current, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+        return fresh;
+
+    // Another thread won the slot, keep ours for the next allocation
+    m_Spare = fresh;
+    return current;
+}
+
+void SparseVoxelOctree::ConcurrentInserter::Insert(glm::vec3 point, glm::vec3 color) {
+    glm::uvec3 cell;
+    if (!m_Tree.Quantize(point, cell))
+        return;
+
+    int maxDepth = m_Tree.m_MaxDepth;
+    NodeIndex node = Claim(m_Tree.m_Root, maxDepth == 0);
+
+    for (int depth = 0; depth < maxDepth; depth++) {
+        int shift = maxDepth - depth - 1;
+        int childIndex = ((cell.x >> shift) & 1) | (((cell.y >> shift) & 1) << 1) | (((cell.z >> shift) & 1) << 2);
+
+        node = Claim(m_Tree.m_Nodes[node].children[childIndex], depth + 1 == maxDepth);
     }
 
-    childCount = ValidChildCount;
-    index += ValidChildCount;
-    return childDesc;
-}
\ No newline at end of file
+    // Racing writers to the same voxel leave one of their colors, per channel
+    glm::vec3& leafColor = m_Tree.m_Nodes[node].data.color;
+    std::atomic_ref<float>(leafColor.x).store(color.x, std::memory_order_relaxed);
+    std::atomic_ref<float>(leafColor.y).store(color.y, std::memory_order_relaxed);
+    std::atomic_ref<float>(leafColor.z).store(color.z, std::memory_order_relaxed);
+}
+
+void SparseVoxelOctree::Clear() {
+    m_Nodes.Clear();
+    m_Root = InvalidNode;
+    m_VoxelCount = 0;
+    m_Compressed = false;
+    m_References.clear();
+    m_FreeNodes.clear();
+    m_AbandonedNodes = 0;
+    m_AttributesDirty = false;
+    m_Buffer.clear();
+    m_Far.clear();
+    m_Attributes.clear();
+    m_Bricks.clear();
+    m_BufferBrickLevels = 0;
+    m_Distances.clear();
+    m_BufferDistanceLevel = 0;
+    m_BufferFormat = DescriptorFormat::Compact;
+    m_BufferAttributeFormat = AttributeFormat::RGBA8;
+    m_Editable = false;
+    m_EditSlots.clear();
+    for (std::vector<uint32_t>& blocks : m_FreeBlocks)
+        blocks.clear();
+    m_FreeFar.clear();
+    m_EditedCells.clear();
+}
@@ -1,39 +1,442 @@
+#pragma once
+
 #include <vk_types.h>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include "node_pool.h"
+#include "morton.h"
 
 struct VoxelData {
     glm::vec3 color;
+    // Opacity of the node seen along its most covered axis, 1 for leaves
+    float coverage = 1.f;
 };
 
+// RGBA8 with coverage in alpha, the layout unpackUnorm4x8 reads
+inline uint32_t PackAttributes(const VoxelData& data) {
+    glm::uvec4 c = glm::uvec4(glm::clamp(glm::vec4(data.color, data.coverage), 0.f, 1.f) * 255.f + 0.5f);
+    return c.x | (c.y << 8) | (c.z << 16) | (c.w << 24);
+}
+
+// Octahedral projection of a direction onto 6 bits per axis, u in the low bits. A zero vector maps to +y.
+inline uint32_t PackNormal(glm::vec3 normal) {
+    float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (l1 == 0.f) {
+        normal = glm::vec3(0.f, 1.f, 0.f);
+        l1 = 1.f;
+    }
+
+    glm::vec2 p = glm::vec2(normal.x, normal.y) / l1;
+    if (normal.z < 0.f)
+        p = (1.f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.f ? 1.f : -1.f, p.y >= 0.f ? 1.f : -1.f);
+
+    glm::uvec2 q = glm::uvec2(glm::clamp(p * 0.5f + 0.5f, 0.f, 1.f) * 63.f + 0.5f);
+    return q.x | (q.y << 6);
+}
+
+inline glm::vec3 UnpackNormal(uint32_t packed) {
+    glm::vec2 p = glm::vec2(packed & 63, (packed >> 6) & 63) / 63.f * 2.f - 1.f;
+    glm::vec3 n(p.x, p.y, 1.f - std::abs(p.x) - std::abs(p.y));
+    float t = std::max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return glm::normalize(n);
+}
+
+// AttributeFormat::ColorNormal: RGB565 color in the low half, then the packed normal and 4 bits of coverage
+inline uint32_t PackColorNormal(const VoxelData& data, uint32_t normal) {
+    glm::uvec3 c = glm::uvec3(glm::clamp(data.color, 0.f, 1.f) * glm::vec3(31.f, 63.f, 31.f) + 0.5f);
+    uint32_t coverage = (uint32_t)(std::clamp(data.coverage, 0.f, 1.f) * 15.f + 0.5f);
+    return c.x | (c.y << 5) | (c.z << 11) | (normal << 16) | (coverage << 28);
+}
+
 struct Node {
-    bool IsLeaf;
-    Node* children[8];
+    NodeIndex children[8];
     VoxelData data;
+    bool IsLeaf;
 
     Node() : IsLeaf(false) {
         for (int i = 0; i < 8; i++) {
-            children[i] = nullptr;
+            children[i] = InvalidNode;
         }
     }
 };
 
+// Order in which node blocks are placed in m_Buffer. Every policy produces a buffer the shader can
+// traverse; they differ in how far a child block lands from its parent's descriptor.
+enum class BufferLayout {
+    DepthFirst,     // preorder, the default encoding
+    BreadthFirst,   // level by level
+    Clustered,      // van Emde Boas order, with every subtree that fits a 4 KiB page kept within one
+};
+
+// How m_Buffer stores a descriptor
+enum class DescriptorFormat {
+    Compact,    // one word: child masks and an offset to the child block, through m_Far beyond 15 bits
+    Wide,       // two words: child masks, then the child block's slot; needs no far pointers
+};
+
+// What m_Attributes holds per slot. Both take one word, so the choice costs nothing in size.
+enum class AttributeFormat {
+    RGBA8,          // 8-bit color and coverage, shaded with the normal of the face the ray entered
+    ColorNormal,    // RGB565 color, an octahedral normal estimated from the neighbouring voxels and 4-bit coverage
+};
+
+// Specialization constants of raymarch.comp, in constant_id order
+struct SvoShaderConstants {
+    int32_t leafDepth = 7;
+    float size = 20.f;
+    uint32_t wideDescriptors = 0;   // VkBool32
+    uint32_t colorNormals = 0;      // VkBool32, AttributeFormat::ColorNormal
+    int32_t brickLevels = 0;        // GetBufferBrickLevels
+    int32_t distanceLevel = 0;      // GetBufferDistanceLevel
+
+    bool operator==(const SvoShaderConstants&) const = default;
+};
+
+// Words of one of the serialized arrays that changed
+struct SvoDirtyRange {
+    uint32_t offset;
+    uint32_t count;
+};
+
+// What UpdateBuffer rewrote, per array, as sorted and merged ranges. A full update replaced the
+// arrays, which may also have changed size.
+struct SvoBufferUpdate {
+    bool full = false;
+    std::vector<SvoDirtyRange> buffer, far, attributes, distances;
+
+    bool Empty() const { return !full && buffer.empty() && far.empty() && attributes.empty() && distances.empty(); }
+    // Adds a later update's ranges, as if both edits were one
+    void Merge(const SvoBufferUpdate& later);
+};
+
+struct PointCloudImportProgress {
+    const char* phase = "";     // "sort" while reading runs, "merge" while building the tree
+    uint64_t bytesRead = 0, totalBytes = 0;
+    uint64_t points = 0;        // read so far, or merged into the tree so far
+    uint32_t runs = 0;
+};
+
+struct PointCloudImportSettings {
+    // Maps file positions into the tree's volume
+    glm::mat4 transform{ 1.f };
+    // Points held in memory at once, while sorting runs and while merging them
+    size_t memoryBytes = (size_t)256 << 20;
+    // Where sorted runs are spilled, the system's temporary directory if empty
+    std::filesystem::path tempDirectory;
+    std::function<void(const PointCloudImportProgress&)> progress;
+};
+
+struct PointCloudImportStats {
+    bool ok = false;
+    uint64_t points = 0;
+    uint64_t outside = 0;       // points outside the tree's volume
+    uint64_t voxels = 0;
+    uint32_t runs = 0;          // sorted runs spilled to disk, 0 if the points fit in memory
+    uint64_t spilledBytes = 0;
+    double sortSeconds = 0, mergeSeconds = 0;
+};
+
+struct BufferLayoutStats {
+    uint32_t descriptors = 0;
+    uint32_t farPointers = 0;
+    uint32_t backReferences = 0;  // descriptors pointing at a shared block placed before them, DAGs only
+    double averageDistance = 0;   // words from a descriptor to its child block
+    double sameCacheLine = 0;     // fraction of child blocks starting in the descriptor's 64-byte line
+    double samePage = 0;          // same, for 4 KiB pages
+};
+
 class SparseVoxelOctree {
 private:
-    Node* m_Root;
+    friend class SvoQuery;
+    friend class VersionedSvo;
+
+    ChunkedPool<Node> m_Nodes;
+    NodeIndex m_Root;
     int m_Size, m_MaxDepth, m_VoxelCount;
-    std::vector<uint8_t> colors;
+    // Levels above the leaves at which the next depth-first buffer switches to bricks, and the value
+    // the current buffer was written with
+    int m_BrickLevels, m_BufferBrickLevels;
+    // Level of the grid the next buffer's distance field is computed on, 0 for none, and the value the
+    // current one was computed with
+    int m_DistanceLevel, m_BufferDistanceLevel;
+    // Format of the next buffer and of the current one
+    DescriptorFormat m_Format, m_BufferFormat;
+    bool m_Compressed;
+    // While compressed: how many parents share each node, the root counting once for the tree, and
+    // the nodes edits released, which are reused before the pool grows
+    std::vector<uint32_t> m_References;
+    std::vector<NodeIndex> m_FreeNodes;
+    // Pool slots ConcurrentInserter reserved but never used, until the pool is cleared or compressed
+    uint32_t m_AbandonedNodes;
+    // Set when inserts left interior colors and coverage out of date
+    bool m_AttributesDirty;
+    // Format of the next buffer's attributes and of the current one's
+    AttributeFormat m_AttributeFormat, m_BufferAttributeFormat;
 
-    void Insert(Node** node, glm::vec3 point, glm::vec3 color, glm::ivec3 parentCenter, int depth);
-    uint32_t CreateDescriptor(Node* node, int& index, int pIndex);
-    void CreateBuffer(Node* node, int& index);
+    // Where each node's descriptor, child block and far entry are in an editable buffer, see
+    // SetEditSlack. A block has room for capacity slots.
+    struct EditSlots {
+        uint32_t descriptor = UINT32_MAX;
+        uint32_t block = UINT32_MAX;
+        uint32_t capacity = 0;
+        uint32_t far = UINT32_MAX;
+    };
+    float m_EditSlack;
+    // Set while the current buffer was written with slack and every edit since is in m_EditedCells
+    bool m_Editable;
+    std::vector<EditSlots> m_EditSlots;
+    // Slots in use, the rest of m_Buffer is free for blocks that outgrow their capacity
+    uint32_t m_UsedSlots;
+    // Blocks given up by moved or removed nodes, by log2 of their capacity, and far entries nothing
+    // points at any more. Both are reused before the free tail and m_Far grow.
+    std::vector<uint32_t> m_FreeBlocks[4];
+    std::vector<uint32_t> m_FreeFar;
+    // Distance field cells never exceed this, so a new voxel only lowers those closer than it
+    int m_DistanceMax;
+    std::vector<glm::uvec3> m_EditedCells;
+
+    static constexpr uint32_t PointerOffsetFarMax = 1 << 15;
+    static constexpr uint32_t FarIndexMax = 1 << 15;
+
+    // Where one encoder task writes its descriptors, far pointers and attributes. A null buffer only
+    // counts.
+    struct EncodeTarget {
+        uint32_t* buffer = nullptr;
+        uint32_t* far = nullptr;
+        uint32_t farCount = 0;
+        uint32_t voxelCount = 0;
+        uint32_t* attributes = nullptr;
+        // Nodes this many levels above the leaves become bricks, 0 encodes every level as nodes
+        int brickLevels = 0;
+        uint32_t* bricks = nullptr;
+        uint32_t brickCount = 0;
+        // m_Attributes slot of the next brick voxel
+        uint32_t brickAttributeSlot = 0;
+        // Descriptors take two words and point at their child block directly, see DescriptorFormat
+        bool wide = false;
+        // Blocks are rounded up to a power of two slots, leaving room for edits
+        bool roundBlocks = false;
+        // PackNormal result per node for AttributeFormat::ColorNormal, RGBA8 attributes without
+        const uint16_t* normals = nullptr;
+
+        uint32_t Pack(NodeIndex node, const VoxelData& data) const {
+            return normals ? PackColorNormal(data, normals[node]) : PackAttributes(data);
+        }
+
+        void Write(uint32_t slot, uint32_t desc, uint32_t blockStart) const {
+            if (!wide) {
+                buffer[slot] = desc;
+                return;
+            }
+            buffer[2 * (size_t)slot] = desc;
+            buffer[2 * (size_t)slot + 1] = blockStart;
+        }
+    };
+
+    bool Quantize(glm::vec3 point, glm::uvec3& cell) const;
+    // Sets an interior node's color and coverage from its children's
+    void FilterNode(NodeIndex node);
+    uint32_t CountChildren(NodeIndex node) const;
+    // Compressed trees only. A fresh node with one reference, from m_FreeNodes when there is one.
+    NodeIndex AllocateShared();
+    // Compressed trees only. Gives parent its own copy of the child if other parents share it, and
+    // returns the child parent now owns.
+    NodeIndex Unshare(NodeIndex parent, int childIndex);
+    // Compressed trees only. Drops a reference to node, freeing it and whatever only it referenced.
+    void Release(NodeIndex node);
+    uint32_t BlockSlots(NodeIndex node, const EncodeTarget& target) const;
+    // Whether node's leaves are exactly levels below it, so it is written as a brick
+    bool IsBrickRoot(NodeIndex node, int levels) const;
+    void CreateBrick(NodeIndex node, EncodeTarget& target) const;
+    void CreateDistanceField();
+    // PackNormal of every node: leaves face away from their occupied neighbours, interior nodes along
+    // the sum of their leaves' normals. Indexed by NodeIndex.
+    std::vector<uint16_t> EstimateNormals() const;
+    // Records where every node landed in a freshly written editable buffer
+    void IndexEditSlots();
+    // Returns a node's block and far entry to the free lists once it is gone from an editable buffer
+    void FreeEditSlots(NodeIndex node);
+    void LowerDistances(glm::uvec3 cell, SvoBufferUpdate& update);
+    uint32_t CreateDescriptor(NodeIndex node, uint32_t slot, uint32_t blockStart, EncodeTarget& target) const;
+    void CreateBuffer(NodeIndex node, uint32_t blockStart, uint32_t& cursor, EncodeTarget& target) const;
+    bool CreateBuffer(std::span<const NodeIndex> blockOrder);
+    bool CreateDagBuffer();
+    // Serializes the subtree below node on its own, with its descriptor in slot 0
+    uint32_t EncodeSubtree(NodeIndex node, std::vector<uint32_t>& buffer, std::vector<uint32_t>& far, std::vector<uint32_t>& attributes) const;
 
 public:
+    // SlotWords words per slot, see DescriptorFormat. The root's descriptor is in slot 0.
     std::vector<uint32_t> m_Buffer, m_Far;
+    // One word per m_Buffer slot in the buffer's AttributeFormat: the attributes of the node whose
+    // descriptor is there, or of the leaf whose slot it is. Brick voxels follow, see m_Bricks.
+    std::vector<uint32_t> m_Attributes;
+    // Bricks of BrickWords(levels) words each. A brick root is marked as a leaf in its parent's
+    // descriptor and its slot in m_Buffer holds its brick index instead of a descriptor. A brick is
+    // the m_Attributes slot of its first voxel, then one occupancy bit per voxel, x fastest; voxels'
+    // attributes are packed in the same order.
+    std::vector<uint32_t> m_Bricks;
+    // One byte per cell of the 2^level grid, x fastest, four to a word: the chessboard distance in
+    // cells to the nearest occupied one, saturated at 255. Every cell closer than that to a cell with
+    // distance d is empty, so a ray can leave that whole box in one step.
+    std::vector<uint32_t> m_Distances;
+
+    static constexpr int MaxBrickLevels = 3;
+    static constexpr uint32_t BrickWords(int levels) { return 1 + (1u << (3 * levels)) / 32; }
+    static constexpr int MaxDistanceLevel = 8;
+    static constexpr uint32_t SlotWords(DescriptorFormat format) { return format == DescriptorFormat::Wide ? 2 : 1; }
+
+    // Streams leaf Morton codes in ascending order into an emptied tree, creating every node in a
+    // single pass. Repeated codes are merged with the last color winning, and interior nodes are
+    // filtered as they are closed, so the tree needs no FilterAttributes pass.
+    class SortedBuilder {
+    public:
+        explicit SortedBuilder(SparseVoxelOctree& tree);
+
+        void Add(uint64_t code, glm::vec3 color, float coverage = 1.f);
+        void Finish();
+
+    private:
+        SparseVoxelOctree& m_Tree;
+        NodeIndex m_Path[morton::MaxBitsPerAxis + 1];
+        uint64_t m_Previous = 0;
+        bool m_Empty = true;
+
+        void Close(int depth);
+    };
+
+    // Per-thread handle for inserting into the same tree from many threads at once. Child slots are
+    // claimed with compare-and-swap and new nodes come from blocks owned by this handle, so there is
+    // no global lock. Interior nodes are filtered when the buffer is next created. Do not mix with
+    // Insert/Build while in use, and do not use on a compressed tree.
+    class ConcurrentInserter {
+    public:
+        explicit ConcurrentInserter(SparseVoxelOctree& tree);
+        ~ConcurrentInserter() { Finish(); }
+
+        void Insert(glm::vec3 point, glm::vec3 color);
+        // Gives up the rest of this handle's block and its spare node, which stay in the pool unused
+        // and are left out of GetNodeCount. The handle can go on inserting from a fresh block.
+        void Finish();
+
+    private:
+        static constexpr uint32_t BlockSize = 256;
+
+        SparseVoxelOctree& m_Tree;
+        NodeIndex m_Next = 0, m_End = 0;
+        NodeIndex m_Spare = InvalidNode;
+
+        NodeIndex Allocate(bool leaf);
+        NodeIndex Claim(NodeIndex& slot, bool leaf);
+    };
 
     SparseVoxelOctree(int size, int maxDepth);
 
+    // On a compressed tree only the nodes on the path that other parents share are copied, and nodes
+    // nothing references any more go back to a free list. Every edit still costs a path walk with
+    // reference count updates, and the buffer can only be recreated whole, so for more than a few
+    // edits it is cheaper to Clear and rebuild from the source data, then Compress again. Interior
+    // nodes are filtered when the buffer is next created.
     void Insert(glm::vec3 point, glm::vec3 color);
+    // Removes the voxel at point and the interior nodes it leaves empty. Returns false if there was
+    // none.
+    bool Remove(glm::vec3 point);
+    // Recolors the voxel at point, returns false if there is none
+    bool Replace(glm::vec3 point, glm::vec3 color);
+    // Replaces the tree with the given points. colors may be empty, otherwise it matches points.
+    void Build(std::span<const glm::vec3> points, std::span<const glm::vec3> colors);
+    // Replaces the tree with a triangle mesh, transform maps vertex positions into the tree's volume.
+    // Every voxel a triangle touches is set, and with solid the inside of a closed mesh is filled too.
+    // Voxels take the average vertex color of the triangle that set them. Returns the voxel count.
+    uint64_t Voxelize(std::span<const Vertex> vertices, std::span<const uint32_t> indices, const glm::mat4& transform, bool solid);
+    // Replaces the tree with a point cloud file, binary little-endian PLY or ASCII XYZ ("x y z [r g b]"
+    // per line, colors 0-255), streamed in chunks. Each chunk is quantized to Morton codes and sorted
+    // in memory, larger clouds are spilled as sorted runs and merged, so memory stays within the
+    // settings' budget however big the file is. Repeated points keep the last color.
+    PointCloudImportStats Import(const std::filesystem::path& path, const PointCloudImportSettings& settings = {});
+    // Merges identical subtrees into a directed acyclic graph and compacts the node pool. Leaves match
+    // on color, interior nodes on their children; a merged interior node keeps the first one's color.
+    void Compress();
+    // Recomputes every interior node's color and coverage from its children, bottom-up. Colors are
+    // averaged weighted by coverage; coverage is the opacity of the node's children composited along
+    // whichever axis they cover best, so a surface keeps its coverage at every level. CreateBuffer
+    // runs this first when inserts have touched the tree.
+    void FilterAttributes();
+    // Writes the bottom levels of the next depth-first buffer as 4^3 (2) or 8^3 (3) voxel bricks, 0
+    // turns bricks off. DAG buffers and the other layouts are always written without bricks.
+    void SetBrickLevels(int levels);
+    // Computes an empty-space distance field over a 2^level grid with every buffer, 0 turns it off.
+    // Coarser grids are smaller but only skip space far from any voxel.
+    void SetDistanceLevel(int level);
+    // With slack above 0, the next depth-first buffers round every child block up to a power of two
+    // slots and keep slack times their size free at the end, so UpdateBuffer can re-encode edits in
+    // place. Such buffers have no bricks. DAG buffers and the other layouts are never editable.
+    void SetEditSlack(float slack);
+    // Re-encodes the nodes on the paths of every Insert, Remove and Replace since the last buffer:
+    // their attributes are refiltered and their blocks rewritten where they are, or moved into a
+    // block a moved or removed node gave up, or into the free tail, when they outgrew them. Removals
+    // leave the distance field conservatively stale. Falls back to CreateBuffer, reported as a full
+    // update, if the buffer is not editable or out of room.
+    SvoBufferUpdate UpdateBuffer();
+    // ColorNormal estimates a normal per node when the buffer is written. Editable buffers, DAG buffers
+    // and SavePaged pages always use RGBA8: a shared node has no one neighbourhood, and an edit would
+    // change its neighbours' normals too.
+    void SetAttributeFormat(AttributeFormat format) { m_AttributeFormat = format; }
+    // Compact descriptors run out of far pointers on large trees, wide ones address 2^32 slots. Applies
+    // to every encoder except SavePaged, which always writes compact pages. A compact buffer that would
+    // need more than FarIndexMax far pointers is written wide instead, see GetBufferFormat.
+    void SetDescriptorFormat(DescriptorFormat format) { m_Format = format; }
+    // A compressed tree is serialized with one block per unique node, with wide descriptors if the
+    // shared references need more far pointers than a compact descriptor can index
     void CreateBuffer();
+    // Subtrees below splitDepth are serialized in parallel, 0 encodes the whole tree on this thread.
+    // The output does not depend on splitDepth.
+    void CreateBuffer(int splitDepth);
+    // Returns false if the layout needs more far pointers than a compact descriptor can index, in
+    // which case the same layout is written with wide descriptors. A compressed tree always uses its
+    // DAG encoding.
+    bool CreateBuffer(BufferLayout layout);
+    BufferLayoutStats GetLayoutStats() const;
+    // Writes the last CreateBuffer result, bricks and distance field included, and the tree's metadata
+    // for MappedSvo to load.
+    bool Save(const std::filesystem::path& path) const;
+    // Writes the tree for PagedSvo: the levels above pageDepth as one resident tree, and every
+    // subtree rooted at pageDepth as a separately loadable page. Interior attributes are written as
+    // last filtered, see FilterAttributes.
+    bool SavePaged(const std::filesystem::path& path, int pageDepth) const;
+    void Clear();
 
+    int GetMaxDepth() const { return m_MaxDepth; }
+    int GetSize() const { return m_Size; }
+    int GetVoxelCount() const { return m_VoxelCount; }
+    bool IsCompressed() const { return m_Compressed; }
+    int GetBrickLevels() const { return m_BrickLevels; }
+    // Brick levels of the last CreateBuffer result
+    int GetBufferBrickLevels() const { return m_BufferBrickLevels; }
+    int GetDistanceLevel() const { return m_DistanceLevel; }
+    // Grid level of the last CreateBuffer result's distance field, 0 if it has none
+    int GetBufferDistanceLevel() const { return m_BufferDistanceLevel; }
+    DescriptorFormat GetDescriptorFormat() const { return m_Format; }
+    float GetEditSlack() const { return m_EditSlack; }
+    // Whether UpdateBuffer can patch the current buffer
+    bool IsEditable() const { return m_Editable; }
+    // Format of the last CreateBuffer result
+    DescriptorFormat GetBufferFormat() const { return m_BufferFormat; }
+    AttributeFormat GetAttributeFormat() const { return m_AttributeFormat; }
+    // Attribute format of the last CreateBuffer result
+    AttributeFormat GetBufferAttributeFormat() const { return m_BufferAttributeFormat; }
+    // What raymarch.comp needs to traverse the last CreateBuffer result
+    SvoShaderConstants GetShaderConstants() const {
+        return { m_MaxDepth, (float)m_Size, m_BufferFormat == DescriptorFormat::Wide, m_BufferAttributeFormat == AttributeFormat::ColorNormal,
+            m_BufferBrickLevels, m_BufferDistanceLevel };
+    }
+    uint32_t GetNodeCount() const { return m_Nodes.Size() - (uint32_t)m_FreeNodes.size() - m_AbandonedNodes; }
+    size_t GetNodeMemory() const { return m_Nodes.ReservedBytes(); }
     uint32_t GetBufferSize() const { return m_Buffer.size() * sizeof(uint32_t); }
     uint32_t GetFarBufferSize() const { return m_Far.size() * sizeof(uint32_t); }
+    uint32_t GetAttributeBufferSize() const { return m_Attributes.size() * sizeof(uint32_t); }
+    uint32_t GetBrickBufferSize() const { return m_Bricks.size() * sizeof(uint32_t); }
+    uint32_t GetDistanceBufferSize() const { return m_Distances.size() * sizeof(uint32_t); }
 };
\ No newline at end of file
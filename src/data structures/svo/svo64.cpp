@@ -0,0 +1,377 @@
+#include "svo64.h"
+
+#include <parallel.h>
+#include <bit>
+#include <cassert>
+
+SparseVoxel64Tree::SparseVoxel64Tree(int size, int maxDepth) {
+    assert(maxDepth >= 1 && 2 * maxDepth <= morton::MaxBitsPerAxis);
+    m_Size = size;
+    m_MaxDepth = maxDepth;
+    m_VoxelCount = 0;
+    m_AttributesDirty = false;
+    m_AbandonedNodes = 0;
+    m_Root = InvalidNode;
+}
+
+bool SparseVoxel64Tree::Quantize(glm::vec3 point, glm::uvec3& cell) const {
+    float cells = (float)(1u << (2 * m_MaxDepth));
+    glm::vec3 p = glm::floor((point + glm::vec3(m_Size) / glm::vec3(2)) * (cells / m_Size));
+
+    if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= cells || p.y >= cells || p.z >= cells)
+        return false;
+
+    cell = glm::uvec3(p);
+    return true;
+}
+
+void SparseVoxel64Tree::Insert(glm::vec3 point, glm::vec3 color) {
+    glm::uvec3 cell;
+    if (!Quantize(point, cell))
+        return;
+
+    if (m_Root == InvalidNode)
+        m_Root = m_Nodes.Allocate();
+    m_AttributesDirty = true;
+
+    NodeIndex node = m_Root;
+    for (int depth = 0; depth < m_MaxDepth; depth++) {
+        // Chunks never move, so this reference survives the allocation below
+        Node64& n = m_Nodes[node];
+
+        int shift = 2 * (m_MaxDepth - depth - 1);
+        uint32_t childIndex = Child64Index((cell >> (uint32_t)shift) & 3u);
+        uint64_t bit = 1ull << childIndex;
+        uint32_t rank = std::popcount(n.childMask & (bit - 1));
+
+        if (!(n.childMask & bit)) {
+            uint32_t count = std::popcount(n.childMask);
+            NodeIndex children = m_Nodes.Reserve(count + 1);
+            for (uint32_t i = 0; i < count; i++)
+                new (&m_Nodes[children + i + (i >= rank)]) Node64(m_Nodes[n.children + i]);
+            new (&m_Nodes[children + rank]) Node64();
+
+            m_AbandonedNodes += count;
+            n.children = children;
+            n.childMask |= bit;
+        }
+
+        node = n.children + rank;
+    }
+
+    m_Nodes[node].IsLeaf = true;
+    m_Nodes[node].data.color = color;
+}
+
+void SparseVoxel64Tree::Build(std::span<const glm::vec3> points, std::span<const glm::vec3> colors) {
+    Clear();
+
+    std::vector<uint64_t> codes;
+    std::vector<uint32_t> order;
+    codes.reserve(points.size());
+    order.reserve(points.size());
+
+    for (size_t i = 0; i < points.size(); i++) {
+        glm::uvec3 cell;
+        if (Quantize(points[i], cell)) {
+            codes.push_back(morton::Encode(cell));
+            order.push_back((uint32_t)i);
+        }
+    }
+
+    // Stable, so repeated points stay in input order and the last one wins
+    morton::RadixSort(codes, order, 6 * m_MaxDepth);
+
+    // The leaves, one per distinct code
+    std::vector<uint64_t> level;
+    level.reserve(codes.size());
+    for (size_t i = 0; i < codes.size(); i++) {
+        if (i + 1 == codes.size() || codes[i + 1] != codes[i])
+            level.push_back(i);
+    }
+    if (level.empty())
+        return;
+
+    NodeIndex first = m_Nodes.Reserve((uint32_t)level.size());
+    for (size_t i = 0; i < level.size(); i++) {
+        uint64_t last = level[i];
+        Node64& leaf = *new (&m_Nodes[first + (uint32_t)i]) Node64();
+        leaf.IsLeaf = true;
+        leaf.data.color = colors.empty() ? glm::vec3(1.f) : colors[order[last]];
+        level[i] = codes[last];
+    }
+    m_VoxelCount = (int)level.size();
+
+    // Each level's nodes are sorted, so the children of one parent are a consecutive run of the level
+    // below, and every child array is the run itself
+    std::vector<uint64_t> parents;
+    for (int depth = m_MaxDepth - 1; depth >= 0; depth--) {
+        parents.clear();
+        for (size_t i = 0; i < level.size(); i++) {
+            if (i == 0 || (level[i] >> 6) != (level[i - 1] >> 6))
+                parents.push_back(level[i] >> 6);
+        }
+
+        NodeIndex parentFirst = m_Nodes.Reserve((uint32_t)parents.size());
+        size_t child = 0;
+        for (size_t p = 0; p < parents.size(); p++) {
+            Node64& parent = *new (&m_Nodes[parentFirst + (uint32_t)p]) Node64();
+            parent.children = first + (uint32_t)child;
+            for (; child < level.size() && (level[child] >> 6) == parents[p]; child++)
+                parent.childMask |= 1ull << (level[child] & 63);
+
+            FilterNode(parentFirst + (uint32_t)p);
+        }
+
+        level.swap(parents);
+        first = parentFirst;
+    }
+
+    m_Root = first;
+}
+
+// Same filter as SparseVoxelOctree::FilterNode, over columns of four children
+void SparseVoxel64Tree::FilterNode(NodeIndex node) {
+    Node64& n = m_Nodes[node];
+
+    float coverage[64] = {};
+    glm::vec3 colorSum(0.f);
+    float coverageSum = 0;
+    uint32_t rank = 0;
+    for (uint64_t mask = n.childMask; mask; mask &= mask - 1) {
+        const VoxelData& child = m_Nodes[n.children + rank++].data;
+        coverage[std::countr_zero(mask)] = child.coverage;
+        colorSum += child.color * child.coverage;
+        coverageSum += child.coverage;
+    }
+
+    float best = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float opacity = 0;
+        for (uint32_t u = 0; u < 4; u++) {
+            for (uint32_t v = 0; v < 4; v++) {
+                float transmittance = 1;
+                for (uint32_t w = 0; w < 4; w++) {
+                    glm::uvec3 local;
+                    local[axis] = w;
+                    local[(axis + 1) % 3] = u;
+                    local[(axis + 2) % 3] = v;
+                    transmittance *= 1 - coverage[Child64Index(local)];
+                }
+                opacity += 1 - transmittance;
+            }
+        }
+        best = std::max(best, opacity / 16);
+    }
+
+    n.data.coverage = best;
+    if (coverageSum > 0)
+        n.data.color = colorSum / coverageSum;
+}
+
+void SparseVoxel64Tree::FilterAttributes() {
+    m_AttributesDirty = false;
+    if (m_Root == InvalidNode)
+        return;
+
+    auto filter = [&](auto& self, NodeIndex node) -> void {
+        if (m_Nodes[node].IsLeaf)
+            return;
+
+        uint32_t count = std::popcount(m_Nodes[node].childMask);
+        for (uint32_t i = 0; i < count; i++)
+            self(self, m_Nodes[node].children + i);
+        FilterNode(node);
+    };
+
+    // The root's children are disjoint subtrees
+    uint32_t count = std::popcount(m_Nodes[m_Root].childMask);
+    parallel::For(count, [&](size_t i) { filter(filter, m_Nodes[m_Root].children + (uint32_t)i); });
+    FilterNode(m_Root);
+}
+
+// Depth-first, each node's child block reserved when the node is visited
+void SparseVoxel64Tree::CreateBuffer() {
+    if (m_AttributesDirty)
+        FilterAttributes();
+
+    m_Buffer.clear();
+    m_Attributes.clear();
+    m_VoxelCount = 0;
+
+    if (m_Root == InvalidNode)
+        return;
+
+    auto encode = [&](auto& self, NodeIndex node, uint32_t slot, int depth) -> void {
+        const Node64& n = m_Nodes[node];
+        uint32_t count = std::popcount(n.childMask);
+
+        uint32_t* words = &m_Buffer[(size_t)slot * NodeWords];
+        words[0] = (uint32_t)n.childMask;
+        words[1] = (uint32_t)(n.childMask >> 32);
+        words[3] = PackAttributes(n.data);
+
+        if (depth + 1 == m_MaxDepth) {
+            words[2] = (uint32_t)m_Attributes.size();
+            for (uint32_t i = 0; i < count; i++)
+                m_Attributes.push_back(PackAttributes(m_Nodes[n.children + i].data));
+            m_VoxelCount += count;
+            return;
+        }
+
+        // Growing the buffer moves it
+        uint32_t block = (uint32_t)(m_Buffer.size() / NodeWords);
+        words[2] = block;
+        m_Buffer.resize(m_Buffer.size() + (size_t)count * NodeWords);
+
+        for (uint32_t i = 0; i < count; i++)
+            self(self, n.children + i, block + i, depth + 1);
+    };
+
+    m_Buffer.assign(NodeWords, 0);
+    encode(encode, m_Root, 0, 0);
+}
+
+void SparseVoxel64Tree::Clear() {
+    m_Nodes.Clear();
+    m_Root = InvalidNode;
+    m_VoxelCount = 0;
+    m_AttributesDirty = false;
+    m_AbandonedNodes = 0;
+    m_Buffer.clear();
+    m_Attributes.clear();
+}
+
+Svo64Query::Svo64Query(const SparseVoxel64Tree& tree)
+    : m_Buffer(tree.m_Buffer), m_Size(tree.GetSize()), m_MaxDepth(tree.GetMaxDepth()) {}
+
+Svo64Query::Svo64Query(std::span<const uint32_t> buffer, int size, int maxDepth)
+    : m_Buffer(buffer), m_Size(size), m_MaxDepth(maxDepth) {}
+
+bool Svo64Query::IsOccupied(glm::vec3 point) const {
+    if (m_Buffer.empty())
+        return false;
+
+    float cells = (float)(1u << (2 * m_MaxDepth));
+    glm::vec3 p = glm::floor((point + glm::vec3(m_Size / 2.f)) * (cells / m_Size));
+    if (glm::any(glm::lessThan(p, glm::vec3(0.f))) || glm::any(glm::greaterThanEqual(p, glm::vec3(cells))))
+        return false;
+
+    glm::uvec3 cell(p);
+    uint32_t slot = 0;
+    for (int depth = 0; depth < m_MaxDepth; depth++) {
+        const uint32_t* words = &m_Buffer[(size_t)slot * SparseVoxel64Tree::NodeWords];
+        uint64_t mask = words[0] | ((uint64_t)words[1] << 32);
+        uint64_t bit = 1ull << Child64Index((cell >> (uint32_t)(2 * (m_MaxDepth - depth - 1))) & 3u);
+        if (!(mask & bit))
+            return false;
+
+        slot = words[2] + std::popcount(mask & (bit - 1));
+    }
+
+    return true;
+}
+
+// Hierarchical DDA: every level steps through its node's 4x4x4 cells, descending into occupied ones
+// and popping back to the parent once it leaves the node
+SvoRayHit Svo64Query::Raycast(const SvoRay& ray) const {
+    SvoRayHit hit;
+    float length = glm::length(ray.direction);
+    if (m_Buffer.empty() || length == 0)
+        return hit;
+
+    float cells = (float)(1u << (2 * m_MaxDepth));
+    glm::vec3 origin = (ray.origin + glm::vec3(m_Size / 2.f)) * (cells / m_Size);
+    glm::vec3 direction = ray.direction / length * (cells / m_Size);
+
+    glm::vec3 inverse;
+    glm::ivec3 step;
+    for (int axis = 0; axis < 3; axis++) {
+        // A tiny step instead of zero keeps 0 * inf out of the slab distances
+        float d = direction[axis] < 0 ? std::min(direction[axis], -1e-30f) : std::max(direction[axis], 1e-30f);
+        inverse[axis] = 1.f / d;
+        step[axis] = d < 0 ? -1 : 1;
+    }
+
+    glm::vec3 t0 = -origin * inverse, t1 = (glm::vec3(cells) - origin) * inverse;
+    glm::vec3 enter = glm::min(t0, t1), exit = glm::max(t0, t1);
+    float t = std::max({ enter.x, enter.y, enter.z }), tExit = std::min({ exit.x, exit.y, exit.z });
+    if (t > tExit || tExit < 0)
+        return hit;
+
+    int axis = t > 0 ? (enter.x == t ? 0 : (enter.y == t ? 1 : 2)) : 3;
+    t = std::max(t, 0.f);
+
+    struct Level {
+        uint32_t slot;
+        glm::vec3 min;
+        glm::ivec3 cell;
+        glm::vec3 next;
+    };
+    Level stack[morton::MaxBitsPerAxis / 2 + 1];
+
+    // Cells of the node at depth are this wide, in leaf cells
+    auto cellSize = [&](int depth) { return (float)(1u << (2 * (m_MaxDepth - depth - 1))); };
+    auto enterNode = [&](Level& level, uint32_t slot, glm::vec3 min, int depth) {
+        float size = cellSize(depth);
+        level.slot = slot;
+        level.min = min;
+        level.cell = glm::clamp(glm::ivec3(glm::floor((origin + direction * t - min) / size)), glm::ivec3(0), glm::ivec3(3));
+        for (int a = 0; a < 3; a++)
+            level.next[a] = (min[a] + (level.cell[a] + (step[a] > 0 ? 1 : 0)) * size - origin[a]) * inverse[a];
+    };
+
+    int depth = 0;
+    enterNode(stack[0], 0, glm::vec3(0.f), 0);
+
+    while (t <= ray.maxDistance) {
+        Level& level = stack[depth];
+        const uint32_t* words = &m_Buffer[(size_t)level.slot * SparseVoxel64Tree::NodeWords];
+        uint64_t mask = words[0] | ((uint64_t)words[1] << 32);
+        uint64_t bit = 1ull << Child64Index(glm::uvec3(level.cell));
+
+        if (mask & bit) {
+            float size = cellSize(depth);
+            glm::vec3 childMin = level.min + glm::vec3(level.cell) * size;
+
+            if (depth + 1 == m_MaxDepth) {
+                hit.cell = glm::uvec3(childMin);
+                hit.distance = t;
+                if (axis < 3)
+                    hit.normal[axis] = step[axis] < 0 ? 1.f : -1.f;
+                return hit;
+            }
+
+            uint32_t child = words[2] + std::popcount(mask & (bit - 1));
+            depth++;
+            enterNode(stack[depth], child, childMin, depth);
+            continue;
+        }
+
+        // Step to the next cell, popping out of every node the ray leaves on the way
+        while (true) {
+            Level& current = stack[depth];
+            axis = current.next.x <= current.next.y && current.next.x <= current.next.z ? 0 : (current.next.y <= current.next.z ? 1 : 2);
+            t = current.next[axis];
+            current.cell[axis] += step[axis];
+            if (current.cell[axis] >= 0 && current.cell[axis] < 4) {
+                current.next[axis] += cellSize(depth) * std::abs(inverse[axis]);
+                break;
+            }
+
+            if (depth-- == 0)
+                return hit;
+        }
+    }
+
+    return hit;
+}
+
+void Svo64Query::Raycast(std::span<const SvoRay> rays, std::span<SvoRayHit> hits) const {
+    constexpr size_t Chunk = 64;
+
+    parallel::For((rays.size() + Chunk - 1) / Chunk, [&](size_t c) {
+        for (size_t i = c * Chunk; i < std::min(rays.size(), (c + 1) * Chunk); i++)
+            hits[i] = Raycast(rays[i]);
+    });
+}
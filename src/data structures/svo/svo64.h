@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vk_types.h>
+#include "node_pool.h"
+#include "morton.h"
+#include "svo.h"
+#include "svo_query.h"
+
+// A child's index within its 4x4x4 parent is the 6-bit Morton code of its position, so children in
+// Morton order are also in index order: the low bit of each axis, then the high bit.
+inline uint32_t Child64Index(glm::uvec3 local) {
+    return (local.x & 1) | ((local.y & 1) << 1) | ((local.z & 1) << 2) | ((local.x >> 1) << 3) | ((local.y >> 1) << 4) | ((local.z >> 1) << 5);
+}
+
+struct Node64 {
+    uint64_t childMask = 0;
+    // First of popcount(childMask) consecutive nodes, in child index order
+    NodeIndex children = InvalidNode;
+    VoxelData data;
+    bool IsLeaf = false;
+};
+
+// Sparse voxel tree with 4x4x4 children per node, so it needs half the levels of an octree of the
+// same resolution. It has the octree's builder interface; maxDepth counts 64-ary levels, giving
+// 4^maxDepth cells per axis.
+//
+// The serialized buffer holds four words per node: the child mask's low and high halves, the child
+// pointer and the node's RGBA8 attributes. A node's children are consecutive nodes, found by popcount
+// of the mask below their bit. For nodes on the last interior level, the pointer indexes m_Attributes,
+// where their leaves' attributes are packed in the same order.
+class SparseVoxel64Tree {
+private:
+    friend class Svo64Query;
+
+    ChunkedPool<Node64> m_Nodes;
+    NodeIndex m_Root;
+    int m_Size, m_MaxDepth, m_VoxelCount;
+    // Set when inserts left interior colors and coverage out of date
+    bool m_AttributesDirty;
+    // Slots left behind when Insert moved a child array to grow it
+    uint32_t m_AbandonedNodes;
+
+    bool Quantize(glm::vec3 point, glm::uvec3& cell) const;
+    void FilterNode(NodeIndex node);
+
+public:
+    static constexpr uint32_t NodeWords = 4;
+
+    std::vector<uint32_t> m_Buffer;
+    std::vector<uint32_t> m_Attributes;
+
+    SparseVoxel64Tree(int size, int maxDepth);
+
+    // Adding a child moves its siblings to a larger array, the old one is abandoned until Clear
+    void Insert(glm::vec3 point, glm::vec3 color);
+    // Replaces the tree with the given points, built level by level from the bottom so every child
+    // array is allocated once. colors may be empty, otherwise it matches points.
+    void Build(std::span<const glm::vec3> points, std::span<const glm::vec3> colors);
+    void FilterAttributes();
+    void CreateBuffer();
+    void Clear();
+
+    int GetMaxDepth() const { return m_MaxDepth; }
+    int GetSize() const { return m_Size; }
+    int GetVoxelCount() const { return m_VoxelCount; }
+    uint32_t GetNodeCount() const { return m_Nodes.Size() - m_AbandonedNodes; }
+    size_t GetNodeMemory() const { return m_Nodes.ReservedBytes(); }
+    uint32_t GetBufferSize() const { return m_Buffer.size() * sizeof(uint32_t); }
+    // Child pointers are never far, so there is no far array
+    uint32_t GetFarBufferSize() const { return 0; }
+    uint32_t GetAttributeBufferSize() const { return m_Attributes.size() * sizeof(uint32_t); }
+    // What raymarch64.comp needs: leafDepth is its MAX_DEPTH, the number of 64-ary levels
+    SvoShaderConstants GetShaderConstants() const { return { m_MaxDepth, (float)m_Size }; }
+};
+
+// Ray and point queries against a serialized 64-ary tree, stepping through each node's 4x4x4 cells
+// the same way raymarch64.comp does. Safe to call from many threads at once.
+class Svo64Query {
+public:
+    explicit Svo64Query(const SparseVoxel64Tree& tree);
+    Svo64Query(std::span<const uint32_t> buffer, int size, int maxDepth);
+
+    bool IsOccupied(glm::vec3 point) const;
+    // Hit cells are leaf cells of the 4^maxDepth grid
+    SvoRayHit Raycast(const SvoRay& ray) const;
+    // Casts batches of rays in parallel, hits must be as long as rays
+    void Raycast(std::span<const SvoRay> rays, std::span<SvoRayHit> hits) const;
+
+private:
+    std::span<const uint32_t> m_Buffer;
+    int m_Size, m_MaxDepth;
+};
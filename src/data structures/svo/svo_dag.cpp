@@ -0,0 +1,219 @@
+#include "svo.h"
+
+#include <bit>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+    // Everything that makes two subtrees identical once their children have been merged
+    struct SubtreeKey {
+        NodeIndex children[8];
+        uint32_t color[3];
+        bool leaf;
+
+        bool operator==(const SubtreeKey& other) const { return std::memcmp(this, &other, sizeof(SubtreeKey)) == 0; }
+    };
+
+    struct SubtreeHash {
+        size_t operator()(const SubtreeKey& key) const {
+            uint64_t hash = key.leaf ? 0x9E3779B97F4A7C15ull : 0;
+            auto mix = [&](uint32_t value) {
+                hash = (hash ^ value) * 0xFF51AFD7ED558CCDull;
+                hash ^= hash >> 32;
+            };
+
+            for (NodeIndex child : key.children)
+                mix(child);
+            for (uint32_t c : key.color)
+                mix(c);
+
+            return (size_t)hash;
+        }
+    };
+}
+
+void SparseVoxelOctree::Compress() {
+    if (m_Root == InvalidNode)
+        return;
+
+    ChunkedPool<Node> merged;
+    std::unordered_map<SubtreeKey, NodeIndex, SubtreeHash> unique;
+    std::vector<NodeIndex> remap(m_Nodes.Size(), InvalidNode);
+
+    // Children are merged first, so identical subtrees end up with identical keys
+    auto merge = [&](auto& self, NodeIndex node) -> NodeIndex {
+        if (remap[node] != InvalidNode)
+            return remap[node];
+
+        Node copy = m_Nodes[node];
+        for (NodeIndex& child : copy.children) {
+            if (child != InvalidNode)
+                child = self(self, child);
+        }
+
+        // Zeroed so the padding compares equal
+        SubtreeKey key;
+        std::memset(&key, 0, sizeof(key));
+        std::memcpy(key.children, copy.children, sizeof(key.children));
+        key.leaf = copy.IsLeaf;
+        if (copy.IsLeaf) {
+            key.color[0] = std::bit_cast<uint32_t>(copy.data.color.x);
+            key.color[1] = std::bit_cast<uint32_t>(copy.data.color.y);
+            key.color[2] = std::bit_cast<uint32_t>(copy.data.color.z);
+        }
+
+        auto [it, inserted] = unique.try_emplace(key, InvalidNode);
+        if (inserted) {
+            it->second = merged.Allocate();
+            merged[it->second] = copy;
+        }
+
+        return remap[node] = it->second;
+    };
+    m_Root = merge(merge, m_Root);
+
+    m_Nodes.Swap(merged);
+    m_Compressed = true;
+    m_AbandonedNodes = 0;
+    m_Editable = false;
+
+    // Every merged node is reachable, so counting each one's children gives every node its parents
+    m_References.assign(m_Nodes.Size(), 0);
+    m_References[m_Root] = 1;
+    for (NodeIndex node = 0; node < m_Nodes.Size(); node++) {
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child != InvalidNode)
+                m_References[child]++;
+        }
+    }
+    m_FreeNodes.clear();
+}
+
+NodeIndex SparseVoxelOctree::AllocateShared() {
+    NodeIndex node;
+    if (!m_FreeNodes.empty()) {
+        node = m_FreeNodes.back();
+        m_FreeNodes.pop_back();
+        m_Nodes[node] = Node();
+    }
+    else {
+        node = m_Nodes.Allocate();
+        m_References.resize(m_Nodes.Size());
+    }
+    m_References[node] = 1;
+    return node;
+}
+
+NodeIndex SparseVoxelOctree::Unshare(NodeIndex parent, int childIndex) {
+    NodeIndex child = m_Nodes[parent].children[childIndex];
+    if (m_References[child] == 1)
+        return child;
+
+    // The copy is a new parent of every grandchild
+    NodeIndex copy = AllocateShared();
+    m_Nodes[copy] = m_Nodes[child];
+    for (NodeIndex grandchild : m_Nodes[copy].children) {
+        if (grandchild != InvalidNode)
+            m_References[grandchild]++;
+    }
+    m_References[child]--;
+    m_Nodes[parent].children[childIndex] = copy;
+    return copy;
+}
+
+void SparseVoxelOctree::Release(NodeIndex node) {
+    if (--m_References[node] > 0)
+        return;
+
+    for (NodeIndex child : m_Nodes[node].children) {
+        if (child != InvalidNode)
+            Release(child);
+    }
+    m_FreeNodes.push_back(node);
+}
+
+// Like the depth-first encoder, but a node's block is written only the first time the node is reached.
+// Later references point back at it; the offset wraps around to a large unsigned value, which always
+// goes through the far table, and the shader's 32-bit index arithmetic wraps it back. Far entries are
+// shared between descriptors with the same offset. Wide descriptors simply name the shared block.
+bool SparseVoxelOctree::CreateDagBuffer() {
+    if (m_AttributesDirty)
+        FilterAttributes();
+
+    m_Buffer.clear();
+    m_Far.clear();
+    m_Attributes.clear();
+    m_Bricks.clear();
+    m_VoxelCount = 0;
+    m_BufferBrickLevels = 0;
+    m_BufferFormat = m_Format;
+    m_BufferAttributeFormat = AttributeFormat::RGBA8;
+    m_Editable = false;
+    m_EditedCells.clear();
+    CreateDistanceField();
+
+    if (m_Root == InvalidNode)
+        return true;
+
+    std::vector<uint32_t> blockStart(m_Nodes.Size(), UINT32_MAX), voxels(m_Nodes.Size());
+    std::unordered_map<uint32_t, uint32_t> farIndex;
+
+    uint32_t slotWords = SlotWords(m_Format);
+    auto place = [&](NodeIndex node) {
+        blockStart[node] = (uint32_t)m_Attributes.size();
+        m_Attributes.resize(m_Attributes.size() + CountChildren(node));
+        m_Buffer.resize(m_Attributes.size() * slotWords);
+    };
+
+    EncodeTarget counter;
+    counter.wide = m_Format == DescriptorFormat::Wide;
+    auto encode = [&](NodeIndex node, uint32_t slot) {
+        // Placing blocks moves the buffers
+        counter.buffer = m_Buffer.data();
+        counter.attributes = m_Attributes.data();
+        uint32_t desc = CreateDescriptor(node, slot, blockStart[node], counter);
+        if (desc & (1 << 16)) {
+            uint32_t offset = blockStart[node] - slot;
+            auto [it, inserted] = farIndex.try_emplace(offset, (uint32_t)m_Far.size());
+            if (inserted)
+                m_Far.push_back(offset);
+
+            desc = (desc & 0x1FFFF) | (it->second << 17);
+        }
+
+        counter.Write(slot, desc, blockStart[node]);
+    };
+
+    // Returns the number of voxels below node, counting every reference to a shared subtree
+    auto visit = [&](auto& self, NodeIndex node) -> uint32_t {
+        uint32_t slot = blockStart[node];
+        uint32_t count = 0;
+
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child == InvalidNode)
+                continue;
+
+            if (m_Nodes[child].IsLeaf) {
+                count++;
+                continue;
+            }
+
+            bool first = blockStart[child] == UINT32_MAX;
+            if (first)
+                place(child);
+
+            encode(child, slot++);
+            count += first ? self(self, child) : voxels[child];
+        }
+
+        return voxels[node] = count;
+    };
+
+    m_Buffer.resize(slotWords);
+    m_Attributes.resize(1);
+    place(m_Root);
+    encode(m_Root, 0);
+    m_VoxelCount = visit(visit, m_Root);
+
+    return m_Far.size() <= FarIndexMax;
+}
\ No newline at end of file
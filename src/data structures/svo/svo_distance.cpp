@@ -0,0 +1,115 @@
+#include "svo.h"
+
+#include <algorithm>
+
+void SparseVoxelOctree::SetDistanceLevel(int level) {
+    m_DistanceLevel = std::clamp(level, 0, std::min(MaxDistanceLevel, m_MaxDepth));
+}
+
+// Marks the cells whose node exists at the grid's level, then runs a chessboard distance transform:
+// one raster pass forward and one back, each cell taking one more than the smallest of the 13
+// neighbours already visited. The chessboard unit ball is the 3x3x3 neighbourhood, so two passes
+// give exact distances.
+void SparseVoxelOctree::CreateDistanceField() {
+    m_Distances.clear();
+    m_BufferDistanceLevel = 0;
+    m_DistanceMax = 0;
+
+    int level = m_DistanceLevel;
+    if (level == 0 || m_Root == InvalidNode)
+        return;
+
+    int n = 1 << level;
+    std::vector<uint8_t> distance((size_t)n * n * n, 255);
+    auto index = [n](glm::ivec3 c) { return (size_t)c.x + ((size_t)c.y + (size_t)c.z * n) * n; };
+
+    auto mark = [&](auto& self, NodeIndex node, glm::ivec3 cell, int depth) -> void {
+        if (depth == level) {
+            distance[index(cell)] = 0;
+            return;
+        }
+
+        const Node& parent = m_Nodes[node];
+        for (int i = 0; i < 8; i++) {
+            if (parent.children[i] != InvalidNode)
+                self(self, parent.children[i], cell * 2 + glm::ivec3(i & 1, (i >> 1) & 1, i >> 2), depth + 1);
+        }
+    };
+    mark(mark, m_Root, glm::ivec3(0), 0);
+
+    // Neighbours before a cell in raster order, z slowest
+    std::vector<glm::ivec3> before;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dz * 9 + dy * 3 + dx < 0)
+                    before.push_back({ dx, dy, dz });
+            }
+        }
+    }
+
+    auto pass = [&](int direction) {
+        size_t cells = distance.size();
+        for (size_t step = 0; step < cells; step++) {
+            size_t i = direction > 0 ? step : cells - 1 - step;
+            if (distance[i] == 0)
+                continue;
+
+            glm::ivec3 c((int)(i % n), (int)(i / n % n), (int)(i / ((size_t)n * n)));
+            int best = distance[i];
+            for (glm::ivec3 offset : before) {
+                glm::ivec3 q = c + offset * direction;
+                if (q.x >= 0 && q.y >= 0 && q.z >= 0 && q.x < n && q.y < n && q.z < n)
+                    best = std::min(best, distance[index(q)] + 1);
+            }
+            distance[i] = (uint8_t)std::min(best, 255);
+        }
+    };
+    pass(1);
+    pass(-1);
+
+    m_Distances.assign((distance.size() + 3) / 4, 0);
+    for (size_t i = 0; i < distance.size(); i++) {
+        m_Distances[i / 4] |= (uint32_t)distance[i] << (i % 4 * 8);
+        m_DistanceMax = std::max(m_DistanceMax, (int)distance[i]);
+    }
+    m_BufferDistanceLevel = level;
+}
+
+// A voxel inserted into leaf cell makes its grid cell occupied, which can only lower the distances
+// of cells nearer to it than their current value. Those all lie within m_DistanceMax of it.
+void SparseVoxelOctree::LowerDistances(glm::uvec3 cell, SvoBufferUpdate& update) {
+    int level = m_BufferDistanceLevel;
+    if (level == 0)
+        return;
+
+    int n = 1 << level;
+    glm::ivec3 center = glm::ivec3(cell >> glm::uvec3(m_MaxDepth - level));
+    auto byte = [&](size_t i) { return (int)(m_Distances[i / 4] >> (i % 4 * 8) & 0xff); };
+    auto index = [n](glm::ivec3 c) { return (size_t)c.x + ((size_t)c.y + (size_t)c.z * n) * n; };
+    if (byte(index(center)) == 0)
+        return;
+
+    glm::ivec3 lo = glm::max(center - m_DistanceMax, glm::ivec3(0));
+    glm::ivec3 hi = glm::min(center + m_DistanceMax, glm::ivec3(n - 1));
+    size_t first = SIZE_MAX, last = 0;
+    for (int z = lo.z; z <= hi.z; z++) {
+        for (int y = lo.y; y <= hi.y; y++) {
+            for (int x = lo.x; x <= hi.x; x++) {
+                glm::ivec3 q(x, y, z);
+                glm::ivec3 d = glm::abs(q - center);
+                int distance = std::max(d.x, std::max(d.y, d.z));
+                size_t i = index(q);
+                if (distance >= byte(i))
+                    continue;
+
+                m_Distances[i / 4] = (m_Distances[i / 4] & ~(0xffu << (i % 4 * 8))) | (uint32_t)distance << (i % 4 * 8);
+                first = std::min(first, i / 4);
+                last = std::max(last, i / 4);
+            }
+        }
+    }
+
+    if (first != SIZE_MAX)
+        update.distances.push_back({ (uint32_t)first, (uint32_t)(last - first + 1) });
+}
\ No newline at end of file
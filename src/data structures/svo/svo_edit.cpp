@@ -0,0 +1,291 @@
+#include "svo.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+    // Sorts ranges by offset and merges the ones that overlap or touch
+    void MergeRanges(std::vector<SvoDirtyRange>& ranges) {
+        std::sort(ranges.begin(), ranges.end(), [](const SvoDirtyRange& a, const SvoDirtyRange& b) { return a.offset < b.offset; });
+
+        size_t count = 0;
+        for (const SvoDirtyRange& range : ranges) {
+            if (count > 0 && range.offset <= ranges[count - 1].offset + ranges[count - 1].count) {
+                SvoDirtyRange& last = ranges[count - 1];
+                last.count = std::max(last.offset + last.count, range.offset + range.count) - last.offset;
+            }
+            else
+                ranges[count++] = range;
+        }
+        ranges.resize(count);
+    }
+
+    int ChildIndex(glm::uvec3 cell, int shift) {
+        return ((cell.x >> shift) & 1) | (((cell.y >> shift) & 1) << 1) | (((cell.z >> shift) & 1) << 2);
+    }
+}
+
+void SvoBufferUpdate::Merge(const SvoBufferUpdate& later) {
+    full |= later.full;
+    auto merge = [](std::vector<SvoDirtyRange>& ranges, const std::vector<SvoDirtyRange>& more) {
+        ranges.insert(ranges.end(), more.begin(), more.end());
+        MergeRanges(ranges);
+    };
+    merge(buffer, later.buffer);
+    merge(far, later.far);
+    merge(attributes, later.attributes);
+    merge(distances, later.distances);
+}
+
+void SparseVoxelOctree::SetEditSlack(float slack) {
+    m_EditSlack = std::max(slack, 0.f);
+}
+
+bool SparseVoxelOctree::Remove(glm::vec3 point) {
+    glm::uvec3 cell;
+    if (!Quantize(point, cell) || m_Root == InvalidNode)
+        return false;
+
+    NodeIndex path[morton::MaxBitsPerAxis + 1];
+    int childIndex[morton::MaxBitsPerAxis];
+    path[0] = m_Root;
+    for (int depth = 0; depth < m_MaxDepth; depth++) {
+        childIndex[depth] = ChildIndex(cell, m_MaxDepth - depth - 1);
+        path[depth + 1] = m_Nodes[path[depth]].children[childIndex[depth]];
+        if (path[depth + 1] == InvalidNode)
+            return false;
+    }
+
+    // The path's shared nodes get their own copies, and the ones left will be refiltered
+    if (m_Compressed) {
+        for (int depth = 1; depth < m_MaxDepth; depth++)
+            path[depth] = Unshare(path[depth - 1], childIndex[depth - 1]);
+    }
+
+    // Unlink the leaf, then every ancestor it leaves without children. On a compressed tree the nodes
+    // nothing references any more are freed, otherwise they stay in the pool until Clear.
+    auto unlink = [&](int depth) {
+        if (m_Editable && depth + 1 < m_MaxDepth)
+            FreeEditSlots(path[depth + 1]);
+        if (m_Compressed)
+            Release(path[depth + 1]);
+        m_Nodes[path[depth]].children[childIndex[depth]] = InvalidNode;
+    };
+    int depth = m_MaxDepth - 1;
+    unlink(depth);
+    while (depth > 0 && CountChildren(path[depth]) == 0)
+        unlink(--depth);
+    if (CountChildren(m_Root) == 0) {
+        if (m_Compressed)
+            Release(m_Root);
+        m_Root = InvalidNode;
+    }
+
+    m_AttributesDirty = true;
+    if (m_Editable) {
+        m_VoxelCount--;
+        m_EditedCells.push_back(cell);
+    }
+    return true;
+}
+
+bool SparseVoxelOctree::Replace(glm::vec3 point, glm::vec3 color) {
+    glm::uvec3 cell;
+    if (!Quantize(point, cell) || m_Root == InvalidNode)
+        return false;
+
+    NodeIndex node = m_Root;
+    for (int depth = 0; depth < m_MaxDepth && node != InvalidNode; depth++)
+        node = m_Nodes[node].children[ChildIndex(cell, m_MaxDepth - depth - 1)];
+    if (node == InvalidNode)
+        return false;
+
+    // Copies a shared path and records the edit like any other insert
+    Insert(point, color);
+    return true;
+}
+
+void SparseVoxelOctree::IndexEditSlots() {
+    m_EditSlots.assign(m_Nodes.Size(), {});
+    for (std::vector<uint32_t>& blocks : m_FreeBlocks)
+        blocks.clear();
+    m_FreeFar.clear();
+    uint32_t slotWords = SlotWords(m_BufferFormat);
+
+    auto visit = [&](auto& self, NodeIndex node, uint32_t slot) -> void {
+        EditSlots& slots = m_EditSlots[node];
+        slots.descriptor = slot;
+        if (slotWords == 2)
+            slots.block = m_Buffer[2 * (size_t)slot + 1];
+        else {
+            uint32_t desc = m_Buffer[slot];
+            if (desc & (1 << 16))
+                slots.far = desc >> 17;
+            slots.block = slot + (slots.far != UINT32_MAX ? m_Far[slots.far] : desc >> 17);
+        }
+        slots.capacity = std::bit_ceil(CountChildren(node));
+
+        uint32_t rank = 0;
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child == InvalidNode)
+                continue;
+            if (!m_Nodes[child].IsLeaf)
+                self(self, child, slots.block + rank);
+            rank++;
+        }
+    };
+    visit(visit, m_Root, 0);
+}
+
+void SparseVoxelOctree::FreeEditSlots(NodeIndex node) {
+    if (node >= m_EditSlots.size())
+        return;
+
+    // Nodes allocated since the buffer was written have neither yet
+    EditSlots& slots = m_EditSlots[node];
+    if (slots.capacity > 0)
+        m_FreeBlocks[std::countr_zero(slots.capacity)].push_back(slots.block);
+    if (slots.far != UINT32_MAX)
+        m_FreeFar.push_back(slots.far);
+    slots = {};
+}
+
+// Only the blocks of nodes on an edited path change: their children may have been added, removed or
+// recolored, and a child that moved to another rank gets its descriptor rewritten at its new slot.
+// Blocks are rewritten deepest first, since a node's leaf attributes are written into its block by
+// the descriptor its parent writes.
+SvoBufferUpdate SparseVoxelOctree::UpdateBuffer() {
+    SvoBufferUpdate update;
+    if (m_Editable && m_EditedCells.empty())
+        return update;
+
+    auto rebuild = [&]() {
+        CreateBuffer();
+        update = {};
+        update.full = true;
+        return update;
+    };
+    if (!m_Editable || m_Root == InvalidNode)
+        return rebuild();
+
+    // Nodes allocated since the buffer was written have no block yet
+    m_EditSlots.resize(m_Nodes.Size());
+
+    // The interior nodes on every edited path, by depth. A removed voxel's path ends at the deepest
+    // node left.
+    std::vector<std::vector<NodeIndex>> levels(m_MaxDepth);
+    for (glm::uvec3 cell : m_EditedCells) {
+        NodeIndex node = m_Root;
+        for (int depth = 0; depth < m_MaxDepth && node != InvalidNode; depth++) {
+            levels[depth].push_back(node);
+            node = m_Nodes[node].children[ChildIndex(cell, m_MaxDepth - depth - 1)];
+        }
+    }
+    for (std::vector<NodeIndex>& level : levels) {
+        std::sort(level.begin(), level.end());
+        level.erase(std::unique(level.begin(), level.end()), level.end());
+    }
+
+    for (int depth = m_MaxDepth - 1; depth >= 0; depth--) {
+        for (NodeIndex node : levels[depth])
+            FilterNode(node);
+    }
+    m_AttributesDirty = false;
+
+    // Blocks that outgrew their capacity move to a freed block of the new size, else to the free tail
+    uint32_t slotCount = (uint32_t)m_Attributes.size();
+    for (const std::vector<NodeIndex>& level : levels) {
+        for (NodeIndex node : level) {
+            EditSlots& slots = m_EditSlots[node];
+            uint32_t count = CountChildren(node);
+            if (count <= slots.capacity)
+                continue;
+
+            if (slots.capacity > 0)
+                m_FreeBlocks[std::countr_zero(slots.capacity)].push_back(slots.block);
+            slots.capacity = std::bit_ceil(count);
+            std::vector<uint32_t>& freed = m_FreeBlocks[std::countr_zero(slots.capacity)];
+            if (!freed.empty()) {
+                slots.block = freed.back();
+                freed.pop_back();
+                continue;
+            }
+
+            slots.block = m_UsedSlots;
+            m_UsedSlots += slots.capacity;
+            if (m_UsedSlots > slotCount)
+                return rebuild();
+        }
+    }
+
+    uint32_t slotWords = SlotWords(m_BufferFormat);
+    EncodeTarget target;
+    target.buffer = m_Buffer.data();
+    target.attributes = m_Attributes.data();
+    target.wide = m_BufferFormat == DescriptorFormat::Wide;
+
+    // A descriptor that needs a far pointer keeps the node's far entry, or takes a freed one before
+    // m_Far grows. One that no longer needs it frees it.
+    auto describe = [&](NodeIndex node, uint32_t slot) {
+        EditSlots& slots = m_EditSlots[node];
+        slots.descriptor = slot;
+        target.farCount = 0;
+        uint32_t desc = CreateDescriptor(node, slot, slots.block, target);
+
+        if (target.farCount > 0) {
+            if (slots.far == UINT32_MAX && !m_FreeFar.empty()) {
+                slots.far = m_FreeFar.back();
+                m_FreeFar.pop_back();
+            }
+            else if (slots.far == UINT32_MAX) {
+                slots.far = (uint32_t)m_Far.size();
+                m_Far.push_back(0);
+            }
+            m_Far[slots.far] = slots.block - slot;
+            desc = (desc & ((1 << 17) - 1)) | slots.far << 17;
+            update.far.push_back({ slots.far, 1 });
+        }
+        else if (slots.far != UINT32_MAX) {
+            m_FreeFar.push_back(slots.far);
+            slots.far = UINT32_MAX;
+        }
+        target.Write(slot, desc, slots.block);
+    };
+
+    for (int depth = m_MaxDepth - 1; depth >= 0; depth--) {
+        for (NodeIndex node : levels[depth]) {
+            uint32_t block = m_EditSlots[node].block, capacity = m_EditSlots[node].capacity;
+            std::fill_n(m_Buffer.begin() + (size_t)block * slotWords, (size_t)capacity * slotWords, 0);
+            std::fill_n(m_Attributes.begin() + block, capacity, 0);
+
+            uint32_t slot = block;
+            for (NodeIndex child : m_Nodes[node].children) {
+                if (child == InvalidNode)
+                    continue;
+                if (!m_Nodes[child].IsLeaf)
+                    describe(child, slot);
+                slot++;
+            }
+
+            update.buffer.push_back({ block * slotWords, capacity * slotWords });
+            update.attributes.push_back({ block, capacity });
+        }
+    }
+    describe(m_Root, 0);
+    update.buffer.push_back({ 0, slotWords });
+    update.attributes.push_back({ 0, 1 });
+
+    if (m_Far.size() > FarIndexMax)
+        return rebuild();
+
+    // Removed voxels' grid cells were already at distance 0, so this only lowers around new ones
+    for (glm::uvec3 cell : m_EditedCells)
+        LowerDistances(cell, update);
+    m_EditedCells.clear();
+
+    MergeRanges(update.buffer);
+    MergeRanges(update.far);
+    MergeRanges(update.attributes);
+    MergeRanges(update.distances);
+    return update;
+}
\ No newline at end of file
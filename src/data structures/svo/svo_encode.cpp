@@ -0,0 +1,344 @@
+#include "svo.h"
+
+#include <parallel.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+    // A node serialized on its own, or a whole subtree below the split depth
+    struct EncodeItem {
+        NodeIndex node;
+        uint32_t parentItem;
+        uint32_t rank;
+        bool subtree;
+        uint32_t slot = 0;
+    };
+}
+
+uint32_t SparseVoxelOctree::CountChildren(NodeIndex node) const {
+    uint32_t count = 0;
+    for (NodeIndex child : m_Nodes[node].children)
+        count += child != InvalidNode;
+
+    return count;
+}
+
+uint32_t SparseVoxelOctree::BlockSlots(NodeIndex node, const EncodeTarget& target) const {
+    uint32_t count = CountChildren(node);
+    return target.roundBlocks ? std::bit_ceil(count) : count;
+}
+
+// Every leaf is at m_MaxDepth, so any path down tells how high a node is
+bool SparseVoxelOctree::IsBrickRoot(NodeIndex node, int levels) const {
+    if (levels == 0)
+        return false;
+
+    for (int level = 0; level < levels; level++) {
+        const Node& n = m_Nodes[node];
+        if (n.IsLeaf)
+            return false;
+
+        node = *std::find_if(std::begin(n.children), std::end(n.children), [](NodeIndex child) { return child != InvalidNode; });
+    }
+
+    return m_Nodes[node].IsLeaf;
+}
+
+// Takes the next brick index and attribute slots from the target, and writes the brick if it has a
+// buffer
+void SparseVoxelOctree::CreateBrick(NodeIndex node, EncodeTarget& target) const {
+    constexpr uint32_t MaxVoxels = 1u << (3 * MaxBrickLevels);
+
+    int levels = target.brickLevels;
+    uint32_t side = 1u << levels;
+    uint32_t occupancy[MaxVoxels / 32] = {};
+    NodeIndex voxels[MaxVoxels];
+
+    auto collect = [&](auto& self, NodeIndex n, glm::uvec3 cell, int level) -> void {
+        if (level == levels) {
+            uint32_t index = cell.x + (cell.y + cell.z * side) * side;
+            occupancy[index / 32] |= 1u << (index % 32);
+            voxels[index] = n;
+            return;
+        }
+
+        for (int i = 0; i < 8; i++) {
+            if (NodeIndex child = m_Nodes[n].children[i]; child != InvalidNode)
+                self(self, child, cell * 2u + glm::uvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1), level + 1);
+        }
+    };
+    collect(collect, node, glm::uvec3(0), 0);
+
+    uint32_t words = BrickWords(levels) - 1;
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < words; w++)
+        count += std::popcount(occupancy[w]);
+
+    if (target.bricks) {
+        uint32_t* brick = target.bricks + (size_t)target.brickCount * BrickWords(levels);
+        brick[0] = target.brickAttributeSlot;
+        std::copy(occupancy, occupancy + words, brick + 1);
+
+        uint32_t slot = target.brickAttributeSlot;
+        for (uint32_t index = 0; index < side * side * side; index++) {
+            if (occupancy[index / 32] & (1u << (index % 32)))
+                target.attributes[slot++] = target.Pack(voxels[index], m_Nodes[voxels[index]].data);
+        }
+    }
+
+    target.brickCount++;
+    target.brickAttributeSlot += count;
+    target.voxelCount += count;
+}
+
+// Also writes the node's attributes to its slot and those of its leaf children to theirs
+uint32_t SparseVoxelOctree::CreateDescriptor(NodeIndex node, uint32_t slot, uint32_t blockStart, EncodeTarget& target) const {
+    if (target.attributes)
+        target.attributes[slot] = target.Pack(node, m_Nodes[node].data);
+
+    uint32_t childDesc = 0;
+    int validChildCount = 0;
+    for (int i = 0; i < 8; i++) {
+        if (NodeIndex child = m_Nodes[node].children[i]; child != InvalidNode) {
+            childDesc |= 1 << i;
+            if (m_Nodes[child].IsLeaf) {
+                childDesc |= 1 << (i + 8);
+                target.voxelCount++;
+                if (target.attributes)
+                    target.attributes[blockStart + validChildCount] = target.Pack(child, m_Nodes[child].data);
+            }
+            else if (IsBrickRoot(child, target.brickLevels)) {
+                // Drawn like a leaf, its slot holds the brick index and its filtered attributes
+                childDesc |= 1 << (i + 8);
+                if (target.buffer)
+                    target.Write(blockStart + validChildCount, target.brickCount, 0);
+                if (target.attributes)
+                    target.attributes[blockStart + validChildCount] = target.Pack(child, m_Nodes[child].data);
+                CreateBrick(child, target);
+            }
+
+            // Leaf blocks are pointed at too, for their attributes. Wide descriptors hold the block's
+            // slot in their second word instead.
+            if (validChildCount == 0 && !target.wide) {
+                uint32_t indexOffset = blockStart - slot;
+                if (indexOffset >= PointerOffsetFarMax) {
+                    childDesc |= 1 << 16;
+                    if (target.far)
+                        target.far[target.farCount] = indexOffset;
+                    childDesc |= target.farCount++ << 17;
+                }
+                else
+                    childDesc |= indexOffset << 17;
+            }
+            validChildCount++;
+        }
+    }
+
+    return childDesc;
+}
+
+// Each node's children occupy one block, reserved at the cursor when the node is visited in preorder.
+// Interior children are packed at the front of the block, leaf slots stay zero and only carry the
+// leaf's attributes. Brick roots are the leaves of a buffer with bricks.
+void SparseVoxelOctree::CreateBuffer(NodeIndex node, uint32_t blockStart, uint32_t& cursor, EncodeTarget& target) const {
+    uint32_t slot = blockStart;
+    for (NodeIndex child : m_Nodes[node].children) {
+        if (child == InvalidNode || m_Nodes[child].IsLeaf || IsBrickRoot(child, target.brickLevels))
+            continue;
+
+        uint32_t childBlock = cursor;
+        cursor += BlockSlots(child, target);
+
+        uint32_t desc = CreateDescriptor(child, slot, childBlock, target);
+        if (target.buffer)
+            target.Write(slot, desc, childBlock);
+
+        slot++;
+        CreateBuffer(child, childBlock, cursor, target);
+    }
+}
+
+uint32_t SparseVoxelOctree::EncodeSubtree(NodeIndex node, std::vector<uint32_t>& buffer, std::vector<uint32_t>& far, std::vector<uint32_t>& attributes) const {
+    EncodeTarget counter;
+    uint32_t cursor = 1 + CountChildren(node);
+    CreateDescriptor(node, 0, 1, counter);
+    CreateBuffer(node, 1, cursor, counter);
+
+    buffer.assign(cursor, 0);
+    far.assign(counter.farCount, 0);
+    attributes.assign(cursor, 0);
+
+    EncodeTarget target{ buffer.data(), far.data(), 0, 0, attributes.data() };
+    cursor = 1 + CountChildren(node);
+    buffer[0] = CreateDescriptor(node, 0, 1, target);
+    CreateBuffer(node, 1, cursor, target);
+
+    return target.voxelCount;
+}
+
+void SparseVoxelOctree::SetBrickLevels(int levels) {
+    m_BrickLevels = std::clamp(levels, 0, std::min(MaxBrickLevels, m_MaxDepth - 1));
+}
+
+void SparseVoxelOctree::CreateBuffer() {
+    if (m_Compressed) {
+        if (CreateDagBuffer())
+            return;
+
+        // Wide descriptors need no far pointers, so this cannot fail
+        fmt::println("SVO DAG needs more than {} far pointers, encoding it with wide descriptors", FarIndexMax);
+        DescriptorFormat format = m_Format;
+        m_Format = DescriptorFormat::Wide;
+        CreateDagBuffer();
+        m_Format = format;
+        return;
+    }
+
+    // Enough subtrees to keep every thread busy, a single-threaded encode does not split at all
+    int splitDepth = 0;
+    if (m_Root != InvalidNode && parallel::ThreadCount() > 1) {
+        std::vector<NodeIndex> level = { m_Root }, next;
+        while (splitDepth < m_MaxDepth - 1 - m_BrickLevels && level.size() < 8 * parallel::ThreadCount()) {
+            next.clear();
+            for (NodeIndex node : level) {
+                for (NodeIndex child : m_Nodes[node].children) {
+                    if (child != InvalidNode && !m_Nodes[child].IsLeaf)
+                        next.push_back(child);
+                }
+            }
+            level.swap(next);
+            splitDepth++;
+        }
+    }
+
+    CreateBuffer(splitDepth);
+}
+
+void SparseVoxelOctree::CreateBuffer(int splitDepth) {
+    if (m_AttributesDirty)
+        FilterAttributes();
+
+    m_Buffer.clear();
+    m_Far.clear();
+    m_Attributes.clear();
+    m_Bricks.clear();
+    m_VoxelCount = 0;
+    m_BufferFormat = m_Format;
+    m_Editable = false;
+    m_EditedCells.clear();
+    CreateDistanceField();
+
+    // Editable buffers need every node to have a block of its own, and attributes UpdateBuffer can
+    // rewrite without looking at the neighbours
+    bool editable = m_EditSlack > 0 && !m_Compressed;
+    int brickLevels = editable ? 0 : m_BrickLevels;
+    bool wide = m_Format == DescriptorFormat::Wide;
+    m_BufferBrickLevels = brickLevels;
+    m_BufferAttributeFormat = editable || m_Compressed ? AttributeFormat::RGBA8 : m_AttributeFormat;
+
+    if (m_Root == InvalidNode)
+        return;
+
+    std::vector<uint16_t> normals;
+    if (m_BufferAttributeFormat == AttributeFormat::ColorNormal)
+        normals = EstimateNormals();
+
+    // Nodes above the split are items of their own, in the preorder the sequential encoder visits them
+    std::vector<EncodeItem> items;
+    auto collect = [&](auto& self, NodeIndex node, uint32_t parentItem, uint32_t rank, int depth) -> void {
+        uint32_t item = (uint32_t)items.size();
+        items.push_back({ node, parentItem, rank, depth >= splitDepth });
+        if (depth >= splitDepth)
+            return;
+
+        uint32_t childRank = 0;
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child != InvalidNode && !m_Nodes[child].IsLeaf && !IsBrickRoot(child, brickLevels))
+                self(self, child, item, childRank++, depth + 1);
+        }
+    };
+    collect(collect, m_Root, UINT32_MAX, 0, 0);
+
+    // Counting pass: words, far pointers and bricks below each item's own block, which only depend on
+    // the item
+    std::vector<uint32_t> words(items.size()), fars(items.size()), voxels(items.size());
+    std::vector<uint32_t> bricks(items.size()), brickVoxels(items.size());
+    parallel::For(items.size(), [&](size_t i) {
+        EncodeTarget counter;
+        counter.brickLevels = brickLevels;
+        counter.wide = wide;
+        counter.roundBlocks = editable;
+        uint32_t cursor = BlockSlots(items[i].node, counter);
+        if (items[i].subtree) {
+            CreateBuffer(items[i].node, 0, cursor, counter);
+            fars[i] = counter.farCount;
+            bricks[i] = counter.brickCount;
+            brickVoxels[i] = counter.brickAttributeSlot;
+        }
+        words[i] = cursor;
+    });
+
+    // Slot 0 holds the root descriptor
+    uint32_t slotCount = 1 + parallel::ExclusiveScan(std::span<uint32_t>(words));
+
+    // An item's own descriptor sits in its parent's block, so whether it needs a far pointer is only
+    // known once the blocks are placed
+    for (size_t i = 0; i < items.size(); i++) {
+        EncodeItem& item = items[i];
+        words[i] += 1;
+        item.slot = item.parentItem == UINT32_MAX ? 0 : words[item.parentItem] + item.rank;
+
+        EncodeTarget counter;
+        counter.brickLevels = brickLevels;
+        counter.wide = wide;
+        CreateDescriptor(item.node, item.slot, words[i], counter);
+        fars[i] += counter.farCount;
+        bricks[i] += counter.brickCount;
+        brickVoxels[i] += counter.brickAttributeSlot;
+    }
+
+    uint32_t farCount = parallel::ExclusiveScan(std::span<uint32_t>(fars));
+    // Far indices past FarIndexMax would wrap in the descriptor, wide descriptors need none
+    if (!wide && farCount > FarIndexMax) {
+        fmt::println("SVO needs {} far pointers, compact descriptors can only index {}; encoding it with wide descriptors", farCount, FarIndexMax);
+        DescriptorFormat format = m_Format;
+        m_Format = DescriptorFormat::Wide;
+        CreateBuffer(splitDepth);
+        m_Format = format;
+        return;
+    }
+    uint32_t brickCount = parallel::ExclusiveScan(std::span<uint32_t>(bricks));
+    uint32_t brickVoxelCount = parallel::ExclusiveScan(std::span<uint32_t>(brickVoxels));
+
+    m_Buffer.assign((size_t)slotCount * SlotWords(m_Format), 0);
+    m_Far.assign(farCount, 0);
+    m_Attributes.assign(slotCount + brickVoxelCount, 0);
+    m_Bricks.assign((size_t)brickCount * BrickWords(brickLevels), 0);
+
+    // Placement pass: every item writes its own descriptor and the blocks of its subtree. Brick voxels'
+    // attributes go after the slots of the buffer.
+    parallel::For(items.size(), [&](size_t i) {
+        const EncodeItem& item = items[i];
+        EncodeTarget target{ m_Buffer.data(), m_Far.data(), fars[i], 0, m_Attributes.data(), brickLevels, m_Bricks.data(), bricks[i], slotCount + brickVoxels[i], wide, editable, normals.empty() ? nullptr : normals.data() };
+
+        target.Write(item.slot, CreateDescriptor(item.node, item.slot, words[i], target), words[i]);
+        if (item.subtree) {
+            uint32_t cursor = words[i] + BlockSlots(item.node, target);
+            CreateBuffer(item.node, words[i], cursor, target);
+        }
+        voxels[i] = target.voxelCount;
+    });
+
+    for (uint32_t v : voxels)
+        m_VoxelCount += v;
+
+    if (editable) {
+        uint32_t tail = (uint32_t)std::ceil(slotCount * m_EditSlack);
+        m_UsedSlots = slotCount;
+        m_Buffer.resize((size_t)(slotCount + tail) * SlotWords(m_Format), 0);
+        m_Attributes.resize(slotCount + tail, 0);
+        IndexEditSlots();
+        m_Editable = true;
+    }
+}
\ No newline at end of file
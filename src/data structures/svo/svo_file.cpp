@@ -0,0 +1,196 @@
+#include "svo_file.h"
+#include "svo.h"
+
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool SparseVoxelOctree::Save(const std::filesystem::path& path) const {
+    SvoFileHeader header{};
+    header.magic = SvoFileHeader::Magic;
+    header.version = SvoFileHeader::CurrentVersion;
+    header.size = m_Size;
+    header.maxDepth = m_MaxDepth;
+    header.voxelCount = (uint64_t)m_VoxelCount;
+    header.flags = (m_Compressed ? SvoFileHeader::Compressed : 0) | (m_BufferFormat == DescriptorFormat::Wide ? SvoFileHeader::Wide : 0)
+        | (m_BufferAttributeFormat == AttributeFormat::ColorNormal ? SvoFileHeader::ColorNormal : 0);
+    header.distanceLevel = m_BufferDistanceLevel;
+    header.brickLevels = m_BufferBrickLevels;
+    header.byteOrder = SvoFileHeader::ByteOrder;
+    header.bufferOffset = SvoFileHeader::Alignment;
+    header.bufferWords = m_Buffer.size();
+    header.farOffset = SvoFileHeader::AlignUp(header.bufferOffset + m_Buffer.size() * sizeof(uint32_t));
+    header.farWords = m_Far.size();
+    header.attributeOffset = SvoFileHeader::AlignUp(header.farOffset + m_Far.size() * sizeof(uint32_t));
+    header.attributeWords = m_Attributes.size();
+    header.brickOffset = SvoFileHeader::AlignUp(header.attributeOffset + m_Attributes.size() * sizeof(uint32_t));
+    header.brickWords = m_Bricks.size();
+    header.distanceOffset = SvoFileHeader::AlignUp(header.brickOffset + m_Bricks.size() * sizeof(uint32_t));
+    header.distanceWords = m_Distances.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        fmt::println("Failed to open {} for writing", path.string());
+        return false;
+    }
+
+    auto padTo = [&](uint64_t offset) {
+        static const char zeros[SvoFileHeader::Alignment] = {};
+        file.write(zeros, (std::streamsize)(offset - (uint64_t)file.tellp()));
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    padTo(header.bufferOffset);
+    file.write(reinterpret_cast<const char*>(m_Buffer.data()), (std::streamsize)(m_Buffer.size() * sizeof(uint32_t)));
+    padTo(header.farOffset);
+    file.write(reinterpret_cast<const char*>(m_Far.data()), (std::streamsize)(m_Far.size() * sizeof(uint32_t)));
+    padTo(header.attributeOffset);
+    file.write(reinterpret_cast<const char*>(m_Attributes.data()), (std::streamsize)(m_Attributes.size() * sizeof(uint32_t)));
+    padTo(header.brickOffset);
+    file.write(reinterpret_cast<const char*>(m_Bricks.data()), (std::streamsize)(m_Bricks.size() * sizeof(uint32_t)));
+    padTo(header.distanceOffset);
+    file.write(reinterpret_cast<const char*>(m_Distances.data()), (std::streamsize)(m_Distances.size() * sizeof(uint32_t)));
+
+    if (!file) {
+        fmt::println("Failed to write {}", path.string());
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<MappedSvo> MappedSvo::Open(const std::filesystem::path& path) {
+    MappedSvo mapped;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        fmt::println("Failed to open SVO file {}", path.string());
+        return {};
+    }
+
+    LARGE_INTEGER length;
+    GetFileSizeEx(file, &length);
+    mapped.m_Length = (size_t)length.QuadPart;
+
+    // The view keeps the mapping alive once both handles are closed
+    HANDLE mapping = mapped.m_Length > 0 ? CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    if (mapping) {
+        mapped.m_Data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fmt::println("Failed to open SVO file {}", path.string());
+        return {};
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0)
+        mapped.m_Length = (size_t)info.st_size;
+
+    if (mapped.m_Length > 0) {
+        void* data = mmap(nullptr, mapped.m_Length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            // Everything is about to be copied out front to back
+            madvise(data, mapped.m_Length, MADV_SEQUENTIAL);
+            madvise(data, mapped.m_Length, MADV_WILLNEED);
+            mapped.m_Data = data;
+        }
+    }
+    close(fd);
+#endif
+
+    if (!mapped.m_Data) {
+        fmt::println("Failed to map SVO file {}", path.string());
+        return {};
+    }
+
+    if (mapped.m_Length < sizeof(SvoFileHeader)) {
+        fmt::println("{} is too small to be an SVO file", path.string());
+        return {};
+    }
+
+    const SvoFileHeader& header = mapped.GetHeader();
+    // Words are mapped as they are, so a file from a host with the other byte order cannot be read
+    if (header.magic != SvoFileHeader::Magic && header.byteOrder == 0x04030201) {
+        fmt::println("{} was saved on a host with the other byte order", path.string());
+        return {};
+    }
+
+    if (header.magic != SvoFileHeader::Magic) {
+        fmt::println("{} is not an SVO file", path.string());
+        return {};
+    }
+
+    if (header.version != SvoFileHeader::CurrentVersion) {
+        fmt::println("{} has SVO format version {}, expected {}", path.string(), header.version, SvoFileHeader::CurrentVersion);
+        return {};
+    }
+
+    if (header.byteOrder != SvoFileHeader::ByteOrder) {
+        fmt::println("{} has an unknown byte order mark {:#010x}", path.string(), header.byteOrder);
+        return {};
+    }
+
+    if (header.maxDepth < 1 || header.maxDepth > morton::MaxBitsPerAxis || header.brickLevels < 0 || header.brickLevels >= header.maxDepth ||
+        header.distanceLevel < 0 || header.distanceLevel > header.maxDepth) {
+        fmt::println("{} has an invalid depth, brick or distance level", path.string());
+        return {};
+    }
+
+    auto fits = [&](uint64_t offset, uint64_t words) {
+        return offset % SvoFileHeader::Alignment == 0 && offset <= mapped.m_Length && words <= (mapped.m_Length - offset) / sizeof(uint32_t);
+    };
+
+    if (!fits(header.bufferOffset, header.bufferWords) || !fits(header.farOffset, header.farWords) ||
+        !fits(header.attributeOffset, header.attributeWords) || !fits(header.brickOffset, header.brickWords) ||
+        !fits(header.distanceOffset, header.distanceWords)) {
+        fmt::println("{} is truncated or corrupt", path.string());
+        return {};
+    }
+
+    return mapped;
+}
+
+MappedSvo::MappedSvo(MappedSvo&& other) noexcept : m_Data(other.m_Data), m_Length(other.m_Length) {
+    other.m_Data = nullptr;
+    other.m_Length = 0;
+}
+
+MappedSvo& MappedSvo::operator=(MappedSvo&& other) noexcept {
+    if (this != &other) {
+        Unmap();
+        std::swap(m_Data, other.m_Data);
+        std::swap(m_Length, other.m_Length);
+    }
+    return *this;
+}
+
+MappedSvo::~MappedSvo() {
+    Unmap();
+}
+
+void MappedSvo::Unmap() {
+    if (!m_Data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_Data);
+#else
+    munmap(m_Data, m_Length);
+#endif
+    m_Data = nullptr;
+    m_Length = 0;
+}
\ No newline at end of file
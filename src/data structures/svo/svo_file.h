@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vk_types.h>
+#include <filesystem>
+#include "svo.h"
+
+// On-disk SVO: this header, then m_Buffer, m_Far, m_Attributes, m_Bricks and m_Distances as words in
+// the byte order of the host that saved it, which byteOrder records. Every array starts on a page
+// boundary, so a mapped file can be handed to the GPU upload page by page without parsing, and the
+// header carries everything raymarch.comp is specialized for.
+struct SvoFileHeader {
+    static constexpr uint32_t Magic = 0x314F5653;   // "SVO1"
+    static constexpr uint32_t CurrentVersion = 6;
+    // Reads back byte-swapped on a host with the other byte order
+    static constexpr uint32_t ByteOrder = 0x01020304;
+    static constexpr uint64_t Alignment = 4096;
+
+    static constexpr uint64_t AlignUp(uint64_t offset) { return (offset + Alignment - 1) & ~(Alignment - 1); }
+
+    enum Flags : uint32_t {
+        Compressed = 1 << 0,   // m_Buffer holds a DAG, see SparseVoxelOctree::Compress
+        Wide = 1 << 1,         // m_Buffer holds DescriptorFormat::Wide descriptors
+        ColorNormal = 1 << 2,  // m_Attributes holds AttributeFormat::ColorNormal words
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    int32_t size;
+    int32_t maxDepth;
+    uint64_t voxelCount;
+    uint32_t flags;
+    // Grid level of the distance field, 0 if the file has none
+    int32_t distanceLevel;
+    // Levels above the leaves written as bricks, 0 if the file has none
+    int32_t brickLevels;
+    uint32_t byteOrder;
+    uint64_t bufferOffset, bufferWords;
+    uint64_t farOffset, farWords;
+    uint64_t attributeOffset, attributeWords;
+    uint64_t brickOffset, brickWords;
+    uint64_t distanceOffset, distanceWords;
+};
+
+static_assert(sizeof(SvoFileHeader) == 120);
+
+// Read-only mapping of an SVO file. The spans point into the mapping and live as long as it does.
+class MappedSvo {
+public:
+    static std::optional<MappedSvo> Open(const std::filesystem::path& path);
+
+    MappedSvo(MappedSvo&& other) noexcept;
+    MappedSvo& operator=(MappedSvo&& other) noexcept;
+    MappedSvo(const MappedSvo&) = delete;
+    MappedSvo& operator=(const MappedSvo&) = delete;
+    ~MappedSvo();
+
+    const SvoFileHeader& GetHeader() const { return *static_cast<const SvoFileHeader*>(m_Data); }
+    std::span<const uint32_t> GetBuffer() const { return Words(GetHeader().bufferOffset, GetHeader().bufferWords); }
+    std::span<const uint32_t> GetFar() const { return Words(GetHeader().farOffset, GetHeader().farWords); }
+    std::span<const uint32_t> GetAttributes() const { return Words(GetHeader().attributeOffset, GetHeader().attributeWords); }
+    std::span<const uint32_t> GetBricks() const { return Words(GetHeader().brickOffset, GetHeader().brickWords); }
+    std::span<const uint32_t> GetDistances() const { return Words(GetHeader().distanceOffset, GetHeader().distanceWords); }
+
+    int GetSize() const { return GetHeader().size; }
+    int GetMaxDepth() const { return GetHeader().maxDepth; }
+    int GetDistanceLevel() const { return GetHeader().distanceLevel; }
+    int GetBrickLevels() const { return GetHeader().brickLevels; }
+    DescriptorFormat GetDescriptorFormat() const { return (GetHeader().flags & SvoFileHeader::Wide) ? DescriptorFormat::Wide : DescriptorFormat::Compact; }
+    AttributeFormat GetAttributeFormat() const { return (GetHeader().flags & SvoFileHeader::ColorNormal) ? AttributeFormat::ColorNormal : AttributeFormat::RGBA8; }
+    uint64_t GetVoxelCount() const { return GetHeader().voxelCount; }
+    size_t GetFileSize() const { return m_Length; }
+    // What raymarch.comp needs to traverse the file's arrays, as SparseVoxelOctree::GetShaderConstants
+    // returned when it was saved
+    SvoShaderConstants GetShaderConstants() const {
+        return { GetMaxDepth(), (float)GetSize(), GetDescriptorFormat() == DescriptorFormat::Wide,
+            GetAttributeFormat() == AttributeFormat::ColorNormal, GetBrickLevels(), GetDistanceLevel() };
+    }
+
+private:
+    MappedSvo() = default;
+    void Unmap();
+
+    std::span<const uint32_t> Words(uint64_t offset, uint64_t count) const {
+        return { reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(m_Data) + offset), (size_t)count };
+    }
+
+    void* m_Data = nullptr;
+    size_t m_Length = 0;
+};
\ No newline at end of file
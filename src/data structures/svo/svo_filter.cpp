@@ -0,0 +1,85 @@
+#include "svo.h"
+
+#include <parallel.h>
+
+void SparseVoxelOctree::FilterNode(NodeIndex node) {
+    Node& n = m_Nodes[node];
+
+    float coverage[8] = {};
+    glm::vec3 colorSum(0.f);
+    float coverageSum = 0;
+    for (int i = 0; i < 8; i++) {
+        if (n.children[i] == InvalidNode)
+            continue;
+
+        const VoxelData& child = m_Nodes[n.children[i]].data;
+        coverage[i] = child.coverage;
+        colorSum += child.color * child.coverage;
+        coverageSum += child.coverage;
+    }
+
+    // Looking down an axis, each of the four columns is as opaque as its two children composited
+    float best = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        int bit = 1 << axis;
+        float opacity = 0;
+        for (int i = 0; i < 8; i++) {
+            if (!(i & bit))
+                opacity += 1 - (1 - coverage[i]) * (1 - coverage[i | bit]);
+        }
+        best = std::max(best, opacity / 4);
+    }
+
+    n.data.coverage = best;
+    if (coverageSum > 0)
+        n.data.color = colorSum / coverageSum;
+}
+
+void SparseVoxelOctree::FilterAttributes() {
+    m_AttributesDirty = false;
+    if (m_Root == InvalidNode)
+        return;
+
+    // A node shared by a DAG is filtered once, its children are the same wherever it is reached
+    std::vector<uint8_t> filtered(m_Compressed ? m_Nodes.Size() : 0);
+    auto filter = [&](auto& self, NodeIndex node) -> void {
+        if (m_Nodes[node].IsLeaf || (m_Compressed && filtered[node]))
+            return;
+
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child != InvalidNode)
+                self(self, child);
+        }
+        FilterNode(node);
+
+        if (m_Compressed)
+            filtered[node] = 1;
+    };
+
+    if (m_Compressed || parallel::ThreadCount() == 1) {
+        filter(filter, m_Root);
+        return;
+    }
+
+    // Subtrees of a tree are disjoint, so everything below the top two levels is filtered in parallel
+    std::vector<NodeIndex> top, subtrees = { m_Root }, next;
+    for (int depth = 0; depth < std::min(2, m_MaxDepth); depth++) {
+        next.clear();
+        for (NodeIndex node : subtrees) {
+            for (NodeIndex child : m_Nodes[node].children) {
+                if (child != InvalidNode)
+                    next.push_back(child);
+            }
+        }
+        top.insert(top.end(), subtrees.begin(), subtrees.end());
+        subtrees.swap(next);
+    }
+
+    parallel::For(subtrees.size(), [&](size_t i) { filter(filter, subtrees[i]); });
+
+    // Parents were listed before their children
+    for (size_t i = top.size(); i-- > 0;) {
+        if (!m_Nodes[top[i]].IsLeaf)
+            FilterNode(top[i]);
+    }
+}
\ No newline at end of file
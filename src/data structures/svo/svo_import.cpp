@@ -0,0 +1,486 @@
+#include "svo.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <queue>
+#include <sstream>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Points read and quantized at a time
+    constexpr size_t BlockPoints = 1 << 16;
+    // What one buffered point costs while a run is sorted: its code, color and sort order, plus the
+    // radix sort's scratch copies of the code and order
+    constexpr size_t BytesPerPoint = 40;
+
+    // One point of a sorted run on disk
+    struct RunRecord {
+        uint32_t codeLow, codeHigh;
+        uint32_t color;
+
+        uint64_t Code() const { return (uint64_t)codeHigh << 32 | codeLow; }
+    };
+    static_assert(sizeof(RunRecord) == 12);
+
+    uint32_t PackColor(glm::vec3 color) {
+        glm::uvec3 c = glm::uvec3(glm::clamp(color, 0.f, 255.f) + 0.5f);
+        return c.x | (c.y << 8) | (c.z << 16);
+    }
+
+    glm::vec3 UnpackColor(uint32_t color) {
+        return glm::vec3(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF) / 255.f;
+    }
+
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+    bool ParsePlyType(const std::string& name, PlyType& type, size_t& size) {
+        static const std::pair<const char*, PlyType> Names[] = {
+            { "char", PlyType::Int8 }, { "int8", PlyType::Int8 }, { "uchar", PlyType::UInt8 }, { "uint8", PlyType::UInt8 },
+            { "short", PlyType::Int16 }, { "int16", PlyType::Int16 }, { "ushort", PlyType::UInt16 }, { "uint16", PlyType::UInt16 },
+            { "int", PlyType::Int32 }, { "int32", PlyType::Int32 }, { "uint", PlyType::UInt32 }, { "uint32", PlyType::UInt32 },
+            { "float", PlyType::Float32 }, { "float32", PlyType::Float32 }, { "double", PlyType::Float64 }, { "float64", PlyType::Float64 },
+        };
+        static const size_t Sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+        for (const auto& [typeName, value] : Names) {
+            if (name == typeName) {
+                type = value;
+                size = Sizes[(int)value];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Assumes a little-endian host, like the rest of the file formats
+    double ReadPlyValue(const char* data, PlyType type) {
+        switch (type) {
+        case PlyType::Int8: { int8_t v; memcpy(&v, data, 1); return v; }
+        case PlyType::UInt8: { uint8_t v; memcpy(&v, data, 1); return v; }
+        case PlyType::Int16: { int16_t v; memcpy(&v, data, 2); return v; }
+        case PlyType::UInt16: { uint16_t v; memcpy(&v, data, 2); return v; }
+        case PlyType::Int32: { int32_t v; memcpy(&v, data, 4); return v; }
+        case PlyType::UInt32: { uint32_t v; memcpy(&v, data, 4); return v; }
+        case PlyType::Float32: { float v; memcpy(&v, data, 4); return v; }
+        case PlyType::Float64: { double v; memcpy(&v, data, 8); return v; }
+        }
+        return 0;
+    }
+
+    struct PlyProperty {
+        size_t offset = 0;
+        PlyType type = PlyType::Float32;
+        bool present = false;
+    };
+
+    // Streams points out of a PLY or XYZ file in blocks, colors as 0-255 RGB packed into a word
+    class PointReader {
+    public:
+        bool Open(const std::filesystem::path& path);
+        // Appends up to max points, returns how many, 0 at the end of the file or on an error
+        size_t Read(size_t max, std::vector<glm::vec3>& positions, std::vector<uint32_t>& colors);
+
+        bool Failed() const { return m_Failed; }
+        uint64_t GetBytesRead() const { return m_BytesRead; }
+        uint64_t GetTotalBytes() const { return m_TotalBytes; }
+
+    private:
+        static constexpr size_t TextChunk = 1 << 20;
+
+        std::filesystem::path m_Path;
+        std::ifstream m_File;
+        bool m_Ply = false;
+        bool m_Failed = false;
+        uint64_t m_BytesRead = 0, m_TotalBytes = 0;
+
+        // Binary PLY vertices left, their size and where their properties are
+        uint64_t m_Remaining = 0;
+        size_t m_Stride = 0;
+        PlyProperty m_Position[3], m_Color[3];
+        std::vector<char> m_Bytes;
+
+        // XYZ text read but not parsed yet
+        std::string m_Text;
+        size_t m_TextStart = 0;
+
+        bool OpenPly();
+        size_t ReadPly(size_t max, std::vector<glm::vec3>& positions, std::vector<uint32_t>& colors);
+        size_t ReadXyz(size_t max, std::vector<glm::vec3>& positions, std::vector<uint32_t>& colors);
+        bool Fail(const std::string& message);
+    };
+
+    bool PointReader::Fail(const std::string& message) {
+        fmt::println("Cannot import {}: {}", m_Path.string(), message);
+        m_Failed = true;
+        return false;
+    }
+
+    bool PointReader::Open(const std::filesystem::path& path) {
+        m_Path = path;
+        m_File.open(path, std::ios::binary);
+        if (!m_File)
+            return Fail("failed to open the file");
+
+        std::error_code error;
+        m_TotalBytes = std::filesystem::file_size(path, error);
+
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+        m_Ply = extension == ".ply";
+        return m_Ply ? OpenPly() : true;
+    }
+
+    // Only the vertex element is read, so it has to come first and must not hold lists
+    bool PointReader::OpenPly() {
+        std::string line;
+        bool inVertex = false, seenElement = false;
+        while (std::getline(m_File, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            std::istringstream words(line);
+            std::string keyword;
+            words >> keyword;
+
+            if (keyword == "ply" || keyword == "comment" || keyword == "obj_info" || keyword.empty())
+                continue;
+
+            if (keyword == "format") {
+                std::string format;
+                words >> format;
+                if (format != "binary_little_endian")
+                    return Fail(fmt::format("PLY format {} is not supported, only binary_little_endian", format));
+            }
+            else if (keyword == "element") {
+                std::string name;
+                uint64_t count = 0;
+                words >> name >> count;
+                if (!seenElement && name != "vertex")
+                    return Fail("the vertex element must come first");
+                inVertex = !seenElement;
+                seenElement = true;
+                if (inVertex)
+                    m_Remaining = count;
+            }
+            else if (keyword == "property" && inVertex) {
+                std::string typeName, name;
+                words >> typeName >> name;
+
+                PlyType type;
+                size_t size;
+                if (typeName == "list" || !ParsePlyType(typeName, type, size))
+                    return Fail(fmt::format("vertex property type {} is not supported", typeName));
+
+                PlyProperty property{ m_Stride, type, true };
+                if (name == "x" || name == "y" || name == "z")
+                    m_Position[name[0] - 'x'] = property;
+                else if (name == "red" || name == "r" || name == "diffuse_red")
+                    m_Color[0] = property;
+                else if (name == "green" || name == "g" || name == "diffuse_green")
+                    m_Color[1] = property;
+                else if (name == "blue" || name == "b" || name == "diffuse_blue")
+                    m_Color[2] = property;
+                m_Stride += size;
+            }
+            else if (keyword == "end_header") {
+                if (!m_Position[0].present || !m_Position[1].present || !m_Position[2].present)
+                    return Fail("vertices have no x, y and z");
+
+                m_BytesRead = (uint64_t)m_File.tellg();
+                return true;
+            }
+        }
+
+        return Fail("the PLY header has no end_header");
+    }
+
+    size_t PointReader::Read(size_t max, std::vector<glm::vec3>& positions, std::vector<uint32_t>& colors) {
+        if (m_Failed)
+            return 0;
+        return m_Ply ? ReadPly(max, positions, colors) : ReadXyz(max, positions, colors);
+    }
+
+    size_t PointReader::ReadPly(size_t max, std::vector<glm::vec3>& positions, std::vector<uint32_t>& colors) {
+        size_t count = (size_t)std::min<uint64_t>(max, m_Remaining);
+        if (count == 0)
+            return 0;
+
+        m_Bytes.resize(count * m_Stride);
+        m_File.read(m_Bytes.data(), (std::streamsize)m_Bytes.size());
+        if ((size_t)m_File.gcount() != m_Bytes.size()) {
+            Fail("the file ends before its last vertex");
+            return 0;
+        }
+        m_Remaining -= count;
+        m_BytesRead += m_Bytes.size();
+
+        // Float colors are 0-1, integer ones 0-255
+        auto color = [&](const char* vertex, int channel) {
+            const PlyProperty& property = m_Color[channel];
+            if (!property.present)
+                return 255.f;
+            float value = (float)ReadPlyValue(vertex + property.offset, property.type);
+            return property.type == PlyType::Float32 || property.type == PlyType::Float64 ? value * 255.f : value;
+        };
+
+        for (size_t i = 0; i < count; i++) {
+            const char* vertex = m_Bytes.data() + i * m_Stride;
+            positions.push_back(glm::vec3(ReadPlyValue(vertex + m_Position[0].offset, m_Position[0].type),
+                ReadPlyValue(vertex + m_Position[1].offset, m_Position[1].type), ReadPlyValue(vertex + m_Position[2].offset, m_Position[2].type)));
+            colors.push_back(PackColor(glm::vec3(color(vertex, 0), color(vertex, 1), color(vertex, 2))));
+        }
+        return count;
+    }
+
+    // Whitespace or commas separate the numbers, lines starting with # are comments
+    size_t PointReader::ReadXyz(size_t max, std::vector<glm::vec3>& positions, std::vector<uint32_t>& colors) {
+        size_t count = 0;
+        while (count < max) {
+            size_t end = m_Text.find('\n', m_TextStart);
+            if (end == std::string::npos) {
+                if (m_File.eof()) {
+                    if (m_TextStart == m_Text.size())
+                        break;
+                    end = m_Text.size();
+                }
+                else {
+                    m_Text.erase(0, m_TextStart);
+                    m_TextStart = 0;
+                    size_t kept = m_Text.size();
+                    m_Text.resize(kept + TextChunk);
+                    m_File.read(m_Text.data() + kept, TextChunk);
+                    m_Text.resize(kept + (size_t)m_File.gcount());
+                    m_BytesRead += (uint64_t)m_File.gcount();
+                    continue;
+                }
+            }
+
+            const char* c = m_Text.data() + m_TextStart;
+            const char* lineEnd = m_Text.data() + end;
+            m_TextStart = std::min(end + 1, m_Text.size());
+
+            float values[6];
+            int parsed = 0;
+            while (parsed < 6) {
+                while (c < lineEnd && (*c == ' ' || *c == '\t' || *c == ',' || *c == '\r'))
+                    c++;
+                if (c == lineEnd || *c == '#')
+                    break;
+
+                auto [next, error] = std::from_chars(c, lineEnd, values[parsed]);
+                if (error != std::errc())
+                    break;
+                c = next;
+                parsed++;
+            }
+
+            if (parsed < 3)
+                continue;
+
+            positions.push_back(glm::vec3(values[0], values[1], values[2]));
+            colors.push_back(PackColor(parsed >= 6 ? glm::vec3(values[3], values[4], values[5]) : glm::vec3(255.f)));
+            count++;
+        }
+        return count;
+    }
+}
+
+// Runs are sorted and deduplicated in memory, spilled when the buffer is full and merged with one
+// cursor per run. Ties between runs go to the earlier run first, so the last point in file order is
+// the one SortedBuilder keeps.
+PointCloudImportStats SparseVoxelOctree::Import(const std::filesystem::path& path, const PointCloudImportSettings& settings) {
+    PointCloudImportStats stats;
+    Clear();
+
+    PointReader reader;
+    if (!reader.Open(path))
+        return stats;
+
+    size_t runPoints = std::max(settings.memoryBytes / BytesPerPoint, BlockPoints);
+    std::filesystem::path directory = settings.tempDirectory.empty() ? std::filesystem::temp_directory_path() : settings.tempDirectory;
+    std::string prefix = fmt::format("svo-import-{:x}", (uint64_t)Clock::now().time_since_epoch().count());
+
+    std::vector<std::filesystem::path> runs;
+    auto removeRuns = [&]() {
+        std::error_code error;
+        for (const std::filesystem::path& run : runs)
+            std::filesystem::remove(run, error);
+    };
+
+    PointCloudImportProgress progress;
+    progress.phase = "sort";
+    progress.totalBytes = reader.GetTotalBytes();
+    auto report = [&]() {
+        if (settings.progress)
+            settings.progress(progress);
+    };
+
+    std::vector<uint64_t> codes;
+    std::vector<uint32_t> colors, order;
+
+    // Sorts the buffered points by code and keeps the last of each repeated one
+    auto sortBuffered = [&]() {
+        order.resize(codes.size());
+        std::iota(order.begin(), order.end(), 0u);
+        morton::RadixSort(codes, order, 3 * m_MaxDepth);
+
+        size_t count = 0;
+        for (size_t i = 0; i < codes.size(); i++) {
+            if (i + 1 < codes.size() && codes[i + 1] == codes[i])
+                continue;
+            uint32_t color = colors[order[i]];
+            codes[count] = codes[i];
+            order[count] = color;
+            count++;
+        }
+        codes.resize(count);
+        order.resize(count);
+        colors.swap(order);
+    };
+
+    auto spill = [&]() {
+        sortBuffered();
+
+        std::filesystem::path run = directory / fmt::format("{}-{}.run", prefix, runs.size());
+        std::ofstream file(run, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            fmt::println("Cannot import {}: failed to create {}", path.string(), run.string());
+            return false;
+        }
+        runs.push_back(run);
+
+        std::vector<RunRecord> records;
+        for (size_t start = 0; start < codes.size(); start += BlockPoints) {
+            records.clear();
+            for (size_t i = start; i < std::min(codes.size(), start + BlockPoints); i++)
+                records.push_back({ (uint32_t)codes[i], (uint32_t)(codes[i] >> 32), colors[i] });
+            file.write(reinterpret_cast<const char*>(records.data()), (std::streamsize)(records.size() * sizeof(RunRecord)));
+        }
+        if (!file) {
+            fmt::println("Cannot import {}: failed to write {}", path.string(), run.string());
+            return false;
+        }
+
+        stats.spilledBytes += codes.size() * sizeof(RunRecord);
+        codes.clear();
+        colors.clear();
+        progress.runs = (uint32_t)runs.size();
+        report();
+        return true;
+    };
+
+    Clock::time_point start = Clock::now();
+    std::vector<glm::vec3> blockPositions;
+    std::vector<uint32_t> blockColors;
+    while (size_t count = reader.Read(BlockPoints, blockPositions, blockColors)) {
+        for (size_t i = 0; i < count; i++) {
+            glm::uvec3 cell;
+            if (Quantize(glm::vec3(settings.transform * glm::vec4(blockPositions[i], 1.f)), cell)) {
+                codes.push_back(morton::Encode(cell));
+                colors.push_back(blockColors[i]);
+            }
+            else
+                stats.outside++;
+        }
+        stats.points += count;
+        blockPositions.clear();
+        blockColors.clear();
+
+        if (codes.size() >= runPoints && !spill()) {
+            removeRuns();
+            return stats;
+        }
+
+        progress.bytesRead = reader.GetBytesRead();
+        progress.points = stats.points;
+        report();
+    }
+
+    // A cloud that fits in memory is never spilled
+    if (reader.Failed() || (!runs.empty() && !codes.empty() && !spill())) {
+        removeRuns();
+        return stats;
+    }
+    if (runs.empty())
+        sortBuffered();
+    stats.sortSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    progress.phase = "merge";
+    progress.points = 0;
+
+    SortedBuilder builder(*this);
+    uint64_t previous = UINT64_MAX;
+    auto add = [&](uint64_t code, uint32_t color) {
+        stats.voxels += code != previous;
+        previous = code;
+        builder.Add(code, UnpackColor(color));
+        if (++progress.points % (BlockPoints * 16) == 0)
+            report();
+    };
+
+    if (runs.empty()) {
+        for (size_t i = 0; i < codes.size(); i++)
+            add(codes[i], colors[i]);
+    }
+    else {
+        // The sort buffers are free now, the budget goes to the runs' read buffers
+        codes = {};
+        colors = {};
+        order = {};
+
+        struct RunCursor {
+            std::ifstream file;
+            std::vector<RunRecord> records;
+            size_t next = 0;
+        };
+        size_t bufferRecords = std::max<size_t>(settings.memoryBytes / sizeof(RunRecord) / runs.size(), 4096);
+        std::vector<RunCursor> cursors(runs.size());
+
+        auto refill = [&](RunCursor& cursor) {
+            cursor.records.resize(bufferRecords);
+            cursor.file.read(reinterpret_cast<char*>(cursor.records.data()), (std::streamsize)(bufferRecords * sizeof(RunRecord)));
+            cursor.records.resize((size_t)cursor.file.gcount() / sizeof(RunRecord));
+            cursor.next = 0;
+            return !cursor.records.empty();
+        };
+
+        // Smallest code first, then the earliest run
+        using Head = std::pair<uint64_t, uint32_t>;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        for (uint32_t r = 0; r < runs.size(); r++) {
+            cursors[r].file.open(runs[r], std::ios::binary);
+            if (refill(cursors[r]))
+                heads.push({ cursors[r].records[0].Code(), r });
+        }
+
+        while (!heads.empty()) {
+            auto [code, r] = heads.top();
+            heads.pop();
+
+            RunCursor& cursor = cursors[r];
+            add(code, cursor.records[cursor.next].color);
+            if (++cursor.next == cursor.records.size() && !refill(cursor))
+                continue;
+            heads.push({ cursor.records[cursor.next].Code(), r });
+        }
+
+        for (RunCursor& cursor : cursors)
+            cursor.file.close();
+    }
+
+    builder.Finish();
+    removeRuns();
+
+    stats.mergeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stats.runs = (uint32_t)runs.size();
+    stats.ok = true;
+    report();
+    return stats;
+}
\ No newline at end of file
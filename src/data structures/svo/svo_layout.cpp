@@ -0,0 +1,225 @@
+#include "svo.h"
+
+#include <bit>
+
+namespace {
+    // Slots of one 4 KiB page of compact descriptors, wide ones take two
+    constexpr uint32_t PageSlots = 1024;
+}
+
+bool SparseVoxelOctree::CreateBuffer(BufferLayout layout) {
+    if (layout == BufferLayout::DepthFirst || m_Compressed || m_Root == InvalidNode) {
+        CreateBuffer();
+        return true;
+    }
+
+    std::vector<NodeIndex> order;
+    order.reserve(m_Nodes.Size());
+
+    if (layout == BufferLayout::BreadthFirst) {
+        order.push_back(m_Root);
+        for (size_t i = 0; i < order.size(); i++) {
+            for (NodeIndex child : m_Nodes[order[i]].children) {
+                if (child != InvalidNode && !m_Nodes[child].IsLeaf)
+                    order.push_back(child);
+            }
+        }
+    }
+    else {
+        // Slots of every interior node's subtree, its own block included
+        std::vector<uint32_t> slots(m_Nodes.Size());
+        auto measure = [&](auto& self, NodeIndex node) -> uint32_t {
+            uint32_t total = CountChildren(node);
+            for (NodeIndex child : m_Nodes[node].children) {
+                if (child != InvalidNode && !m_Nodes[child].IsLeaf)
+                    total += self(self, child);
+            }
+            return slots[node] = total;
+        };
+        measure(measure, m_Root);
+
+        // A subtree that fits a page is written whole, breadth-first, starting a new page if it would
+        // straddle one. The cursor mirrors the one CreateBuffer(blockOrder) places blocks with.
+        uint32_t cursor = 1;
+        auto page = [&](NodeIndex root) {
+            if (!order.empty() && cursor % PageSlots + slots[root] > PageSlots) {
+                order.push_back(InvalidNode);
+                cursor = (cursor + PageSlots - 1) / PageSlots * PageSlots;
+            }
+
+            size_t first = order.size();
+            order.push_back(root);
+            for (size_t i = first; i < order.size(); i++) {
+                cursor += CountChildren(order[i]);
+                for (NodeIndex child : m_Nodes[order[i]].children) {
+                    if (child != InvalidNode && !m_Nodes[child].IsLeaf)
+                        order.push_back(child);
+                }
+            }
+        };
+
+        auto below = [&](auto& self, NodeIndex node, int depth, std::vector<NodeIndex>& nodes) -> void {
+            if (depth == 0) {
+                nodes.push_back(node);
+                return;
+            }
+            for (NodeIndex child : m_Nodes[node].children) {
+                if (child != InvalidNode && !m_Nodes[child].IsLeaf)
+                    self(self, child, depth - 1, nodes);
+            }
+        };
+
+        // Van Emde Boas order: the top half of the levels first, then every subtree hanging below it,
+        // each laid out the same way. whole is set when the levels reach the leaves, so the subtree's
+        // size is known and it can go to a page of its own.
+        auto veb = [&](auto& self, NodeIndex root, int levels, bool whole) -> void {
+            if (whole && slots[root] <= PageSlots) {
+                page(root);
+                return;
+            }
+            if (levels == 1) {
+                order.push_back(root);
+                cursor += CountChildren(root);
+                return;
+            }
+
+            int top = levels / 2;
+            self(self, root, top, false);
+            std::vector<NodeIndex> bottoms;
+            below(below, root, top, bottoms);
+            for (NodeIndex bottom : bottoms)
+                self(self, bottom, levels - top, whole);
+        };
+        veb(veb, m_Root, m_MaxDepth, true);
+    }
+
+    if (CreateBuffer(order))
+        return true;
+
+    // Wide descriptors need no far pointers, so the layout survives
+    fmt::println("SVO layout needs more than {} far pointers, writing it with wide descriptors", FarIndexMax);
+    DescriptorFormat format = m_Format;
+    m_Format = DescriptorFormat::Wide;
+    CreateBuffer(order);
+    m_Format = format;
+    return false;
+}
+
+// Places the blocks of interior nodes in the given order, which must start at the root and list every
+// parent before its children. An InvalidNode entry moves the next block to the start of a page.
+bool SparseVoxelOctree::CreateBuffer(std::span<const NodeIndex> blockOrder) {
+    if (m_AttributesDirty)
+        FilterAttributes();
+
+    m_Buffer.clear();
+    m_Far.clear();
+    m_Bricks.clear();
+    m_VoxelCount = 0;
+    m_BufferBrickLevels = 0;
+    m_BufferFormat = m_Format;
+    m_BufferAttributeFormat = m_AttributeFormat;
+    m_Editable = false;
+    m_EditedCells.clear();
+    CreateDistanceField();
+
+    std::vector<uint32_t> blockStart(m_Nodes.Size());
+    uint32_t cursor = 1;
+    for (NodeIndex node : blockOrder) {
+        if (node == InvalidNode) {
+            cursor = (cursor + PageSlots - 1) / PageSlots * PageSlots;
+            continue;
+        }
+        blockStart[node] = cursor;
+        cursor += CountChildren(node);
+    }
+
+    m_Buffer.assign((size_t)cursor * SlotWords(m_Format), 0);
+    m_Attributes.assign(cursor, 0);
+
+    std::vector<uint16_t> normals;
+    if (m_BufferAttributeFormat == AttributeFormat::ColorNormal)
+        normals = EstimateNormals();
+
+    EncodeTarget target;
+    target.buffer = m_Buffer.data();
+    target.attributes = m_Attributes.data();
+    target.wide = m_Format == DescriptorFormat::Wide;
+    target.normals = normals.empty() ? nullptr : normals.data();
+    auto encode = [&](NodeIndex node, uint32_t slot) {
+        target.farCount = (uint32_t)m_Far.size();
+        uint32_t desc = CreateDescriptor(node, slot, blockStart[node], target);
+        if (desc & (1 << 16))
+            m_Far.push_back(blockStart[node] - slot);
+
+        target.Write(slot, desc, blockStart[node]);
+    };
+
+    encode(blockOrder[0], 0);
+    for (NodeIndex node : blockOrder) {
+        if (node == InvalidNode)
+            continue;
+
+        uint32_t slot = blockStart[node];
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child != InvalidNode && !m_Nodes[child].IsLeaf)
+                encode(child, slot++);
+        }
+
+        if (m_Far.size() > FarIndexMax)
+            return false;
+    }
+
+    m_VoxelCount = target.voxelCount;
+    return true;
+}
+
+// Every descriptor in the buffer is counted once. A DAG buffer's shared blocks are reached from many
+// descriptors, and the later ones point back at them through offsets that wrap around, so offsets are
+// read as signed and a block's descriptors are only walked the first time it is reached.
+BufferLayoutStats SparseVoxelOctree::GetLayoutStats() const {
+    BufferLayoutStats stats;
+    if (m_Buffer.empty())
+        return stats;
+
+    uint64_t distance = 0, sameLine = 0, samePage = 0, linked = 0;
+    uint32_t slotWords = SlotWords(m_BufferFormat);
+    std::vector<bool> reached(m_Buffer.size() / slotWords);
+
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty()) {
+        uint32_t slot = stack.back();
+        stack.pop_back();
+
+        uint32_t desc = m_Buffer[(size_t)slot * slotWords];
+        stats.descriptors++;
+
+        uint32_t interior = (desc & 0xFF) & ~((desc >> 8) & 0xFF);
+        if (interior == 0)
+            continue;
+
+        bool far = slotWords == 1 && (desc & (1 << 16));
+        uint32_t offset = slotWords == 2 ? m_Buffer[(size_t)slot * 2 + 1] - slot : far ? m_Far[desc >> 17] : desc >> 17;
+        uint32_t block = slot + offset;
+
+        stats.farPointers += far;
+        stats.backReferences += block < slot;
+        distance += (uint64_t)std::abs((int64_t)(int32_t)offset) * slotWords;
+        sameLine += ((size_t)slot * slotWords * sizeof(uint32_t)) / 64 == ((size_t)block * slotWords * sizeof(uint32_t)) / 64;
+        samePage += ((size_t)slot * slotWords * sizeof(uint32_t)) / 4096 == ((size_t)block * slotWords * sizeof(uint32_t)) / 4096;
+        linked++;
+
+        if (reached[block])
+            continue;
+        reached[block] = true;
+        for (int i = 0; i < std::popcount(interior); i++)
+            stack.push_back(block + i);
+    }
+
+    if (linked > 0) {
+        stats.averageDistance = (double)distance / linked;
+        stats.sameCacheLine = (double)sameLine / linked;
+        stats.samePage = (double)samePage / linked;
+    }
+
+    return stats;
+}
@@ -0,0 +1,117 @@
+#include "svo.h"
+
+#include <parallel.h>
+#include <bit>
+
+namespace {
+    int ChildIndex(glm::uvec3 cell, int shift) {
+        return ((cell.x >> shift) & 1) | (((cell.y >> shift) & 1) << 1) | (((cell.z >> shift) & 1) << 2);
+    }
+
+    // A subtree whose normals are estimated on one thread, with the path from the root down to it
+    struct NormalTask {
+        NodeIndex path[morton::MaxBitsPerAxis + 1];
+        glm::uvec3 cell;
+        int depth;
+        glm::vec3 sum{ 0.f };
+    };
+}
+
+// A leaf's normal points away from the occupied cells among its 26 neighbours, weighted by how close
+// they are. A neighbour is looked up from the deepest ancestor it shares with the leaf, which is the
+// parent for most of them.
+std::vector<uint16_t> SparseVoxelOctree::EstimateNormals() const {
+    std::vector<uint16_t> normals(m_Nodes.Size(), (uint16_t)PackNormal(glm::vec3(0.f)));
+    if (m_Root == InvalidNode)
+        return normals;
+
+    int cells = 1 << m_MaxDepth;
+    auto occupied = [&](const NodeIndex* path, glm::uvec3 cell, glm::ivec3 offset) {
+        glm::ivec3 q = glm::ivec3(cell) + offset;
+        if (q.x < 0 || q.y < 0 || q.z < 0 || q.x >= cells || q.y >= cells || q.z >= cells)
+            return false;
+
+        glm::uvec3 diff = cell ^ glm::uvec3(q);
+        int shared = std::bit_width(diff.x | diff.y | diff.z);
+        NodeIndex node = path[m_MaxDepth - shared];
+        for (int shift = shared - 1; shift >= 0 && node != InvalidNode; shift--)
+            node = m_Nodes[node].children[ChildIndex(glm::uvec3(q), shift)];
+        return node != InvalidNode;
+    };
+
+    // Returns the sum of the unit normals of the leaves below, which the node's normal points along
+    auto visit = [&](auto& self, NodeIndex* path, glm::uvec3 cell, int depth) -> glm::vec3 {
+        NodeIndex node = path[depth];
+        glm::vec3 sum(0.f);
+        if (depth == m_MaxDepth) {
+            for (int z = -1; z <= 1; z++) {
+                for (int y = -1; y <= 1; y++) {
+                    for (int x = -1; x <= 1; x++) {
+                        glm::ivec3 offset(x, y, z);
+                        if (offset != glm::ivec3(0) && occupied(path, cell, offset))
+                            sum -= glm::vec3(offset) / glm::dot(glm::vec3(offset), glm::vec3(offset));
+                    }
+                }
+            }
+            // Buried or symmetric voxels have no side to face
+            sum = glm::dot(sum, sum) > 1e-6f ? glm::normalize(sum) : glm::vec3(0.f);
+        }
+        else {
+            for (int i = 0; i < 8; i++) {
+                if (NodeIndex child = m_Nodes[node].children[i]; child != InvalidNode) {
+                    path[depth + 1] = child;
+                    sum += self(self, path, cell * 2u + glm::uvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1), depth + 1);
+                }
+            }
+        }
+
+        normals[node] = (uint16_t)PackNormal(sum);
+        return sum;
+    };
+
+    // Enough subtrees to keep every thread busy, each with its own copy of the path above it
+    int splitDepth = 0;
+    std::vector<NormalTask> tasks(1), next;
+    tasks[0].path[0] = m_Root;
+    tasks[0].cell = glm::uvec3(0);
+    tasks[0].depth = 0;
+    while (splitDepth < m_MaxDepth && tasks.size() < 8 * parallel::ThreadCount()) {
+        next.clear();
+        for (const NormalTask& task : tasks) {
+            for (int i = 0; i < 8; i++) {
+                NodeIndex child = m_Nodes[task.path[task.depth]].children[i];
+                if (child == InvalidNode)
+                    continue;
+
+                NormalTask& n = next.emplace_back(task);
+                n.path[task.depth + 1] = child;
+                n.cell = task.cell * 2u + glm::uvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+                n.depth = task.depth + 1;
+            }
+        }
+        tasks.swap(next);
+        splitDepth++;
+    }
+
+    parallel::For(tasks.size(), [&](size_t i) {
+        tasks[i].sum = visit(visit, tasks[i].path, tasks[i].cell, tasks[i].depth);
+    });
+
+    // The nodes above the split, whose subtrees come up in the same preorder the tasks were listed in
+    size_t task = 0;
+    auto top = [&](auto& self, NodeIndex node, int depth) -> glm::vec3 {
+        if (depth == splitDepth)
+            return tasks[task++].sum;
+
+        glm::vec3 sum(0.f);
+        for (NodeIndex child : m_Nodes[node].children) {
+            if (child != InvalidNode)
+                sum += self(self, child, depth + 1);
+        }
+        normals[node] = (uint16_t)PackNormal(sum);
+        return sum;
+    };
+    top(top, m_Root, 0);
+
+    return normals;
+}
\ No newline at end of file
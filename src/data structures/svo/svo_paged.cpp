@@ -0,0 +1,472 @@
+#include "svo_paged.h"
+#include "svo_file.h"
+#include "svo.h"
+
+#include <parallel.h>
+#include <fstream>
+
+namespace {
+    // Compact descriptor fields, see SparseVoxelOctree::CreateDescriptor
+    constexpr uint32_t FarBit = 1u << 16;
+    constexpr uint32_t OffsetShift = 17;
+    constexpr uint32_t FarIndexMax = 1u << (32 - OffsetShift);
+}
+
+bool SparseVoxelOctree::SavePaged(const std::filesystem::path& path, int pageDepth) const {
+    if (m_MaxDepth < 2) {
+        fmt::println("A paged SVO needs at least two levels, this one has {}", m_MaxDepth);
+        return false;
+    }
+    pageDepth = std::clamp(pageDepth, 1, m_MaxDepth - 1);
+
+    // Depth-first in child order visits the page roots in ascending Morton order
+    std::vector<std::pair<uint64_t, NodeIndex>> roots;
+    auto collect = [&](auto& self, NodeIndex node, int depth, uint64_t code) -> void {
+        if (depth == pageDepth) {
+            roots.push_back({ code, node });
+            return;
+        }
+
+        for (int i = 0; i < 8; i++) {
+            if (NodeIndex child = m_Nodes[node].children[i]; child != InvalidNode)
+                self(self, child, depth + 1, (code << 3) | i);
+        }
+    };
+    if (m_Root != InvalidNode)
+        collect(collect, m_Root, 0, 0);
+
+    // The top tree stops at pageDepth, its leaves are the page roots
+    SparseVoxelOctree top(m_Size, pageDepth);
+    SortedBuilder builder(top);
+    for (auto [code, node] : roots)
+        builder.Add(code, m_Nodes[node].data.color, m_Nodes[node].data.coverage);
+    builder.Finish();
+    top.CreateBuffer();
+    // Pages are always compact, and so is the top tree they are spliced into
+    if (top.GetBufferFormat() != DescriptorFormat::Compact) {
+        fmt::println("Cannot save {}, the top tree needs more than {} far pointers", path.string(), FarIndexMax);
+        return false;
+    }
+
+    PagedSvoFileHeader header{};
+    header.magic = PagedSvoFileHeader::Magic;
+    header.version = PagedSvoFileHeader::CurrentVersion;
+    header.size = m_Size;
+    header.maxDepth = m_MaxDepth;
+    header.pageDepth = pageDepth;
+    header.pageCount = (uint32_t)roots.size();
+    header.topOffset = SvoFileHeader::Alignment;
+    header.topWords = top.m_Buffer.size();
+    header.topFarOffset = SvoFileHeader::AlignUp(header.topOffset + top.m_Buffer.size() * sizeof(uint32_t));
+    header.topFarWords = top.m_Far.size();
+    header.topAttributeOffset = SvoFileHeader::AlignUp(header.topFarOffset + top.m_Far.size() * sizeof(uint32_t));
+    header.pageTableOffset = SvoFileHeader::AlignUp(header.topAttributeOffset + top.m_Attributes.size() * sizeof(uint32_t));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        fmt::println("Failed to open {} for writing", path.string());
+        return false;
+    }
+
+    // Also skips over the page table, which is written last
+    auto padTo = [&](uint64_t offset) {
+        static const char zeros[SvoFileHeader::Alignment] = {};
+        for (uint64_t at = (uint64_t)file.tellp(); at < offset; at = (uint64_t)file.tellp())
+            file.write(zeros, (std::streamsize)std::min<uint64_t>(offset - at, sizeof(zeros)));
+    };
+    auto writeWords = [&](const std::vector<uint32_t>& words) {
+        file.write(reinterpret_cast<const char*>(words.data()), (std::streamsize)(words.size() * sizeof(uint32_t)));
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    padTo(header.topOffset);
+    writeWords(top.m_Buffer);
+    padTo(header.topFarOffset);
+    writeWords(top.m_Far);
+    padTo(header.topAttributeOffset);
+    writeWords(top.m_Attributes);
+    padTo(SvoFileHeader::AlignUp(header.pageTableOffset + roots.size() * sizeof(PagedSvoPageEntry)));
+
+    // Pages are encoded a batch at a time in parallel, so only one batch is ever held in memory
+    std::vector<PagedSvoPageEntry> entries(roots.size());
+    size_t batchSize = 8 * parallel::ThreadCount();
+    std::vector<std::vector<uint32_t>> buffers(batchSize), fars(batchSize), attributes(batchSize);
+
+    for (size_t first = 0; first < roots.size(); first += batchSize) {
+        size_t count = std::min(batchSize, roots.size() - first);
+        parallel::For(count, [&](size_t i) {
+            entries[first + i].voxelCount = EncodeSubtree(roots[first + i].second, buffers[i], fars[i], attributes[i]);
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            if (fars[i].size() > FarIndexMax) {
+                fmt::println("Cannot save {}, a page needs more than {} far pointers; use a deeper page depth", path.string(), FarIndexMax);
+                return false;
+            }
+
+            PagedSvoPageEntry& entry = entries[first + i];
+            entry.code = roots[first + i].first;
+            entry.offset = SvoFileHeader::AlignUp((uint64_t)file.tellp());
+            entry.bufferWords = (uint32_t)buffers[i].size();
+            entry.farWords = (uint32_t)fars[i].size();
+            header.voxelCount += entry.voxelCount;
+
+            padTo(entry.offset);
+            writeWords(buffers[i]);
+            writeWords(fars[i]);
+            writeWords(attributes[i]);
+        }
+    }
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.seekp((std::streamoff)header.pageTableOffset);
+    file.write(reinterpret_cast<const char*>(entries.data()), (std::streamsize)(entries.size() * sizeof(PagedSvoPageEntry)));
+
+    if (!file) {
+        fmt::println("Failed to write {}", path.string());
+        return false;
+    }
+
+    return true;
+}
+
+std::unique_ptr<PagedSvo> PagedSvo::Open(const std::filesystem::path& path, size_t budgetBytes, unsigned ioThreads) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fmt::println("Failed to open paged SVO file {}", path.string());
+        return nullptr;
+    }
+
+    std::unique_ptr<PagedSvo> svo(new PagedSvo());
+    PagedSvoFileHeader& header = svo->m_Header;
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != PagedSvoFileHeader::Magic) {
+        fmt::println("{} is not a paged SVO file", path.string());
+        return nullptr;
+    }
+
+    if (header.version != PagedSvoFileHeader::CurrentVersion) {
+        fmt::println("{} has paged SVO format version {}, expected {}", path.string(), header.version, PagedSvoFileHeader::CurrentVersion);
+        return nullptr;
+    }
+
+    // Everything the header sizes is checked against the file before anything is allocated for it
+    std::error_code error;
+    uint64_t fileBytes = std::filesystem::file_size(path, error);
+    auto fits = [&](uint64_t offset, uint64_t count, uint64_t elementBytes) {
+        return !error && offset <= fileBytes && count <= (fileBytes - offset) / elementBytes;
+    };
+    if (header.size <= 0 || header.maxDepth < 2 || header.maxDepth > morton::MaxBitsPerAxis ||
+        header.pageDepth < 1 || header.pageDepth >= header.maxDepth || header.pageCount > 1ull << (3 * header.pageDepth) ||
+        !fits(header.topOffset, header.topWords, sizeof(uint32_t)) || !fits(header.topFarOffset, header.topFarWords, sizeof(uint32_t)) ||
+        !fits(header.topAttributeOffset, header.topWords, sizeof(uint32_t)) ||
+        !fits(header.pageTableOffset, header.pageCount, sizeof(PagedSvoPageEntry))) {
+        fmt::println("{} is truncated or corrupt", path.string());
+        return nullptr;
+    }
+
+    auto readWords = [&](uint64_t offset, uint64_t count, auto& out) {
+        out.resize(count);
+        file.seekg((std::streamoff)offset);
+        return bool(file.read(reinterpret_cast<char*>(out.data()), (std::streamsize)(count * sizeof(out[0]))));
+    };
+
+    // The top tree and the page table are small and always resident
+    if (!readWords(header.topOffset, header.topWords, svo->m_Top) || !readWords(header.topFarOffset, header.topFarWords, svo->m_TopFar) ||
+        !readWords(header.topAttributeOffset, header.topWords, svo->m_TopAttributes) ||
+        !readWords(header.pageTableOffset, header.pageCount, svo->m_Entries)) {
+        fmt::println("{} is truncated or corrupt", path.string());
+        return nullptr;
+    }
+
+    // FindPage binary searches the codes, and the workers read every page whole
+    uint64_t codeEnd = 1ull << (3 * header.pageDepth);
+    for (uint32_t page = 0; page < header.pageCount; page++) {
+        const PagedSvoPageEntry& entry = svo->m_Entries[page];
+        if (entry.code >= codeEnd || (page > 0 && entry.code <= svo->m_Entries[page - 1].code) ||
+            !fits(entry.offset, 2 * (uint64_t)entry.bufferWords + entry.farWords, sizeof(uint32_t))) {
+            fmt::println("{} has a corrupt page table entry for page {}", path.string(), page);
+            return nullptr;
+        }
+    }
+
+    if (!svo->FindRootSlots()) {
+        fmt::println("{} has a top tree that does not match its page table", path.string());
+        return nullptr;
+    }
+
+    float pageSize = (float)header.size / (float)(1u << header.pageDepth);
+    svo->m_Centers.reserve(header.pageCount);
+    for (const PagedSvoPageEntry& entry : svo->m_Entries) {
+        glm::vec3 cell = glm::vec3(morton::Decode(entry.code));
+        svo->m_Centers.push_back(glm::vec3(-header.size / 2.f) + (cell + glm::vec3(0.5f)) * pageSize);
+    }
+
+    svo->m_Pages.resize(header.pageCount);
+    svo->m_Budget = budgetBytes;
+
+    for (unsigned i = 0; i < std::max(1u, ioThreads); i++)
+        svo->m_Workers.emplace_back(&PagedSvo::Worker, svo.get(), path);
+
+    return svo;
+}
+
+bool PagedSvo::FindRootSlots() {
+    m_RootSlots.assign(m_Entries.size(), UINT32_MAX);
+    if (m_Entries.empty())
+        return true;
+    if (m_Top.empty())
+        return false;
+
+    uint32_t found = 0;
+    auto visit = [&](auto& self, uint32_t slot, int depth, uint64_t code) -> bool {
+        uint32_t desc = m_Top[slot];
+        uint64_t block = slot;
+        if (desc & FarBit) {
+            if ((desc >> OffsetShift) >= m_TopFar.size())
+                return false;
+            block += m_TopFar[desc >> OffsetShift];
+        }
+        else
+            block += desc >> OffsetShift;
+
+        uint32_t rank = 0;
+        for (int i = 0; i < 8; i++) {
+            if ((desc & (1u << i)) == 0)
+                continue;
+
+            uint64_t child = block + rank++;
+            if (child >= m_Top.size())
+                return false;
+
+            uint64_t childCode = (code << 3) | i;
+            if (depth + 1 < m_Header.pageDepth) {
+                if (!self(self, (uint32_t)child, depth + 1, childCode))
+                    return false;
+                continue;
+            }
+
+            uint32_t page = FindPage(morton::Decode(childCode));
+            if (page == InvalidPage || m_RootSlots[page] != UINT32_MAX)
+                return false;
+            m_RootSlots[page] = (uint32_t)child;
+            found++;
+        }
+        return true;
+    };
+    return visit(visit, 0, 0, 0) && found == m_Entries.size();
+}
+
+uint32_t PagedSvo::Assemble(std::vector<uint32_t>& buffer, std::vector<uint32_t>& far, std::vector<uint32_t>& attributes) {
+    buffer = m_Top;
+    far = m_TopFar;
+    attributes = m_TopAttributes;
+
+    uint32_t spliced = 0;
+    auto splice = [&](uint32_t page) {
+        std::shared_ptr<const Page> data = GetPage(page);
+        if (!data || data->buffer.empty() || far.size() + data->far.size() + 1 > FarIndexMax)
+            return;
+        uint32_t root = data->buffer[0];
+        if ((root & FarBit) && (root >> OffsetShift) >= data->far.size())
+            return;
+
+        // Indices into the page's far array move by where it lands, block offsets are relative
+        uint32_t base = (uint32_t)buffer.size(), farBase = (uint32_t)far.size();
+        for (uint32_t desc : data->buffer)
+            buffer.push_back(desc & FarBit ? desc + (farBase << OffsetShift) : desc);
+        far.insert(far.end(), data->far.begin(), data->far.end());
+        attributes.insert(attributes.end(), data->attributes.begin(), data->attributes.end());
+
+        // The root's children stay where the page put them, relative to the page's slot 0
+        uint32_t firstBlock = base + (root & FarBit ? data->far[root >> OffsetShift] : root >> OffsetShift);
+        uint32_t slot = m_RootSlots[page];
+        buffer[slot] = (root & (FarBit - 1)) | FarBit | (uint32_t)far.size() << OffsetShift;
+        far.push_back(firstBlock - slot);
+        spliced++;
+    };
+
+    // The order of the last Update, nearest first
+    if (m_Prioritized) {
+        for (auto [distance, page] : m_Order)
+            splice(page);
+    }
+    else {
+        for (uint32_t page = 0; page < m_Entries.size(); page++)
+            splice(page);
+    }
+    return spliced;
+}
+
+SvoShaderConstants PagedSvo::GetShaderConstants() const {
+    SvoShaderConstants constants;
+    constants.leafDepth = m_Header.maxDepth;
+    constants.size = (float)m_Header.size;
+    return constants;
+}
+
+PagedSvo::~PagedSvo() {
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+
+    for (std::thread& worker : m_Workers)
+        worker.join();
+}
+
+size_t PagedSvo::PageBytes(uint32_t page) const {
+    return (2 * (size_t)m_Entries[page].bufferWords + m_Entries[page].farWords) * sizeof(uint32_t);
+}
+
+void PagedSvo::Update(glm::vec3 cameraPosition) {
+    float pageSize = (float)m_Header.size / (float)(1u << m_Header.pageDepth);
+    glm::vec3 moved = cameraPosition - m_LastCamera;
+    if (m_Prioritized && glm::dot(moved, moved) < pageSize * pageSize / 16)
+        return;
+
+    m_LastCamera = cameraPosition;
+    m_Prioritized = true;
+
+    // Sorting happens outside the lock, the page positions never change
+    m_Order.clear();
+    for (uint32_t page = 0; page < m_Entries.size(); page++) {
+        glm::vec3 d = m_Centers[page] - cameraPosition;
+        m_Order.push_back({ glm::dot(d, d), page });
+    }
+    std::sort(m_Order.begin(), m_Order.end());
+
+    std::unique_lock lock(m_Mutex);
+    m_Frame++;
+
+    // Queued pages are re-requested below if they are still wanted
+    for (uint32_t page : m_Queue) {
+        if (m_Pages[page].state == PageState::Queued) {
+            m_Pages[page].state = PageState::Unloaded;
+            m_PendingBytes -= PageBytes(page);
+        }
+    }
+    m_Queue.clear();
+
+    // The nearest pages that fit in the budget are wanted, nearest first
+    size_t wantedBytes = 0;
+    for (auto [distance, page] : m_Order) {
+        size_t bytes = PageBytes(page);
+        if (wantedBytes + bytes > m_Budget)
+            break;
+
+        wantedBytes += bytes;
+        PageSlot& slot = m_Pages[page];
+        slot.lastUsed = m_Frame;
+        if (slot.state == PageState::Unloaded) {
+            slot.state = PageState::Queued;
+            m_Queue.push_back(page);
+            m_PendingBytes += bytes;
+        }
+    }
+
+    // Make room for the queued reads by evicting the pages that went longest without being wanted
+    if (m_ResidentBytes + m_PendingBytes > m_Budget) {
+        std::vector<std::pair<uint64_t, uint32_t>> victims;
+        for (uint32_t page = 0; page < m_Pages.size(); page++) {
+            if (m_Pages[page].state == PageState::Resident && m_Pages[page].lastUsed < m_Frame)
+                victims.push_back({ m_Pages[page].lastUsed, page });
+        }
+        std::sort(victims.begin(), victims.end());
+
+        for (auto [lastUsed, page] : victims) {
+            if (m_ResidentBytes + m_PendingBytes <= m_Budget)
+                break;
+
+            m_Pages[page].data.reset();
+            m_Pages[page].state = PageState::Unloaded;
+            m_ResidentBytes -= PageBytes(page);
+            m_Stats.evictions++;
+        }
+    }
+
+    bool work = !m_Queue.empty();
+    lock.unlock();
+    if (work)
+        m_Wake.notify_all();
+}
+
+uint32_t PagedSvo::FindPage(glm::uvec3 cell) const {
+    uint64_t code = morton::Encode(cell);
+    auto it = std::lower_bound(m_Entries.begin(), m_Entries.end(), code, [](const PagedSvoPageEntry& entry, uint64_t c) { return entry.code < c; });
+    if (it == m_Entries.end() || it->code != code)
+        return InvalidPage;
+
+    return (uint32_t)(it - m_Entries.begin());
+}
+
+std::shared_ptr<const PagedSvo::Page> PagedSvo::GetPage(uint32_t page) {
+    std::lock_guard lock(m_Mutex);
+    m_Pages[page].lastUsed = m_Frame;
+    return m_Pages[page].data;
+}
+
+void PagedSvo::SetBudget(size_t budgetBytes) {
+    std::lock_guard lock(m_Mutex);
+    m_Budget = budgetBytes;
+    m_Prioritized = false;
+}
+
+PagedSvo::Stats PagedSvo::GetStats() {
+    std::lock_guard lock(m_Mutex);
+    Stats stats = m_Stats;
+    stats.residentBytes = m_ResidentBytes;
+    for (const PageSlot& slot : m_Pages) {
+        stats.residentPages += slot.state == PageState::Resident;
+        stats.queuedPages += slot.state == PageState::Queued || slot.state == PageState::Loading;
+    }
+    return stats;
+}
+
+void PagedSvo::Worker(std::filesystem::path path) {
+    std::ifstream file(path, std::ios::binary);
+
+    for (;;) {
+        uint32_t page;
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Wake.wait(lock, [&] { return m_Stop || !m_Queue.empty(); });
+            if (m_Stop)
+                return;
+
+            page = m_Queue.front();
+            m_Queue.pop_front();
+            m_Pages[page].state = PageState::Loading;
+        }
+
+        const PagedSvoPageEntry& entry = m_Entries[page];
+        auto data = std::make_shared<Page>();
+        data->buffer.resize(entry.bufferWords);
+        data->far.resize(entry.farWords);
+        data->attributes.resize(entry.bufferWords);
+
+        file.seekg((std::streamoff)entry.offset);
+        file.read(reinterpret_cast<char*>(data->buffer.data()), (std::streamsize)(entry.bufferWords * sizeof(uint32_t)));
+        file.read(reinterpret_cast<char*>(data->far.data()), (std::streamsize)(entry.farWords * sizeof(uint32_t)));
+        file.read(reinterpret_cast<char*>(data->attributes.data()), (std::streamsize)(entry.bufferWords * sizeof(uint32_t)));
+
+        bool ok = bool(file);
+        if (!ok) {
+            fmt::println("Failed to read SVO page {} from {}", page, path.string());
+            file.clear();
+        }
+
+        std::lock_guard lock(m_Mutex);
+        m_PendingBytes -= PageBytes(page);
+        if (ok) {
+            m_Pages[page].state = PageState::Resident;
+            m_Pages[page].data = std::move(data);
+            m_ResidentBytes += PageBytes(page);
+            m_Stats.loads++;
+        }
+        else
+            m_Pages[page].state = PageState::Failed;
+    }
+}
\ No newline at end of file
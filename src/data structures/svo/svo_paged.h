@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vk_types.h>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+
+// On-disk paged SVO: this header, the top tree's buffer, far and attribute arrays, the page table, then
+// every page's buffer, far and attribute arrays back to back. A page's attribute array has bufferWords
+// words. Arrays and pages start on SvoFileHeader::Alignment.
+struct PagedSvoFileHeader {
+    static constexpr uint32_t Magic = 0x504F5653;   // "SVOP"
+    static constexpr uint32_t CurrentVersion = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    int32_t size;
+    int32_t maxDepth;
+    int32_t pageDepth;
+    uint32_t pageCount;
+    uint64_t voxelCount;
+    uint64_t topOffset, topWords;
+    uint64_t topFarOffset, topFarWords;
+    uint64_t topAttributeOffset;
+    uint64_t pageTableOffset;
+};
+
+// Pages are sorted by code, the Morton code of their root cell at pageDepth
+struct PagedSvoPageEntry {
+    uint64_t code;
+    uint64_t offset;
+    uint32_t bufferWords, farWords;
+    uint32_t voxelCount;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PagedSvoFileHeader) == 80);
+static_assert(sizeof(PagedSvoPageEntry) == 32);
+
+struct SvoShaderConstants;
+
+// Out-of-core SVO. The top tree, whose leaves are the page roots, stays resident; pages are read on
+// background threads and kept under a memory budget, nearest to the camera first. A page that is not
+// resident yet is simply not returned, so the caller never waits on I/O.
+//
+// Assemble splices the resident pages into the top tree for the renderer: each page's arrays are
+// appended whole, its far pointers rebased, and its root descriptor written to the top tree's leaf slot
+// with a far pointer to the page's first block.
+class PagedSvo {
+public:
+    static constexpr uint32_t InvalidPage = UINT32_MAX;
+
+    struct Page {
+        std::vector<uint32_t> buffer, far, attributes;
+    };
+
+    struct Stats {
+        uint32_t residentPages = 0;
+        uint32_t queuedPages = 0;
+        size_t residentBytes = 0;
+        uint64_t loads = 0;
+        uint64_t evictions = 0;
+    };
+
+    static std::unique_ptr<PagedSvo> Open(const std::filesystem::path& path, size_t budgetBytes, unsigned ioThreads = 2);
+    ~PagedSvo();
+
+    PagedSvo(const PagedSvo&) = delete;
+    PagedSvo& operator=(const PagedSvo&) = delete;
+
+    // Reprioritizes loads around the camera and evicts the least recently used pages over budget, once
+    // the camera has moved a quarter of a page. Only takes the lock for bookkeeping, never waits for a
+    // read. Call from one thread at a time.
+    void Update(glm::vec3 cameraPosition);
+
+    // The page rooted at the given cell of the pageDepth grid, or InvalidPage if that cell is empty
+    uint32_t FindPage(glm::uvec3 cell) const;
+    // Null until the page has been loaded. The page stays valid while the caller holds it, even if it
+    // is evicted in the meantime.
+    std::shared_ptr<const Page> GetPage(uint32_t page);
+
+    // Takes effect on the next Update
+    void SetBudget(size_t budgetBytes);
+
+    // The top tree with the resident pages spliced in, nearest to the last Update first, as the buffer,
+    // far and attribute arrays of a compact RGBA8 tree with GetShaderConstants. Pages that are not
+    // resident, or that would need more far pointers than a compact descriptor
+    // indexes, are left empty.
+    // Returns how many pages were spliced in. Call from the thread that calls Update.
+    uint32_t Assemble(std::vector<uint32_t>& buffer, std::vector<uint32_t>& far, std::vector<uint32_t>& attributes);
+    SvoShaderConstants GetShaderConstants() const;
+
+    std::span<const uint32_t> GetTopBuffer() const { return m_Top; }
+    std::span<const uint32_t> GetTopFar() const { return m_TopFar; }
+    std::span<const uint32_t> GetTopAttributes() const { return m_TopAttributes; }
+    int GetSize() const { return m_Header.size; }
+    int GetMaxDepth() const { return m_Header.maxDepth; }
+    int GetPageDepth() const { return m_Header.pageDepth; }
+    uint32_t GetPageCount() const { return m_Header.pageCount; }
+    uint64_t GetVoxelCount() const { return m_Header.voxelCount; }
+    const PagedSvoPageEntry& GetPageEntry(uint32_t page) const { return m_Entries[page]; }
+    Stats GetStats();
+
+private:
+    enum class PageState : uint8_t {
+        Unloaded,
+        Queued,
+        Loading,
+        Resident,
+        Failed,     // the read failed, never retried
+    };
+
+    struct PageSlot {
+        PageState state = PageState::Unloaded;
+        uint64_t lastUsed = 0;
+        std::shared_ptr<const Page> data;
+    };
+
+    PagedSvo() = default;
+
+    void Worker(std::filesystem::path path);
+    size_t PageBytes(uint32_t page) const;
+    // Fills m_RootSlots from the top buffer, false if it does not reach every page exactly once
+    bool FindRootSlots();
+
+    PagedSvoFileHeader m_Header{};
+    std::vector<uint32_t> m_Top, m_TopFar, m_TopAttributes;
+    std::vector<PagedSvoPageEntry> m_Entries;
+    std::vector<glm::vec3> m_Centers;
+    // The top buffer slot every page's root descriptor goes to
+    std::vector<uint32_t> m_RootSlots;
+    std::vector<std::thread> m_Workers;
+    // Distance-sorted page order, reused between updates
+    std::vector<std::pair<float, uint32_t>> m_Order;
+    glm::vec3 m_LastCamera{ 0.f };
+    // Whether m_Order is up to date. SetBudget clears it, from any thread, to make the next Update
+    // re-request pages.
+    std::atomic<bool> m_Prioritized = false;
+
+    // Everything below is guarded by m_Mutex
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::vector<PageSlot> m_Pages;
+    std::deque<uint32_t> m_Queue;
+    size_t m_Budget = 0;
+    size_t m_ResidentBytes = 0, m_PendingBytes = 0;
+    uint64_t m_Frame = 0;
+    Stats m_Stats;
+    bool m_Stop = false;
+};
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "svo_query.h"
+#include "svo.h"
+
+#include <parallel.h>
+#include <bit>
+
+namespace {
+    // Both accessors walk interior nodes by handle; leaves are never dereferenced, a child at maxDepth
+    // only exists as a bit in its parent's mask
+    struct NodeAccess {
+        const ChunkedPool<Node>& nodes;
+        NodeIndex root;
+
+        bool Empty() const { return root == InvalidNode; }
+        uint32_t Root() const { return root; }
+
+        uint32_t Mask(uint32_t node) const {
+            uint32_t mask = 0;
+            for (int i = 0; i < 8; i++)
+                mask |= (uint32_t)(nodes[node].children[i] != InvalidNode) << i;
+            return mask;
+        }
+
+        uint32_t Child(uint32_t node, int i, uint32_t) const { return nodes[node].children[i]; }
+    };
+
+    // Follows offsets the way the shader does, so DAG back references wrap around
+    struct BufferAccess {
+        std::span<const uint32_t> buffer, far;
+        bool wide;
+
+        bool Empty() const { return buffer.empty(); }
+        uint32_t Root() const { return 0; }
+        uint32_t Mask(uint32_t slot) const { return buffer[wide ? 2 * (size_t)slot : slot] & 0xFF; }
+
+        uint32_t Child(uint32_t slot, int i, uint32_t mask) const {
+            uint32_t rank = std::popcount(mask & ((1u << i) - 1));
+            if (wide)
+                return buffer[2 * (size_t)slot + 1] + rank;
+
+            uint32_t desc = buffer[slot];
+            uint32_t offset = (desc & (1 << 16)) ? far[desc >> 17] : desc >> 17;
+            return slot + offset + rank;
+        }
+    };
+
+    glm::uvec3 ChildCell(glm::uvec3 cell, int i) {
+        return cell * 2u + glm::uvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+    }
+
+    template<typename Access>
+    bool Occupied(const Access& access, int maxDepth, glm::uvec3 cell) {
+        if (access.Empty())
+            return false;
+
+        uint32_t node = access.Root();
+        for (int depth = 0; depth < maxDepth; depth++) {
+            int shift = maxDepth - depth - 1;
+            int i = ((cell.x >> shift) & 1) | (((cell.y >> shift) & 1) << 1) | (((cell.z >> shift) & 1) << 2);
+
+            uint32_t mask = access.Mask(node);
+            if (!(mask & (1 << i)))
+                return false;
+            if (shift > 0)
+                node = access.Child(node, i, mask);
+        }
+
+        return true;
+    }
+
+    template<typename Access>
+    void Overlapping(const Access& access, int maxDepth, glm::uvec3 lo, glm::uvec3 hi, std::vector<glm::uvec3>& cells) {
+        if (access.Empty())
+            return;
+
+        auto visit = [&](auto& self, uint32_t node, glm::uvec3 cell, int depth) -> void {
+            int shift = maxDepth - depth - 1;
+            uint32_t mask = access.Mask(node);
+
+            // Children in Morton order, so the cells come out in Morton order too
+            for (int i = 0; i < 8; i++) {
+                if (!(mask & (1 << i)))
+                    continue;
+
+                glm::uvec3 child = ChildCell(cell, i);
+                glm::uvec3 childLo = child << (uint32_t)shift, childHi = childLo + glm::uvec3((1u << shift) - 1);
+                if (glm::any(glm::greaterThan(childLo, hi)) || glm::any(glm::lessThan(childHi, lo)))
+                    continue;
+
+                if (shift == 0)
+                    cells.push_back(child);
+                else
+                    self(self, access.Child(node, i, mask), child, depth + 1);
+            }
+        };
+
+        if (maxDepth == 0)
+            cells.push_back(glm::uvec3(0));
+        else
+            visit(visit, access.Root(), glm::uvec3(0), 0);
+    }
+
+    // Ray in leaf cell units, mirrored so it runs forwards along every axis; t is the world distance
+    struct GridRay {
+        glm::vec3 origin, inverse;
+        float maxT;
+        int octant;     // bit set for every axis that was mirrored
+    };
+
+    // The first child a ray enters, from the plane it entered the parent through and the parent's
+    // midplane crossings
+    int FirstChild(glm::vec3 t0, glm::vec3 tm) {
+        if (t0.x >= t0.y && t0.x >= t0.z)
+            return (tm.y < t0.x ? 2 : 0) | (tm.z < t0.x ? 4 : 0);
+        if (t0.y >= t0.z)
+            return (tm.x < t0.y ? 1 : 0) | (tm.z < t0.y ? 4 : 0);
+        return (tm.x < t0.z ? 1 : 0) | (tm.y < t0.z ? 2 : 0);
+    }
+
+    // Parametric traversal (Revelles et al.): a node's children are found by halving its slab
+    // distances, and only the at most four children the ray passes through are visited, front to back
+    template<typename Access>
+    SvoRayHit Cast(const Access& access, int maxDepth, const GridRay& ray) {
+        SvoRayHit hit;
+        if (access.Empty() || maxDepth == 0)
+            return hit;
+
+        auto visit = [&](auto& self, uint32_t node, glm::uvec3 cell, int depth, glm::vec3 t0, glm::vec3 t1) -> bool {
+            uint32_t mask = access.Mask(node);
+            glm::vec3 tm = (t0 + t1) * 0.5f;
+
+            for (int local = FirstChild(t0, tm); local < 8;) {
+                glm::vec3 c0, c1;
+                for (int axis = 0; axis < 3; axis++) {
+                    bool upper = local & (1 << axis);
+                    c0[axis] = upper ? tm[axis] : t0[axis];
+                    c1[axis] = upper ? t1[axis] : tm[axis];
+                }
+
+                float enter = std::max({ c0.x, c0.y, c0.z });
+                if (enter > ray.maxT)
+                    return false;
+
+                int i = local ^ ray.octant;
+                if ((mask & (1 << i)) && c1.x >= 0 && c1.y >= 0 && c1.z >= 0) {
+                    glm::uvec3 child = ChildCell(cell, i);
+                    if (depth + 1 < maxDepth) {
+                        if (self(self, access.Child(node, i, mask), child, depth + 1, c0, c1))
+                            return true;
+                    }
+                    else {
+                        hit.cell = child;
+                        hit.distance = std::max(enter, 0.f);
+                        if (enter > 0) {
+                            int axis = c0.x == enter ? 0 : (c0.y == enter ? 1 : 2);
+                            hit.normal[axis] = (ray.octant & (1 << axis)) ? 1.f : -1.f;
+                        }
+                        return true;
+                    }
+                }
+
+                // Step across whichever plane the ray leaves this child through, or out of the parent
+                int exit = c1.x <= c1.y && c1.x <= c1.z ? 0 : (c1.y <= c1.z ? 1 : 2);
+                local = (local & (1 << exit)) ? 8 : local | (1 << exit);
+            }
+
+            return false;
+        };
+
+        float cells = (float)(1u << maxDepth);
+        glm::vec3 t0 = -ray.origin * ray.inverse, t1 = (glm::vec3(cells) - ray.origin) * ray.inverse;
+        if (std::max({ t0.x, t0.y, t0.z }) < std::min({ t1.x, t1.y, t1.z }))
+            visit(visit, access.Root(), glm::uvec3(0), 0, t0, t1);
+
+        return hit;
+    }
+}
+
+SvoQuery::SvoQuery(const SparseVoxelOctree& tree)
+    : m_Tree(&tree), m_Size(tree.GetSize()), m_MaxDepth(tree.GetMaxDepth()) {}
+
+SvoQuery::SvoQuery(const SparseVoxelOctree& tree, NodeIndex root)
+    : m_Tree(&tree), m_Root(root), m_Size(tree.GetSize()), m_MaxDepth(tree.GetMaxDepth()) {}
+
+SvoQuery::SvoQuery(std::span<const uint32_t> buffer, std::span<const uint32_t> far, int size, int maxDepth, DescriptorFormat format)
+    : m_Buffer(buffer), m_Far(far), m_Size(size), m_MaxDepth(maxDepth), m_Format(format) {}
+
+template<typename Fn>
+auto SvoQuery::Visit(Fn&& fn) const {
+    if (m_Tree)
+        return fn(NodeAccess{ m_Tree->m_Nodes, m_Root.value_or(m_Tree->m_Root) });
+
+    return fn(BufferAccess{ m_Buffer, m_Far, m_Format == DescriptorFormat::Wide });
+}
+
+bool SvoQuery::IsOccupied(glm::vec3 point) const {
+    float cells = (float)(1u << m_MaxDepth);
+    glm::vec3 p = glm::floor((point + glm::vec3(m_Size / 2.f)) * (cells / m_Size));
+    if (glm::any(glm::lessThan(p, glm::vec3(0.f))) || glm::any(glm::greaterThanEqual(p, glm::vec3(cells))))
+        return false;
+
+    return Visit([&](const auto& access) { return Occupied(access, m_MaxDepth, glm::uvec3(p)); });
+}
+
+size_t SvoQuery::QueryBox(glm::vec3 min, glm::vec3 max, std::vector<glm::uvec3>& cells) const {
+    float count = (float)(1u << m_MaxDepth);
+    glm::vec3 lo = glm::floor((min + glm::vec3(m_Size / 2.f)) * (count / m_Size));
+    glm::vec3 hi = glm::floor((max + glm::vec3(m_Size / 2.f)) * (count / m_Size));
+    if (glm::any(glm::greaterThan(lo, hi)) || glm::any(glm::lessThan(hi, glm::vec3(0.f))) || glm::any(glm::greaterThanEqual(lo, glm::vec3(count))))
+        return 0;
+
+    lo = glm::max(lo, glm::vec3(0.f));
+    hi = glm::min(hi, glm::vec3(count - 1));
+
+    size_t first = cells.size();
+    Visit([&](const auto& access) { Overlapping(access, m_MaxDepth, glm::uvec3(lo), glm::uvec3(hi), cells); });
+    return cells.size() - first;
+}
+
+SvoRayHit SvoQuery::Raycast(const SvoRay& ray) const {
+    float length = glm::length(ray.direction);
+    if (length == 0)
+        return {};
+
+    float cells = (float)(1u << m_MaxDepth);
+    glm::vec3 origin = (ray.origin + glm::vec3(m_Size / 2.f)) * (cells / m_Size);
+    glm::vec3 direction = ray.direction / length * (cells / m_Size);
+
+    GridRay grid;
+    grid.maxT = ray.maxDistance;
+    grid.octant = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (direction[axis] < 0) {
+            origin[axis] = cells - origin[axis];
+            direction[axis] = -direction[axis];
+            grid.octant |= 1 << axis;
+        }
+
+        // A tiny step instead of zero keeps 0 * inf out of the slab distances
+        grid.inverse[axis] = 1.f / std::max(direction[axis], 1e-30f);
+    }
+    grid.origin = origin;
+
+    return Visit([&](const auto& access) { return Cast(access, m_MaxDepth, grid); });
+}
+
+void SvoQuery::Raycast(std::span<const SvoRay> rays, std::span<SvoRayHit> hits) const {
+    constexpr size_t Chunk = 64;
+
+    parallel::For((rays.size() + Chunk - 1) / Chunk, [&](size_t c) {
+        for (size_t i = c * Chunk; i < std::min(rays.size(), (c + 1) * Chunk); i++)
+            hits[i] = Raycast(rays[i]);
+    });
+}
+
+std::pair<glm::vec3, glm::vec3> SvoQuery::CellBounds(glm::uvec3 cell) const {
+    float cellSize = (float)m_Size / (float)(1u << m_MaxDepth);
+    glm::vec3 min = glm::vec3(cell) * cellSize - glm::vec3(m_Size / 2.f);
+    return { min, min + glm::vec3(cellSize) };
+}
\ No newline at end of file
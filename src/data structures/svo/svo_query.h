@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vk_types.h>
+#include "svo.h"
+
+struct SvoRay {
+    glm::vec3 origin;
+    glm::vec3 direction;                // need not be normalized
+    float maxDistance = INFINITY;
+};
+
+struct SvoRayHit {
+    glm::uvec3 cell{ 0 };               // leaf cell, see SvoQuery::CellBounds
+    float distance = INFINITY;          // world units along the ray, INFINITY on a miss
+    glm::vec3 normal{ 0.f };            // face the ray entered through, zero if it started inside
+
+    bool Hit() const { return distance != INFINITY; }
+};
+
+// Read-only spatial queries against either a tree's node graph or a serialized buffer, which may be a
+// DAG, a MappedSvo or any other copy of m_Buffer and m_Far written without bricks, in either
+// descriptor format. Positions are in the tree's world space, centered on the origin. Every method is
+// const and safe to call from many threads at once, as long as nothing modifies the tree or the buffer
+// meanwhile.
+class SvoQuery {
+public:
+    explicit SvoQuery(const SparseVoxelOctree& tree);
+    // The node graph below another root of the tree's pool, such as a VersionedSvo snapshot's
+    SvoQuery(const SparseVoxelOctree& tree, NodeIndex root);
+    SvoQuery(std::span<const uint32_t> buffer, std::span<const uint32_t> far, int size, int maxDepth,
+        DescriptorFormat format = DescriptorFormat::Compact);
+
+    bool IsOccupied(glm::vec3 point) const;
+    // Appends every voxel overlapping the box to cells, in Morton order, and returns how many it added
+    size_t QueryBox(glm::vec3 min, glm::vec3 max, std::vector<glm::uvec3>& cells) const;
+    SvoRayHit Raycast(const SvoRay& ray) const;
+    // Casts batches of rays in parallel, hits must be as long as rays
+    void Raycast(std::span<const SvoRay> rays, std::span<SvoRayHit> hits) const;
+
+    // World-space bounds of a leaf cell
+    std::pair<glm::vec3, glm::vec3> CellBounds(glm::uvec3 cell) const;
+
+private:
+    const SparseVoxelOctree* m_Tree = nullptr;
+    // The tree's own root when empty
+    std::optional<NodeIndex> m_Root;
+    std::span<const uint32_t> m_Buffer, m_Far;
+    int m_Size, m_MaxDepth;
+    DescriptorFormat m_Format = DescriptorFormat::Compact;
+
+    template<typename Fn>
+    auto Visit(Fn&& fn) const;
+};
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "svo_versioned.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+    uint64_t PackVersion(uint32_t version, NodeIndex root) {
+        return (uint64_t)version << 32 | root;
+    }
+
+    int ChildIndex(glm::uvec3 cell, int shift) {
+        return ((cell.x >> shift) & 1) | (((cell.y >> shift) & 1) << 1) | (((cell.z >> shift) & 1) << 2);
+    }
+}
+
+SvoSnapshot::SvoSnapshot(SvoSnapshot&& other) noexcept
+    : m_Owner(other.m_Owner), m_Reader(other.m_Reader), m_Version(other.m_Version), m_Root(other.m_Root) {
+    other.m_Owner = nullptr;
+}
+
+SvoSnapshot& SvoSnapshot::operator=(SvoSnapshot&& other) noexcept {
+    if (this != &other) {
+        Release();
+        m_Owner = other.m_Owner;
+        m_Reader = other.m_Reader;
+        m_Version = other.m_Version;
+        m_Root = other.m_Root;
+        other.m_Owner = nullptr;
+    }
+    return *this;
+}
+
+SvoSnapshot::~SvoSnapshot() {
+    Release();
+}
+
+SvoQuery SvoSnapshot::Query() const {
+    assert(m_Owner);
+    return SvoQuery(m_Owner->m_Tree, m_Root);
+}
+
+void SvoSnapshot::Release() {
+    if (m_Owner)
+        m_Owner->Unpin(m_Reader);
+    m_Owner = nullptr;
+}
+
+VersionedSvo::VersionedSvo(SparseVoxelOctree& tree, uint32_t maxReaders)
+    : m_Tree(tree), m_Readers(std::make_unique<ReaderSlot[]>(maxReaders)), m_MaxReaders(maxReaders) {
+    assert(!tree.m_Compressed);
+    if (tree.m_AttributesDirty)
+        tree.FilterAttributes();
+
+    m_Root = tree.m_Root;
+    m_Current.store(PackVersion(0, m_Root), std::memory_order_release);
+}
+
+uint32_t VersionedSvo::RegisterReader() {
+    for (uint32_t i = 0; i < m_MaxReaders; i++) {
+        bool expected = false;
+        if (m_Readers[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return i;
+    }
+    return UINT32_MAX;
+}
+
+void VersionedSvo::UnregisterReader(uint32_t reader) {
+    m_Readers[reader].epoch.store(0, std::memory_order_release);
+    m_Readers[reader].used.store(false, std::memory_order_release);
+}
+
+// The slot's epoch is stored before the root is loaded, both sequentially consistent, so either
+// Reclaim sees the pin or this load sees every root published before Reclaim looked
+SvoSnapshot VersionedSvo::Pin(uint32_t reader) const {
+    assert(m_Readers[reader].epoch.load(std::memory_order_relaxed) == 0);
+    m_Readers[reader].epoch.store(m_Epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    uint64_t current = m_Current.load(std::memory_order_seq_cst);
+
+    SvoSnapshot snapshot;
+    snapshot.m_Owner = this;
+    snapshot.m_Reader = reader;
+    snapshot.m_Version = (uint32_t)(current >> 32);
+    snapshot.m_Root = (NodeIndex)current;
+    return snapshot;
+}
+
+void VersionedSvo::Unpin(uint32_t reader) const {
+    m_Readers[reader].epoch.store(0, std::memory_order_release);
+}
+
+NodeIndex VersionedSvo::Allocate() {
+    if (m_Free.empty())
+        return m_Tree.m_Nodes.Allocate();
+
+    NodeIndex node = m_Free.back();
+    m_Free.pop_back();
+    m_Tree.m_Nodes[node] = Node();
+    return node;
+}
+
+NodeIndex VersionedSvo::Own(NodeIndex node) {
+    if (m_Fresh.contains(node))
+        return node;
+
+    NodeIndex copy = Allocate();
+    m_Tree.m_Nodes[copy] = m_Tree.m_Nodes[node];
+    m_Fresh.insert(copy);
+    m_Replaced.push_back(node);
+    return copy;
+}
+
+// An unpublished node can be reused right away, a published one only once readers are done with it
+void VersionedSvo::Discard(NodeIndex node) {
+    if (m_Fresh.erase(node))
+        m_Free.push_back(node);
+    else
+        m_Replaced.push_back(node);
+}
+
+void VersionedSvo::Insert(glm::vec3 point, glm::vec3 color) {
+    glm::uvec3 cell;
+    if (!m_Tree.Quantize(point, cell))
+        return;
+
+    int maxDepth = m_Tree.m_MaxDepth;
+    NodeIndex path[morton::MaxBitsPerAxis + 1];
+    path[0] = m_Root == InvalidNode ? Allocate() : Own(m_Root);
+    m_Fresh.insert(path[0]);
+    m_Root = path[0];
+
+    for (int depth = 0; depth < maxDepth; depth++) {
+        int i = ChildIndex(cell, maxDepth - depth - 1);
+        NodeIndex child = m_Tree.m_Nodes[path[depth]].children[i];
+        if (child == InvalidNode) {
+            child = Allocate();
+            m_Fresh.insert(child);
+        }
+        else
+            child = Own(child);
+
+        m_Tree.m_Nodes[path[depth]].children[i] = child;
+        path[depth + 1] = child;
+    }
+
+    Node& leaf = m_Tree.m_Nodes[path[maxDepth]];
+    if (m_Tree.m_Editable) {
+        m_Tree.m_VoxelCount += !leaf.IsLeaf;
+        m_Tree.m_EditedCells.push_back(cell);
+    }
+    leaf.IsLeaf = true;
+    leaf.data.color = color;
+
+    for (int depth = maxDepth - 1; depth >= 0; depth--)
+        m_Tree.FilterNode(path[depth]);
+}
+
+bool VersionedSvo::Remove(glm::vec3 point) {
+    glm::uvec3 cell;
+    if (!m_Tree.Quantize(point, cell) || m_Root == InvalidNode)
+        return false;
+
+    int maxDepth = m_Tree.m_MaxDepth;
+    NodeIndex path[morton::MaxBitsPerAxis + 1];
+    int childIndex[morton::MaxBitsPerAxis];
+    path[0] = m_Root;
+    for (int depth = 0; depth < maxDepth; depth++) {
+        childIndex[depth] = ChildIndex(cell, maxDepth - depth - 1);
+        path[depth + 1] = m_Tree.m_Nodes[path[depth]].children[childIndex[depth]];
+        if (path[depth + 1] == InvalidNode)
+            return false;
+    }
+
+    // Copy the interior nodes, the leaf is only unlinked
+    path[0] = m_Root = Own(m_Root);
+    for (int depth = 1; depth < maxDepth; depth++) {
+        path[depth] = Own(path[depth]);
+        m_Tree.m_Nodes[path[depth - 1]].children[childIndex[depth - 1]] = path[depth];
+    }
+
+    int depth = maxDepth - 1;
+    Discard(path[maxDepth]);
+    m_Tree.m_Nodes[path[depth]].children[childIndex[depth]] = InvalidNode;
+    while (depth > 0 && m_Tree.CountChildren(path[depth]) == 0) {
+        Discard(path[depth]);
+        depth--;
+        m_Tree.m_Nodes[path[depth]].children[childIndex[depth]] = InvalidNode;
+    }
+
+    if (m_Tree.CountChildren(m_Root) == 0) {
+        Discard(m_Root);
+        m_Root = InvalidNode;
+    }
+    else {
+        for (; depth >= 0; depth--)
+            m_Tree.FilterNode(path[depth]);
+    }
+
+    if (m_Tree.m_Editable) {
+        m_Tree.m_VoxelCount--;
+        m_Tree.m_EditedCells.push_back(cell);
+    }
+    return true;
+}
+
+// Readers that pin after the epoch advances load the new root, so the replaced nodes are retired under
+// the epoch that just ended
+uint32_t VersionedSvo::Publish() {
+    uint64_t current = m_Current.load(std::memory_order_relaxed);
+    if (m_Fresh.empty() && m_Replaced.empty() && (NodeIndex)current == m_Root)
+        return (uint32_t)(current >> 32);
+
+    uint32_t version = (uint32_t)(current >> 32) + 1;
+    m_Current.store(PackVersion(version, m_Root), std::memory_order_seq_cst);
+    uint64_t epoch = m_Epoch.fetch_add(1, std::memory_order_seq_cst);
+
+    if (!m_Replaced.empty())
+        m_Retired.push_back({ epoch, std::move(m_Replaced) });
+    m_Replaced.clear();
+    m_Fresh.clear();
+    m_Tree.m_Root = m_Root;
+
+    Reclaim();
+    return version;
+}
+
+void VersionedSvo::Reclaim() {
+    uint64_t oldest = UINT64_MAX;
+    for (uint32_t i = 0; i < m_MaxReaders; i++) {
+        uint64_t epoch = m_Readers[i].epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0)
+            oldest = std::min(oldest, epoch);
+    }
+
+    // A reader pinned at epoch e may still reach nodes retired under e, but nothing retired earlier
+    while (!m_Retired.empty() && m_Retired.front().epoch < oldest) {
+        m_Free.insert(m_Free.end(), m_Retired.front().nodes.begin(), m_Retired.front().nodes.end());
+        m_Retired.pop_front();
+    }
+}
+
+size_t VersionedSvo::GetRetiredNodes() const {
+    size_t count = 0;
+    for (const Retired& retired : m_Retired)
+        count += retired.nodes.size();
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vk_types.h>
+#include <atomic>
+#include <deque>
+#include <unordered_set>
+#include "svo.h"
+#include "svo_query.h"
+
+class VersionedSvo;
+
+// A pinned version of a VersionedSvo. Its nodes are not reused while it is alive, however many
+// versions are published meanwhile. Unpins when destroyed.
+class SvoSnapshot {
+public:
+    SvoSnapshot() = default;
+    SvoSnapshot(SvoSnapshot&& other) noexcept;
+    SvoSnapshot& operator=(SvoSnapshot&& other) noexcept;
+    ~SvoSnapshot();
+
+    SvoSnapshot(const SvoSnapshot&) = delete;
+    SvoSnapshot& operator=(const SvoSnapshot&) = delete;
+
+    bool Valid() const { return m_Owner != nullptr; }
+    uint32_t GetVersion() const { return m_Version; }
+    NodeIndex GetRoot() const { return m_Root; }
+    // Queries against this version's node graph, valid as long as the snapshot is
+    SvoQuery Query() const;
+    void Release();
+
+private:
+    friend class VersionedSvo;
+
+    const VersionedSvo* m_Owner = nullptr;
+    uint32_t m_Reader = 0;
+    uint32_t m_Version = 0;
+    NodeIndex m_Root = InvalidNode;
+};
+
+// Copy-on-write versions of a tree, for one editing thread and many readers. Edits copy the path from
+// the root to the changed leaf and refilter the copies, so no node a published version can reach is
+// ever written. Publish makes the edits since the last one visible with a single atomic store of the
+// new root.
+//
+// Readers register once per thread and then pin snapshots without locks: a pin stores the current
+// epoch in the reader's slot and loads the root. Publish retires the nodes the new version replaced
+// under the epoch it ends; they go to a free list for later edits once every pinned reader has moved
+// past that epoch. A reader holds at most one snapshot at a time.
+//
+// The tree keeps working on the editing thread, with its root following the published versions:
+// CreateBuffer serializes the latest one, and UpdateBuffer patches an editable buffer. Do not call
+// the tree's own Insert, Build or Compress while it is versioned.
+class VersionedSvo {
+public:
+    // The tree must not be compressed, since a shared node could not be retired with one path
+    explicit VersionedSvo(SparseVoxelOctree& tree, uint32_t maxReaders = 64);
+
+    // Reader side, safe from any thread. RegisterReader returns UINT32_MAX when every slot is taken.
+    uint32_t RegisterReader();
+    void UnregisterReader(uint32_t reader);
+    SvoSnapshot Pin(uint32_t reader) const;
+
+    // Editing thread only. Edits are invisible to readers until Publish.
+    void Insert(glm::vec3 point, glm::vec3 color);
+    bool Remove(glm::vec3 point);
+    // Returns the new version number, or the current one if nothing changed
+    uint32_t Publish();
+
+    const SparseVoxelOctree& GetTree() const { return m_Tree; }
+    uint32_t GetVersion() const { return (uint32_t)(m_Current.load(std::memory_order_relaxed) >> 32); }
+    // Nodes replaced by published versions that readers may still reach, and nodes ready for reuse
+    size_t GetRetiredNodes() const;
+    size_t GetFreeNodes() const { return m_Free.size(); }
+
+private:
+    friend class SvoSnapshot;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch = 0;     // 0 while nothing is pinned
+        std::atomic<bool> used = false;
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        std::vector<NodeIndex> nodes;
+    };
+
+    SparseVoxelOctree& m_Tree;
+    std::unique_ptr<ReaderSlot[]> m_Readers;
+    uint32_t m_MaxReaders;
+    // The published version in the high half and its root in the low half
+    std::atomic<uint64_t> m_Current;
+    std::atomic<uint64_t> m_Epoch = 1;
+
+    // Editing thread state: the root being edited, the nodes copied since the last Publish, which may
+    // be written in place, and the published nodes they replaced
+    NodeIndex m_Root;
+    std::unordered_set<NodeIndex> m_Fresh;
+    std::vector<NodeIndex> m_Replaced;
+    std::deque<Retired> m_Retired;
+    std::vector<NodeIndex> m_Free;
+
+    NodeIndex Allocate();
+    // node itself if it was copied since the last Publish, otherwise a fresh copy of it
+    NodeIndex Own(NodeIndex node);
+    void Discard(NodeIndex node);
+    void Reclaim();
+    void Unpin(uint32_t reader) const;
+};
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "svo.h"
+
+#include <parallel.h>
+#include <atomic>
+
+namespace {
+    // Separating axis test between a triangle and an axis-aligned box (Akenine-Moller), with the
+    // triangle already relative to the box center
+    bool TriangleBoxOverlap(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float half) {
+        glm::vec3 e0 = v1 - v0, e1 = v2 - v1, e2 = v0 - v2;
+
+        // The nine cross products of the triangle edges with the box axes
+        auto axis = [&](glm::vec3 a) {
+            float p0 = glm::dot(a, v0), p1 = glm::dot(a, v1), p2 = glm::dot(a, v2);
+            float r = half * (std::abs(a.x) + std::abs(a.y) + std::abs(a.z));
+            return std::min({ p0, p1, p2 }) <= r && std::max({ p0, p1, p2 }) >= -r;
+        };
+
+        for (glm::vec3 e : { e0, e1, e2 }) {
+            if (!axis(glm::vec3(0.f, -e.z, e.y)) || !axis(glm::vec3(e.z, 0.f, -e.x)) || !axis(glm::vec3(-e.y, e.x, 0.f)))
+                return false;
+        }
+
+        // The box faces, the triangle's bounds are handled by the caller's cell range
+        glm::vec3 lo = glm::min(glm::min(v0, v1), v2), hi = glm::max(glm::max(v0, v1), v2);
+        for (int i = 0; i < 3; i++) {
+            if (lo[i] > half || hi[i] < -half)
+                return false;
+        }
+
+        // The triangle's plane
+        glm::vec3 normal = glm::cross(e0, e1);
+        float d = glm::dot(normal, v0);
+        float r = half * (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+        return std::abs(d) <= r;
+    }
+
+    // Whether a column center on an edge belongs to this triangle, so a column passing exactly
+    // through a shared edge is crossed once
+    bool IsTopLeft(glm::vec2 from, glm::vec2 to) {
+        glm::vec2 d = to - from;
+        return d.y < 0 || (d.y == 0 && d.x < 0);
+    }
+
+    struct Crossing {
+        float z;
+        uint32_t triangle;
+
+        bool operator<(const Crossing& other) const { return z < other.z; }
+    };
+}
+
+uint64_t SparseVoxelOctree::Voxelize(std::span<const Vertex> vertices, std::span<const uint32_t> indices, const glm::mat4& transform, bool solid) {
+    constexpr uint32_t Chunk = 4096;
+    constexpr int MaxTileShift = 5;
+
+    uint32_t cells = 1u << m_MaxDepth;
+    uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+    uint32_t chunks = (triangleCount + Chunk - 1) / Chunk;
+
+    // Tiles are octree cells MaxTileShift levels above the leaves, so each one is a contiguous run of
+    // Morton codes and finished tiles can be streamed into the builder in order
+    int tileShift = std::min(MaxTileShift, m_MaxDepth);
+    int tileDepth = m_MaxDepth - tileShift;
+    uint32_t tileCells = 1u << tileShift;
+
+    // Positions in units of leaf cells, triangle colors from their vertices
+    std::vector<glm::vec3> positions(vertices.size());
+    float scale = (float)cells / (float)m_Size;
+    parallel::For((vertices.size() + Chunk - 1) / Chunk, [&](size_t c) {
+        for (size_t i = c * Chunk; i < std::min(vertices.size(), (c + 1) * Chunk); i++) {
+            glm::vec4 p = transform * glm::vec4(vertices[i].position, 1.f);
+            positions[i] = (glm::vec3(p) + glm::vec3(m_Size / 2.f)) * scale;
+        }
+    });
+
+    std::vector<glm::vec3> colors(triangleCount);
+    std::vector<glm::uvec3> lo(triangleCount), hi(triangleCount);
+    std::vector<uint8_t> inside(triangleCount);
+
+    // Cell bounds of every triangle, clipped to the volume
+    parallel::For(chunks, [&](size_t c) {
+        for (uint32_t t = (uint32_t)c * Chunk; t < std::min(triangleCount, (uint32_t)(c + 1) * Chunk); t++) {
+            glm::vec3 a = positions[indices[3 * t]], b = positions[indices[3 * t + 1]], d = positions[indices[3 * t + 2]];
+            glm::vec3 min = glm::min(glm::min(a, b), d), max = glm::max(glm::max(a, b), d);
+
+            colors[t] = (glm::vec3(vertices[indices[3 * t]].color) + glm::vec3(vertices[indices[3 * t + 1]].color) + glm::vec3(vertices[indices[3 * t + 2]].color)) / 3.f;
+            inside[t] = max.x >= 0 && max.y >= 0 && max.z >= 0 && min.x < cells && min.y < cells && min.z < cells;
+            if (inside[t]) {
+                lo[t] = glm::uvec3(glm::clamp(glm::floor(min), glm::vec3(0.f), glm::vec3((float)(cells - 1))));
+                hi[t] = glm::uvec3(glm::clamp(glm::floor(max), glm::vec3(0.f), glm::vec3((float)(cells - 1))));
+            }
+        }
+    });
+
+    // Bin triangles into every tile their bounds touch, then sort the bins into Morton order
+    auto forEachTile = [&](uint32_t t, auto&& fn) {
+        glm::uvec3 a = lo[t] >> (uint32_t)tileShift, b = hi[t] >> (uint32_t)tileShift;
+        for (uint32_t z = a.z; z <= b.z; z++)
+            for (uint32_t y = a.y; y <= b.y; y++)
+                for (uint32_t x = a.x; x <= b.x; x++)
+                    fn(morton::Encode(glm::uvec3(x, y, z)));
+    };
+
+    std::vector<uint32_t> binOffsets(chunks + 1);
+    parallel::For(chunks, [&](size_t c) {
+        uint32_t count = 0;
+        for (uint32_t t = (uint32_t)c * Chunk; t < std::min(triangleCount, (uint32_t)(c + 1) * Chunk); t++) {
+            if (inside[t])
+                forEachTile(t, [&](uint64_t) { count++; });
+        }
+        binOffsets[c] = count;
+    });
+    uint32_t binCount = parallel::ExclusiveScan(std::span<uint32_t>(binOffsets));
+
+    std::vector<uint64_t> binTiles(binCount);
+    std::vector<uint32_t> binTriangles(binCount);
+    parallel::For(chunks, [&](size_t c) {
+        uint32_t at = binOffsets[c];
+        for (uint32_t t = (uint32_t)c * Chunk; t < std::min(triangleCount, (uint32_t)(c + 1) * Chunk); t++) {
+            if (inside[t]) {
+                forEachTile(t, [&](uint64_t tile) {
+                    binTiles[at] = tile;
+                    binTriangles[at++] = t;
+                });
+            }
+        }
+    });
+    morton::RadixSort(binTiles, binTriangles, 3 * tileDepth);
+
+    // For a solid fill, every column through the mesh gets the sorted heights where it crosses the
+    // surface, and a cell is inside after an odd number of crossings below its center
+    std::vector<uint32_t> columnStart;
+    std::vector<Crossing> crossings;
+    if (solid) {
+        auto forEachColumn = [&](uint32_t t, auto&& fn) {
+            glm::vec3 a = positions[indices[3 * t]], b = positions[indices[3 * t + 1]], c = positions[indices[3 * t + 2]];
+            glm::vec2 pa(a.x, a.y), pb(b.x, b.y), pc(c.x, c.y);
+
+            float area = (pb.x - pa.x) * (pc.y - pa.y) - (pb.y - pa.y) * (pc.x - pa.x);
+            if (area == 0)
+                return;
+            if (area < 0) {
+                std::swap(pb, pc);
+                std::swap(b, c);
+                area = -area;
+            }
+
+            auto edge = [](glm::vec2 u, glm::vec2 v, glm::vec2 p) { return (v.x - u.x) * (p.y - u.y) - (v.y - u.y) * (p.x - u.x); };
+            bool topLeft0 = IsTopLeft(pb, pc), topLeft1 = IsTopLeft(pc, pa), topLeft2 = IsTopLeft(pa, pb);
+
+            // Triangles above or below the volume still count, only the footprint is clipped
+            glm::vec2 min = glm::min(glm::min(pa, pb), pc), max = glm::max(glm::max(pa, pb), pc);
+            if (max.x < 0 || max.y < 0 || min.x >= cells || min.y >= cells)
+                return;
+
+            glm::uvec2 from = glm::uvec2(glm::clamp(glm::floor(min), glm::vec2(0.f), glm::vec2((float)(cells - 1))));
+            glm::uvec2 to = glm::uvec2(glm::clamp(glm::floor(max), glm::vec2(0.f), glm::vec2((float)(cells - 1))));
+
+            for (uint32_t y = from.y; y <= to.y; y++) {
+                for (uint32_t x = from.x; x <= to.x; x++) {
+                    glm::vec2 p(x + 0.5f, y + 0.5f);
+                    float w0 = edge(pb, pc, p), w1 = edge(pc, pa, p), w2 = edge(pa, pb, p);
+                    if ((w0 > 0 || (w0 == 0 && topLeft0)) && (w1 > 0 || (w1 == 0 && topLeft1)) && (w2 > 0 || (w2 == 0 && topLeft2)))
+                        fn(y * cells + x, (w0 * a.z + w1 * b.z + w2 * c.z) / area);
+                }
+            }
+        };
+
+        columnStart.assign((size_t)cells * cells + 1, 0);
+        parallel::For(chunks, [&](size_t c) {
+            for (uint32_t t = (uint32_t)c * Chunk; t < std::min(triangleCount, (uint32_t)(c + 1) * Chunk); t++)
+                forEachColumn(t, [&](uint32_t column, float) { std::atomic_ref<uint32_t>(columnStart[column]).fetch_add(1, std::memory_order_relaxed); });
+        });
+        crossings.resize(parallel::ExclusiveScan(std::span<uint32_t>(columnStart)));
+
+        std::vector<uint32_t> cursor(columnStart.begin(), columnStart.end() - 1);
+        parallel::For(chunks, [&](size_t c) {
+            for (uint32_t t = (uint32_t)c * Chunk; t < std::min(triangleCount, (uint32_t)(c + 1) * Chunk); t++) {
+                forEachColumn(t, [&](uint32_t column, float z) {
+                    crossings[std::atomic_ref<uint32_t>(cursor[column]).fetch_add(1, std::memory_order_relaxed)] = { z, t };
+                });
+            }
+        });
+
+        parallel::For(cells, [&](size_t y) {
+            for (size_t column = y * cells; column < (y + 1) * cells; column++)
+                std::sort(crossings.begin() + columnStart[column], crossings.begin() + columnStart[column + 1]);
+        });
+    }
+
+    // Surface tiles, plus for a solid fill every tile in the mesh's bounds since the inside of a large
+    // mesh can span tiles no triangle touches
+    std::vector<uint64_t> tiles;
+    glm::vec3 meshMin(INFINITY), meshMax(-INFINITY);
+    if (solid) {
+        for (glm::vec3 p : positions) {
+            meshMin = glm::min(meshMin, p);
+            meshMax = glm::max(meshMax, p);
+        }
+    }
+
+    if (solid && meshMax.x >= 0 && meshMax.y >= 0 && meshMax.z >= 0 && meshMin.x < cells && meshMin.y < cells && meshMin.z < cells) {
+        glm::uvec3 meshLo = glm::uvec3(glm::clamp(glm::floor(meshMin), glm::vec3(0.f), glm::vec3((float)(cells - 1))));
+        glm::uvec3 meshHi = glm::uvec3(glm::clamp(glm::floor(meshMax), glm::vec3(0.f), glm::vec3((float)(cells - 1))));
+
+        glm::uvec3 a = meshLo >> (uint32_t)tileShift, b = meshHi >> (uint32_t)tileShift;
+        for (uint32_t z = a.z; z <= b.z; z++)
+            for (uint32_t y = a.y; y <= b.y; y++)
+                for (uint32_t x = a.x; x <= b.x; x++)
+                    tiles.push_back(morton::Encode(glm::uvec3(x, y, z)));
+        std::sort(tiles.begin(), tiles.end());
+    }
+    else {
+        for (size_t i = 0; i < binTiles.size(); i++) {
+            if (i == 0 || binTiles[i] != binTiles[i - 1])
+                tiles.push_back(binTiles[i]);
+        }
+    }
+
+    struct TileVoxels {
+        std::vector<uint64_t> codes;
+        std::vector<uint32_t> triangles;
+    };
+
+    auto voxelizeTile = [&](uint64_t tile, TileVoxels& out) {
+        // Which triangle set each cell of the tile, indexed by the cell's Morton code within the tile.
+        // Only touched cells are reset afterwards, so the array stays empty between tiles.
+        thread_local std::vector<uint32_t> owner;
+        owner.resize((size_t)1 << (3 * MaxTileShift), UINT32_MAX);
+
+        std::vector<uint32_t> touched;
+        auto set = [&](glm::uvec3 local, uint32_t triangle) {
+            uint32_t index = (uint32_t)morton::Encode(local);
+            if (owner[index] == UINT32_MAX) {
+                owner[index] = triangle;
+                touched.push_back(index);
+            }
+        };
+
+        glm::uvec3 origin = morton::Decode(tile) << (uint32_t)tileShift;
+        glm::uvec3 last = origin + glm::uvec3(tileCells - 1);
+
+        auto first = std::lower_bound(binTiles.begin(), binTiles.end(), tile);
+        for (size_t i = first - binTiles.begin(); i < binTiles.size() && binTiles[i] == tile; i++) {
+            uint32_t t = binTriangles[i];
+            glm::uvec3 a = glm::max(lo[t], origin), b = glm::min(hi[t], last);
+            glm::vec3 v0 = positions[indices[3 * t]], v1 = positions[indices[3 * t + 1]], v2 = positions[indices[3 * t + 2]];
+            glm::vec3 normal = glm::cross(v1 - v0, v2 - v1);
+            float d = glm::dot(normal, v0);
+
+            // Walk the two axes the triangle faces least and solve the plane for the third, so each
+            // column only tests the few cells the plane passes through. The range is padded for
+            // rounding, the overlap test rejects the extra cells.
+            glm::vec3 extent = glm::abs(normal);
+            int k = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            int u = (k + 1) % 3, v = (k + 2) % 3;
+
+            glm::uvec3 cell;
+            for (cell[u] = a[u]; cell[u] <= b[u]; cell[u]++) {
+                for (cell[v] = a[v]; cell[v] <= b[v]; cell[v]++) {
+                    float kFrom = (float)a[k], kTo = (float)b[k];
+                    if (normal[k] != 0) {
+                        float k00 = (d - normal[u] * cell[u] - normal[v] * cell[v]) / normal[k];
+                        float du = -normal[u] / normal[k], dv = -normal[v] / normal[k];
+                        float k0 = k00 + std::min(du, 0.f) + std::min(dv, 0.f), k1 = k00 + std::max(du, 0.f) + std::max(dv, 0.f);
+                        kFrom = std::max(kFrom, std::floor(k0 - 1e-3f));
+                        kTo = std::min(kTo, std::floor(k1 + 1e-3f));
+                    }
+
+                    for (float kf = kFrom; kf <= kTo; kf++) {
+                        cell[k] = (uint32_t)kf;
+                        glm::vec3 center = glm::vec3(cell) + glm::vec3(0.5f);
+                        if (TriangleBoxOverlap(v0 - center, v1 - center, v2 - center, 0.5f))
+                            set(cell - origin, t);
+                    }
+                }
+            }
+        }
+
+        if (solid) {
+            for (uint32_t y = origin.y; y <= last.y; y++) {
+                for (uint32_t x = origin.x; x <= last.x; x++) {
+                    size_t column = (size_t)y * cells + x;
+                    auto begin = crossings.begin() + columnStart[column], end = crossings.begin() + columnStart[column + 1];
+                    if (begin == end)
+                        continue;
+
+                    // Crossings below the tile decide whether the column enters it inside
+                    auto next = std::lower_bound(begin, end, Crossing{ origin.z + 0.5f, 0 });
+                    for (uint32_t z = origin.z; z <= last.z; z++) {
+                        while (next != end && next->z < z + 0.5f)
+                            ++next;
+                        if ((next - begin) % 2 == 1)
+                            set(glm::uvec3(x, y, z) - origin, (next - 1)->triangle);
+                    }
+                }
+            }
+        }
+
+        std::sort(touched.begin(), touched.end());
+        out.codes.resize(touched.size());
+        out.triangles.resize(touched.size());
+        for (size_t i = 0; i < touched.size(); i++) {
+            out.codes[i] = (tile << (3 * tileShift)) | touched[i];
+            out.triangles[i] = owner[touched[i]];
+            owner[touched[i]] = UINT32_MAX;
+        }
+    };
+
+    // Tiles are voxelized a batch at a time and handed to the builder in order
+    SortedBuilder builder(*this);
+    uint64_t voxels = 0;
+
+    size_t batchSize = 4 * parallel::ThreadCount();
+    std::vector<TileVoxels> batch(batchSize);
+    for (size_t first = 0; first < tiles.size(); first += batchSize) {
+        size_t count = std::min(batchSize, tiles.size() - first);
+        parallel::For(count, [&](size_t i) { voxelizeTile(tiles[first + i], batch[i]); });
+
+        for (size_t i = 0; i < count; i++) {
+            for (size_t v = 0; v < batch[i].codes.size(); v++)
+                builder.Add(batch[i].codes[v], colors[batch[i].triangles[v]]);
+            voxels += batch[i].codes.size();
+        }
+    }
+    builder.Finish();
+
+    return voxels;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vk_types.h>
+#include <concepts>
+#include "svo.h"
+#include "svo64.h"
+#include "svo_query.h"
+
+// The query type that reads a tree: the octree's node graph through SvoQuery, the 64-ary tree's
+// serialized buffer through Svo64Query, which needs CreateBuffer first
+template<typename Tree>
+struct VoxelTreeTraits;
+
+template<>
+struct VoxelTreeTraits<SparseVoxelOctree> {
+    using Query = SvoQuery;
+    static constexpr int Arity = 8;
+};
+
+template<>
+struct VoxelTreeTraits<SparseVoxel64Tree> {
+    using Query = Svo64Query;
+    static constexpr int Arity = 64;
+};
+
+// Ray and point queries both query types answer, safe to call from many threads at once
+template<typename Query>
+concept VoxelTreeQuery = requires(const Query& query, glm::vec3 point, const SvoRay& ray, std::span<const SvoRay> rays, std::span<SvoRayHit> hits) {
+    { query.IsOccupied(point) } -> std::same_as<bool>;
+    { query.Raycast(ray) } -> std::same_as<SvoRayHit>;
+    query.Raycast(rays, hits);
+};
+
+// The builder interface SparseVoxelOctree and SparseVoxel64Tree share, so code that fills a tree,
+// serializes it for the GPU and casts rays against it can be written once and handed either. A tree of
+// maxDepth levels has Arity^maxDepth cells; an octree of 2 * maxDepth levels matches a 64-ary tree of
+// maxDepth. m_Buffer and m_Attributes are bound as the residency's Buffer and Attributes arrays.
+template<typename Tree>
+concept VoxelTree = std::constructible_from<Tree, int, int> && VoxelTreeQuery<typename VoxelTreeTraits<Tree>::Query> &&
+    std::constructible_from<typename VoxelTreeTraits<Tree>::Query, const Tree&> &&
+    requires(Tree tree, const Tree& constTree, glm::vec3 point, std::span<const glm::vec3> points) {
+        tree.Insert(point, point);
+        tree.Build(points, points);
+        tree.FilterAttributes();
+        tree.CreateBuffer();
+        tree.Clear();
+        { tree.m_Buffer } -> std::convertible_to<std::span<const uint32_t>>;
+        { tree.m_Attributes } -> std::convertible_to<std::span<const uint32_t>>;
+        { constTree.GetSize() } -> std::convertible_to<int>;
+        { constTree.GetMaxDepth() } -> std::convertible_to<int>;
+        { constTree.GetVoxelCount() } -> std::convertible_to<int>;
+        { constTree.GetNodeCount() } -> std::convertible_to<uint32_t>;
+        { constTree.GetNodeMemory() } -> std::convertible_to<size_t>;
+        { constTree.GetBufferSize() } -> std::convertible_to<uint32_t>;
+        { constTree.GetFarBufferSize() } -> std::convertible_to<uint32_t>;
+        { constTree.GetAttributeBufferSize() } -> std::convertible_to<uint32_t>;
+        { constTree.GetShaderConstants() } -> std::same_as<SvoShaderConstants>;
+    };
+
+static_assert(VoxelTree<SparseVoxelOctree>);
+static_assert(VoxelTree<SparseVoxel64Tree>);
\ No newline at end of file
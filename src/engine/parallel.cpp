@@ -0,0 +1,118 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+    // Workers live for the whole run so a For costs a wake-up instead of thread creation. Every For
+    // queues its job, so concurrent and nested calls share the workers instead of running serially.
+    class ThreadPool {
+    public:
+        explicit ThreadPool(unsigned workers) {
+            for (unsigned w = 0; w < workers; w++)
+                m_Workers.emplace_back([this]() { WorkerLoop(); });
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(m_Mutex);
+                m_Stop = true;
+            }
+            m_Wake.notify_all();
+            for (std::thread& w : m_Workers)
+                w.join();
+        }
+
+        // Runs the job on the caller plus whichever workers are free to join it
+        void Run(size_t count, const std::function<void(size_t)>& fn) {
+            Job job;
+            job.fn = &fn;
+            job.count = count;
+            {
+                std::lock_guard lock(m_Mutex);
+                m_Jobs.push_back(&job);
+            }
+            m_Wake.notify_all();
+
+            Work(job);
+
+            // Every index is handed out, so wait for the workers still running one
+            std::unique_lock lock(m_Mutex);
+            Retire(job);
+            m_Done.wait(lock, [&]() { return job.active == 0; });
+        }
+
+    private:
+        struct Job {
+            const std::function<void(size_t)>* fn = nullptr;
+            size_t count = 0;
+            std::atomic<size_t> next = 0;
+            // Workers inside Work, guarded by m_Mutex
+            unsigned active = 0;
+        };
+
+        static void Work(Job& job) {
+            for (size_t i = job.next.fetch_add(1, std::memory_order_relaxed); i < job.count; i = job.next.fetch_add(1, std::memory_order_relaxed))
+                (*job.fn)(i);
+        }
+
+        // Takes a job with no indices left off the queue, so no more workers join it. m_Mutex must be held.
+        void Retire(Job& job) {
+            auto it = std::find(m_Jobs.begin(), m_Jobs.end(), &job);
+            if (it != m_Jobs.end())
+                m_Jobs.erase(it);
+        }
+
+        void WorkerLoop() {
+            std::unique_lock lock(m_Mutex);
+            while (true) {
+                m_Wake.wait(lock, [&]() { return m_Stop || !m_Jobs.empty(); });
+                if (m_Stop)
+                    return;
+
+                Job& job = *m_Jobs.front();
+                if (job.next.load(std::memory_order_relaxed) >= job.count) {
+                    Retire(job);
+                    continue;
+                }
+
+                job.active++;
+                lock.unlock();
+                Work(job);
+                lock.lock();
+
+                Retire(job);
+                if (--job.active == 0)
+                    m_Done.notify_all();
+            }
+        }
+
+        std::vector<std::thread> m_Workers;
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::condition_variable m_Done;
+
+        // Jobs that may still have indices to hand out, oldest first
+        std::deque<Job*> m_Jobs;
+        bool m_Stop = false;
+    };
+}
+
+unsigned parallel::ThreadCount() {
+    static const unsigned count = std::max(1u, std::thread::hardware_concurrency());
+    return count;
+}
+
+void parallel::For(size_t count, const std::function<void(size_t)>& fn) {
+    if (std::min<size_t>(ThreadCount(), count) > 1) {
+        static ThreadPool pool(ThreadCount() - 1);
+        pool.Run(count, fn);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        fn(i);
+}
\ No newline at end of file
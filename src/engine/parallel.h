@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vk_types.h>
+#include <algorithm>
+
+namespace parallel {
+    unsigned ThreadCount();
+
+    // Runs fn(i) for every i in [0, count) on the caller plus up to ThreadCount() - 1 pooled workers, handing out indices in order.
+    // Any thread may call it, fn included: concurrent and nested calls queue their jobs and share the workers.
+    void For(size_t count, const std::function<void(size_t)>& fn);
+
+    // In-place exclusive prefix sum, returns the total. Large inputs are scanned in per-thread blocks.
+    template<typename T>
+    T ExclusiveScan(std::span<T> values) {
+        constexpr size_t MinBlockSize = 1 << 16;
+
+        size_t blocks = std::min<size_t>(ThreadCount(), values.size() / MinBlockSize);
+        if (blocks <= 1) {
+            T sum = 0;
+            for (T& v : values) {
+                T c = v;
+                v = sum;
+                sum += c;
+            }
+            return sum;
+        }
+
+        size_t blockSize = (values.size() + blocks - 1) / blocks;
+        std::vector<T> sums(blocks);
+
+        For(blocks, [&](size_t b) {
+            size_t end = std::min(values.size(), (b + 1) * blockSize);
+            T sum = 0;
+            for (size_t i = b * blockSize; i < end; i++)
+                sum += values[i];
+            sums[b] = sum;
+        });
+
+        T total = ExclusiveScan(std::span<T>(sums));
+
+        For(blocks, [&](size_t b) {
+            size_t end = std::min(values.size(), (b + 1) * blockSize);
+            T sum = sums[b];
+            for (size_t i = b * blockSize; i < end; i++) {
+                T c = values[i];
+                values[i] = sum;
+                sum += c;
+            }
+        });
+
+        return total;
+    }
+}
\ No newline at end of file
@@ -1,8 +1,25 @@
 #include <vk_engine.h>
+#include <bench.h>
+
+#include <string>
+#include <string_view>
 
 int main(int argc, char* argv[]) {
+	if (argc > 1 && std::string_view(argv[1]) == "--bench")
+		return bench::Run(argc - 2, argv + 2);
+
 	VulkanEngine engine;
 
+	// --svo <file.svo> uploads a Save file as is, --paged <file.svop> [budgetMB] streams a SavePaged
+	// tree. Either replaces voxelizing the test meshes.
+	if (argc > 2 && std::string_view(argv[1]) == "--svo")
+		engine.svoPath = argv[2];
+	if (argc > 2 && std::string_view(argv[1]) == "--paged") {
+		engine.pagedSvoPath = argv[2];
+		if (argc > 3)
+			engine.pagedSvoBudget = (size_t)std::stoul(argv[3]) << 20;
+	}
+
 	engine.init();
 	engine.run();
 	engine.cleanup();
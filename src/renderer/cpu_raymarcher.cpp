@@ -0,0 +1,581 @@
+#include "cpu_raymarcher.h"
+#include <svo.h>
+#include <parallel.h>
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_RAYMARCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // The few lane-wise operations the traversal needs, as wide as the build allows
+#if defined(__AVX2__)
+    constexpr int Lanes = 8;
+    constexpr const char* InstructionSet = "AVX2";
+
+    struct Float { __m256 v; };
+    struct Mask { __m256 v; };
+
+    Float Splat(float f) { return { _mm256_set1_ps(f) }; }
+    Float Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    void Store(float* p, Float a) { _mm256_storeu_ps(p, a.v); }
+    Float operator+(Float a, Float b) { return { _mm256_add_ps(a.v, b.v) }; }
+    Float operator*(Float a, Float b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    Float Min(Float a, Float b) { return { _mm256_min_ps(a.v, b.v) }; }
+    Float Max(Float a, Float b) { return { _mm256_max_ps(a.v, b.v) }; }
+    Mask operator<(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    Mask operator<=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    Mask operator&(Mask a, Mask b) { return { _mm256_and_ps(a.v, b.v) }; }
+    Mask AndNot(Mask a, Mask b) { return { _mm256_andnot_ps(b.v, a.v) }; }
+    Float Select(Mask m, Float a, Float b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+    int Bits(Mask m) { return _mm256_movemask_ps(m.v); }
+#elif defined(__SSE4_1__) || defined(CPU_RAYMARCHER_SSE2)
+    constexpr int Lanes = 4;
+    constexpr const char* InstructionSet = "SSE";
+
+    struct Float { __m128 v; };
+    struct Mask { __m128 v; };
+
+    Float Splat(float f) { return { _mm_set1_ps(f) }; }
+    Float Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    void Store(float* p, Float a) { _mm_storeu_ps(p, a.v); }
+    Float operator+(Float a, Float b) { return { _mm_add_ps(a.v, b.v) }; }
+    Float operator*(Float a, Float b) { return { _mm_mul_ps(a.v, b.v) }; }
+    Float Min(Float a, Float b) { return { _mm_min_ps(a.v, b.v) }; }
+    Float Max(Float a, Float b) { return { _mm_max_ps(a.v, b.v) }; }
+    Mask operator<(Float a, Float b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    Mask operator<=(Float a, Float b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    Mask operator&(Mask a, Mask b) { return { _mm_and_ps(a.v, b.v) }; }
+    Mask AndNot(Mask a, Mask b) { return { _mm_andnot_ps(b.v, a.v) }; }
+#if defined(__SSE4_1__)
+    Float Select(Mask m, Float a, Float b) { return { _mm_blendv_ps(b.v, a.v, m.v) }; }
+#else
+    Float Select(Mask m, Float a, Float b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+#endif
+    int Bits(Mask m) { return _mm_movemask_ps(m.v); }
+#else
+    constexpr int Lanes = 1;
+    constexpr const char* InstructionSet = "scalar";
+
+    struct Float { float v; };
+    struct Mask { bool v; };
+
+    Float Splat(float f) { return { f }; }
+    Float Load(const float* p) { return { *p }; }
+    void Store(float* p, Float a) { *p = a.v; }
+    Float operator+(Float a, Float b) { return { a.v + b.v }; }
+    Float operator*(Float a, Float b) { return { a.v * b.v }; }
+    Float Min(Float a, Float b) { return { std::min(a.v, b.v) }; }
+    Float Max(Float a, Float b) { return { std::max(a.v, b.v) }; }
+    Mask operator<(Float a, Float b) { return { a.v < b.v }; }
+    Mask operator<=(Float a, Float b) { return { a.v <= b.v }; }
+    Mask operator&(Mask a, Mask b) { return { a.v && b.v }; }
+    Mask AndNot(Mask a, Mask b) { return { a.v && !b.v }; }
+    Float Select(Mask m, Float a, Float b) { return m.v ? a : b; }
+    int Bits(Mask m) { return m.v ? 1 : 0; }
+#endif
+
+    // Same light and sky as raymarch.comp
+    const glm::vec3 SunLight = glm::normalize(glm::vec3(0.4f, 0.4f, 0.48f));
+    const glm::vec3 SunColour = glm::vec3(1.f, 0.9f, 0.83f);
+
+    glm::vec3 Sky(glm::vec3 rd) {
+        float sunAmount = std::max(glm::dot(rd, SunLight), 0.f);
+        float v = std::pow(1.f - std::max(rd.y, 0.f), 5.f) * 0.5f;
+        glm::vec3 sky = glm::vec3(v * SunColour.x * 0.4f + 0.18f, v * SunColour.y * 0.4f + 0.22f, v * SunColour.z * 0.4f + 0.4f);
+        sky += SunColour * std::pow(sunAmount, 6.5f) * 0.32f;
+        sky += SunColour * std::min(std::pow(sunAmount, 1150.f), 0.3f) * 0.65f;
+        return sky;
+    }
+
+    uint32_t PackColor(glm::vec3 color) {
+        glm::uvec3 c = glm::uvec3(glm::clamp(color, 0.f, 1.f) * 255.f + 0.5f);
+        return c.x | (c.y << 8) | (c.z << 16) | (0xFFu << 24);
+    }
+
+    glm::vec3 UnpackColor(uint32_t rgba) {
+        return glm::vec3(rgba & 0xFF, (rgba >> 8) & 0xFF, (rgba >> 16) & 0xFF) / 255.f;
+    }
+
+    glm::vec3 UnpackColor565(uint32_t word) {
+        return glm::vec3(word & 31, (word >> 5) & 63, (word >> 11) & 31) / glm::vec3(31.f, 63.f, 31.f);
+    }
+
+    // Lanes of rays in leaf cell units, where the root spans [0, 2^maxDepth]; t is the world distance
+    struct Packet {
+        Float inverse[3];
+        Float originT[3];       // -origin * inverse, a plane at p is crossed at p * inverse + originT
+        Float t;                // closest hit so far
+        uint32_t slot[Lanes];   // attribute slot of the hit node
+        int axis[Lanes];        // axis of the face the hit was entered through, 3 if the ray started inside
+
+        // Per lane, for stepping through bricks
+        float origin[3][Lanes];
+        float direction[3][Lanes];
+    };
+
+    int EntryAxis(float entry, float x, float y) {
+        return entry <= 0 ? 3 : (x == entry ? 0 : (y == entry ? 1 : 2));
+    }
+
+    struct Traversal {
+        const uint32_t* buffer;
+        const uint32_t* far;
+        const uint32_t* bricks;
+        uint32_t slotWords;     // 2 for wide descriptors, which hold their child block's slot
+        int maxDepth;
+        int brickLevels;
+        int octant;             // children are visited in order of their index xor this
+        float footprint;        // cells a pixel covers per world unit of distance, 0 without LOD
+        uint64_t nodeTests = 0;
+
+        // Amanatides-Woo DDA through one lane's voxels of a brick, from where the ray enters it up to
+        // the closest hit so far. Returns the distance of the first occupied voxel, or INFINITY.
+        float TraceBrick(Packet& p, int lane, const uint32_t* brick, glm::uvec3 brickCell, float enter, float exit, float closest, int axis) {
+            int side = 1 << brickLevels;
+            glm::vec3 origin(p.origin[0][lane], p.origin[1][lane], p.origin[2][lane]);
+            glm::vec3 direction(p.direction[0][lane], p.direction[1][lane], p.direction[2][lane]);
+            glm::vec3 base = glm::vec3(brickCell * (uint32_t)side);
+
+            float t = std::max(enter, 0.f);
+            glm::ivec3 voxel = glm::clamp(glm::ivec3(glm::floor(origin + direction * t - base)), glm::ivec3(0), glm::ivec3(side - 1));
+            glm::ivec3 step;
+            glm::vec3 next, delta;
+            for (int a = 0; a < 3; a++) {
+                step[a] = direction[a] < 0 ? -1 : 1;
+                delta[a] = std::abs(1.f / direction[a]);
+                next[a] = (base[a] + voxel[a] + (step[a] > 0 ? 1 : 0) - origin[a]) / direction[a];
+            }
+
+            while (t < closest) {
+                uint32_t index = voxel.x + (voxel.y + voxel.z * side) * side;
+                uint32_t word = brick[1 + index / 32], bit = 1u << (index % 32);
+                if (word & bit) {
+                    uint32_t rank = std::popcount(word & (bit - 1));
+                    for (uint32_t w = 0; w < index / 32; w++)
+                        rank += std::popcount(brick[1 + w]);
+
+                    p.slot[lane] = brick[0] + rank;
+                    p.axis[lane] = axis;
+                    return t;
+                }
+
+                axis = next.x <= next.y && next.x <= next.z ? 0 : (next.y <= next.z ? 1 : 2);
+                t = next[axis];
+                voxel[axis] += step[axis];
+                if (t > exit || voxel[axis] < 0 || voxel[axis] >= side)
+                    break;
+                next[axis] += delta[axis];
+            }
+
+            return INFINITY;
+        }
+
+        void Visit(Packet& p, uint32_t slot, glm::uvec3 cell, int depth, Mask active) {
+            uint32_t desc = buffer[(size_t)slot * slotWords];
+            uint32_t mask = desc & 0xFF;
+            uint32_t block = slotWords == 2 ? buffer[(size_t)slot * 2 + 1] : slot + ((desc & (1 << 16)) ? far[desc >> 17] : desc >> 17);
+
+            int shift = maxDepth - depth - 1;
+            float childSize = (float)(1u << shift);
+
+            for (int k = 0; k < 8; k++) {
+                int i = k ^ octant;
+                if (!(mask & (1 << i)))
+                    continue;
+
+                glm::uvec3 child = cell * 2u + glm::uvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+
+                Float enter[3];
+                Float tNear = Splat(-INFINITY), tFar = Splat(INFINITY);
+                for (int axis = 0; axis < 3; axis++) {
+                    Float a = Splat(child[axis] * childSize) * p.inverse[axis] + p.originT[axis];
+                    Float b = Splat((child[axis] + 1) * childSize) * p.inverse[axis] + p.originT[axis];
+                    enter[axis] = Min(a, b);
+                    tNear = Max(tNear, enter[axis]);
+                    tFar = Min(tFar, Max(a, b));
+                }
+                nodeTests++;
+
+                Mask hit = active & (tNear <= tFar) & (Splat(0.f) <= tFar) & (tNear < p.t);
+                if (!Bits(hit))
+                    continue;
+
+                uint32_t childSlot = block + std::popcount(mask & ((1u << i) - 1));
+                Float distance = Max(tNear, Splat(0.f));
+
+                // Leaves always stop the ray, nodes only once they are smaller than a pixel
+                Mask stop = shift == 0 ? hit : hit & (Splat(childSize) < distance * Splat(footprint));
+                Mask descend = AndNot(hit, stop);
+                bool brick = brickLevels > 0 && shift == brickLevels;
+                int stopBits = Bits(stop), brickBits = brick ? Bits(descend) : 0;
+
+                if (stopBits || brickBits) {
+                    p.t = Select(stop, distance, p.t);
+
+                    float entry[Lanes], exit[Lanes], t[Lanes], planes[3][Lanes];
+                    Store(entry, tNear);
+                    Store(exit, tFar);
+                    Store(t, p.t);
+                    for (int axis = 0; axis < 3; axis++)
+                        Store(planes[axis], enter[axis]);
+
+                    for (int lane = 0; lane < Lanes; lane++) {
+                        int axis = EntryAxis(entry[lane], planes[0][lane], planes[1][lane]);
+                        if (stopBits & (1 << lane)) {
+                            p.slot[lane] = childSlot;
+                            p.axis[lane] = axis;
+                        }
+                        else if (brickBits & (1 << lane)) {
+                            const uint32_t* data = bricks + (size_t)buffer[(size_t)childSlot * slotWords] * SparseVoxelOctree::BrickWords(brickLevels);
+                            t[lane] = std::min(t[lane], TraceBrick(p, lane, data, child, entry[lane], exit[lane], t[lane], axis));
+                        }
+                    }
+
+                    if (brickBits)
+                        p.t = Load(t);
+                }
+
+                if (!brick && Bits(descend))
+                    Visit(p, childSlot, child, depth + 1, descend);
+            }
+        }
+    };
+
+    float MinComponent(glm::vec3 p) { return std::min(p.x, std::min(p.y, p.z)); }
+    float MaxComponent(glm::vec3 p) { return std::max(p.x, std::max(p.y, p.z)); }
+
+    // raymarch.comp's RayMarch loop, line for line, in world units with the root at [0, size]
+    struct ShaderLoop {
+        const uint32_t* buffer;
+        const uint32_t* far;
+        const uint32_t* distances;
+        uint32_t slotWords;
+        float size;
+        int leafDepth;
+        int brickLevels;
+        int distanceLevel;      // 0 steps through empty space sibling by sibling
+
+        bool IsValid(uint32_t parent, uint32_t idx) const {
+            return idx < 8 && ((parent >> idx) & 1) != 0;
+        }
+
+        uint32_t ChildSlot(uint32_t parent, uint32_t idx, uint32_t pIndex) const {
+            uint32_t shift = std::popcount(parent & 0xFF & ((1u << idx) - 1));
+            if (slotWords == 2)
+                return buffer[2 * (size_t)pIndex + 1] + shift;
+            if ((parent >> 16) & 1)
+                return far[parent >> 17] + shift + pIndex;
+            return (parent >> 17) + shift + pIndex;
+        }
+
+        static uint32_t SelectChild(glm::vec3 ro, glm::vec3 rd, glm::uvec3& positions, float nodeSize, float tmin) {
+            glm::vec3 p = ro + rd * tmin;
+            glm::uvec3 childPos = glm::uvec3(glm::clamp(glm::round((p - glm::vec3(positions) * nodeSize) / nodeSize), 0.f, 1.f));
+            positions = (positions << 1u) | childPos;
+            return childPos.x | (childPos.y << 1) | (childPos.z << 2);
+        }
+
+        static bool LeavesParent(glm::vec3 rd, glm::uvec3 old, glm::uvec3 pos) {
+            for (int axis = 0; axis < 3; axis++) {
+                if ((rd[axis] > 0 && pos[axis] < old[axis]) || (rd[axis] < 0 && pos[axis] > old[axis]))
+                    return true;
+            }
+            return false;
+        }
+
+        // Where the ray leaves the empty box around the distance grid cell it is in at tmin. A cell at
+        // distance d has only empty cells closer than d around it; below 2 the ray could be in the
+        // neighbouring cell by rounding, so tmin comes back unchanged.
+        float SkipEmpty(glm::vec3 ro, glm::vec3 rd, glm::vec3 rdInv, glm::vec3 rSign, float tmin) const {
+            int cells = 1 << distanceLevel;
+            float cellSize = size / cells;
+            glm::ivec3 c = glm::clamp(glm::ivec3(glm::floor((ro + rd * tmin) / cellSize)), glm::ivec3(0), glm::ivec3(cells - 1));
+            uint32_t i = c.x + (c.y + c.z * cells) * cells;
+            int d = (distances[i >> 2] >> ((i & 3) * 8)) & 0xFF;
+            if (d < 2)
+                return tmin;
+
+            glm::vec3 lo = glm::vec3(c - (d - 1)) * cellSize, hi = glm::vec3(c + d) * cellSize;
+            return MinComponent((rSign * hi + (1.f - rSign) * lo - ro) * rdInv);
+        }
+
+        // Iterations until the ray stops, t is where it hit a leaf or INFINITY
+        int Run(glm::vec3 ro, glm::vec3 rd, float& t) const {
+            glm::vec3 rdInv = 1.f / rd;
+            glm::vec3 rSign = glm::step(0.f, glm::sign(rd));
+            float tmin = std::max(0.f, MaxComponent(((1.f - rSign) * size - ro) * rdInv));
+            float tmax = MinComponent((rSign * size - ro) * rdInv);
+            t = INFINITY;
+
+            struct StackEntry {
+                uint32_t node, pIndex;
+            } stack[morton::MaxBitsPerAxis + 1];
+            int stackPtr = 0;
+
+            glm::uvec3 positions(0);
+            uint32_t parent = buffer[0], pIndex = 0;
+            uint32_t idx = SelectChild(ro, rd, positions, size, tmin);
+            int depth = 1;
+
+            for (int i = 0; i < CpuRaymarcher::MaxShaderIterations; i++) {
+                if (tmin > tmax || tmax < 0)
+                    return i;
+                float nodeSize = size / (float)(1u << depth);
+                glm::vec3 tc = (glm::vec3(positions) * nodeSize + rSign * nodeSize - ro) * rdInv;
+                float tcMax = MinComponent(tc);
+
+                bool valid = IsValid(parent, idx);
+                if (valid && (depth == leafDepth || (brickLevels > 0 && depth == leafDepth - brickLevels))) {
+                    t = tmin;
+                    return i + 1;
+                }
+
+                if (valid) {
+                    stack[stackPtr++] = { parent, pIndex };
+                    pIndex = ChildSlot(parent, idx, pIndex);
+                    parent = buffer[(size_t)pIndex * slotWords];
+                    idx = SelectChild(ro, rd, positions, nodeSize, tmin);
+                    depth++;
+                    continue;
+                }
+
+                if (distanceLevel > 0 && idx < 8) {
+                    float skip = SkipEmpty(ro, rd, rdInv, rSign, tmin);
+                    if (skip >= tmax)
+                        return i + 1;
+                    if (skip > tcMax) {
+                        tmin = skip;
+                        positions = glm::uvec3(0);
+                        stackPtr = 0;
+                        parent = buffer[0];
+                        pIndex = 0;
+                        depth = 1;
+                        idx = SelectChild(ro, rd, positions, size, tmin);
+                        continue;
+                    }
+                }
+
+                glm::uvec3 oldPos = positions & 1u;
+                glm::uvec3 pos = glm::uvec3(tcMax == tc.x, tcMax == tc.y, tcMax == tc.z) ^ oldPos;
+                positions = (positions & ~1u) | pos;
+                if (LeavesParent(rd, oldPos, pos)) {
+                    if (stackPtr == 0)
+                        return i + 1;
+                    positions >>= 1u;
+                    idx = 255;
+                    depth--;
+                    stackPtr--;
+                    parent = stack[stackPtr].node;
+                    pIndex = stack[stackPtr].pIndex;
+                }
+                else {
+                    idx = pos.x + 2 * pos.y + 4 * pos.z;
+                    tmin = tcMax;
+                }
+            }
+            return CpuRaymarcher::MaxShaderIterations;
+        }
+    };
+}
+
+CpuCamera CpuCamera::LookAt(glm::vec3 position, glm::vec3 target, float verticalFov) {
+    CpuCamera camera;
+    camera.position = position;
+    camera.forward = glm::normalize(target - position);
+    camera.right = glm::normalize(glm::cross(camera.forward, glm::vec3(0.f, 1.f, 0.f)));
+    camera.up = glm::cross(camera.right, camera.forward);
+    camera.verticalFov = verticalFov;
+    return camera;
+}
+
+glm::vec3 CpuCamera::Direction(float x, float y, int width, int height) const {
+    float scale = std::tan(verticalFov / 2);
+    float u = (2 * x / width - 1) * scale * width / height;
+    float v = (1 - 2 * y / height) * scale;
+    return glm::normalize(forward + u * right + v * up);
+}
+
+float CpuCamera::PixelAngle(int height) const {
+    return 2 * std::tan(verticalFov / 2) / height;
+}
+
+bool CpuFrame::WritePng(const std::filesystem::path& path) const {
+    return stbi_write_png(path.string().c_str(), width, height, 4, color.data(), width * sizeof(uint32_t)) != 0;
+}
+
+CpuRaymarcher::CpuRaymarcher(const SparseVoxelOctree& tree)
+    : CpuRaymarcher(tree.m_Buffer, tree.m_Far, tree.m_Attributes, tree.GetSize(), tree.GetMaxDepth(), tree.m_Bricks, tree.GetBufferBrickLevels(),
+        tree.m_Distances, tree.GetBufferDistanceLevel(), tree.GetBufferFormat(), tree.GetBufferAttributeFormat()) {}
+
+CpuRaymarcher::CpuRaymarcher(std::span<const uint32_t> buffer, std::span<const uint32_t> far, std::span<const uint32_t> attributes, int size, int maxDepth,
+    std::span<const uint32_t> bricks, int brickLevels, std::span<const uint32_t> distances, int distanceLevel, DescriptorFormat format,
+    AttributeFormat attributeFormat)
+    : m_Buffer(buffer), m_Far(far), m_Attributes(attributes), m_Bricks(bricks), m_Distances(distances), m_Size(size), m_MaxDepth(maxDepth),
+    m_BrickLevels(brickLevels), m_DistanceLevel(distances.empty() ? 0 : distanceLevel), m_SlotWords(SparseVoxelOctree::SlotWords(format)),
+    m_ColorNormals(attributeFormat == AttributeFormat::ColorNormal) {}
+
+const char* CpuRaymarcher::GetInstructionSet() {
+    return InstructionSet;
+}
+
+int CpuRaymarcher::GetPacketWidth() {
+    return Lanes;
+}
+
+CpuRenderStats CpuRaymarcher::Render(const CpuCamera& camera, CpuFrame& frame, const CpuRenderSettings& settings) const {
+    constexpr int TileSize = 16;
+    static_assert(TileSize % Lanes == 0, "packets must not straddle tiles");
+
+    int width = frame.width, height = frame.height;
+    frame.color.assign((size_t)width * height, 0);
+    frame.distance.assign((size_t)width * height, INFINITY);
+
+    float cells = (float)(1u << m_MaxDepth);
+    float toCells = cells / m_Size;
+    glm::vec3 origin = (camera.position + glm::vec3(m_Size / 2.f)) * toCells;
+    bool empty = m_Buffer.empty() || m_MaxDepth == 0;
+
+    glm::vec3 center = camera.Direction(width / 2.f, height / 2.f, width, height);
+    int octant = (center.x < 0 ? 1 : 0) | (center.y < 0 ? 2 : 0) | (center.z < 0 ? 4 : 0);
+
+    int tilesX = (width + TileSize - 1) / TileSize, tilesY = (height + TileSize - 1) / TileSize;
+    std::atomic<uint64_t> packets = 0, nodeTests = 0;
+
+    auto renderTile = [&](size_t tile) {
+        Traversal traversal{ m_Buffer.data(), m_Far.data(), m_Bricks.data(), m_SlotWords, m_MaxDepth, m_BrickLevels, octant,
+            settings.lod ? camera.PixelAngle(height) * toCells : 0.f };
+        uint64_t tilePackets = 0;
+
+        int x0 = (int)(tile % tilesX) * TileSize, y0 = (int)(tile / tilesX) * TileSize;
+        for (int y = y0; y < std::min(y0 + TileSize, height); y++) {
+            for (int x = x0; x < std::min(x0 + TileSize, width); x += Lanes) {
+                Packet p;
+                glm::vec3 directions[Lanes];
+                float inverse[3][Lanes], originT[3][Lanes], valid[Lanes];
+                for (int lane = 0; lane < Lanes; lane++) {
+                    directions[lane] = camera.Direction(x + lane + 0.5f, y + 0.5f, width, height);
+                    valid[lane] = x + lane < width ? 1.f : 0.f;
+
+                    for (int axis = 0; axis < 3; axis++) {
+                        // A tiny step instead of zero keeps 0 * inf out of the slab distances
+                        float d = directions[lane][axis] * toCells;
+                        d = d < 0 ? std::min(d, -1e-30f) : std::max(d, 1e-30f);
+                        inverse[axis][lane] = 1.f / d;
+                        originT[axis][lane] = -origin[axis] / d;
+                        p.origin[axis][lane] = origin[axis];
+                        p.direction[axis][lane] = d;
+                    }
+                }
+
+                p.t = Splat(INFINITY);
+                for (int axis = 0; axis < 3; axis++) {
+                    p.inverse[axis] = Load(inverse[axis]);
+                    p.originT[axis] = Load(originT[axis]);
+                }
+
+                if (!empty) {
+                    Float tNear = Splat(-INFINITY), tFar = Splat(INFINITY);
+                    for (int axis = 0; axis < 3; axis++) {
+                        Float a = p.originT[axis], b = Splat(cells) * p.inverse[axis] + p.originT[axis];
+                        tNear = Max(tNear, Min(a, b));
+                        tFar = Min(tFar, Max(a, b));
+                    }
+
+                    Mask active = (Splat(0.5f) < Load(valid)) & (tNear <= tFar) & (Splat(0.f) <= tFar);
+                    if (Bits(active))
+                        traversal.Visit(p, 0, glm::uvec3(0), 0, active);
+                    tilePackets++;
+                }
+
+                float t[Lanes];
+                Store(t, p.t);
+                for (int lane = 0; lane < Lanes && x + lane < width; lane++) {
+                    glm::vec3 rd = directions[lane];
+                    glm::vec3 col;
+                    if (t[lane] != INFINITY) {
+                        glm::vec3 normal(0.f);
+                        if (int axis = p.axis[lane]; axis < 3)
+                            normal[axis] = rd[axis] < 0 ? 1.f : -1.f;
+
+                        uint32_t attributes = m_Attributes[p.slot[lane]];
+                        if (m_ColorNormals)
+                            normal = UnpackNormal((attributes >> 16) & 0xFFF);
+
+                        float diffuse = std::max(glm::dot(normal, SunLight), 0.f);
+                        col = (m_ColorNormals ? UnpackColor565(attributes) : UnpackColor(attributes)) * (0.3f + 0.7f * diffuse);
+                    }
+                    else
+                        col = Sky(rd);
+
+                    col = (1.f - glm::exp(-col * 6.f)) * 1.0024f;
+
+                    size_t pixel = (size_t)y * width + x + lane;
+                    frame.color[pixel] = PackColor(col);
+                    frame.distance[pixel] = t[lane];
+                }
+            }
+        }
+
+        packets.fetch_add(tilePackets, std::memory_order_relaxed);
+        nodeTests.fetch_add(traversal.nodeTests, std::memory_order_relaxed);
+    };
+
+    size_t tileCount = (size_t)tilesX * tilesY;
+    CpuRenderStats stats;
+    stats.rays = (uint64_t)width * height;
+
+    auto start = std::chrono::steady_clock::now();
+    if (settings.multithreaded) {
+        stats.threads = (unsigned)std::min<size_t>(parallel::ThreadCount(), std::max<size_t>(tileCount, 1));
+        parallel::For(tileCount, renderTile);
+    }
+    else {
+        for (size_t tile = 0; tile < tileCount; tile++)
+            renderTile(tile);
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stats.packets = packets.load(std::memory_order_relaxed);
+    stats.nodeTests = nodeTests.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::vector<uint16_t> CpuRaymarcher::CountShaderIterations(const CpuCamera& camera, CpuFrame& frame, bool distanceHints) const {
+    int width = frame.width, height = frame.height;
+    std::vector<uint16_t> iterations((size_t)width * height, 0);
+    frame.color.assign((size_t)width * height, PackColor(glm::vec3(0.f)));
+    frame.distance.assign((size_t)width * height, INFINITY);
+    if (m_Buffer.empty() || m_MaxDepth == 0)
+        return iterations;
+
+    ShaderLoop loop{ m_Buffer.data(), m_Far.data(), m_Distances.data(), m_SlotWords, (float)m_Size, m_MaxDepth, m_BrickLevels,
+        distanceHints ? m_DistanceLevel : 0 };
+    glm::vec3 origin = camera.position + glm::vec3(m_Size / 2.f);
+
+    parallel::For((size_t)height, [&](size_t y) {
+        for (int x = 0; x < width; x++) {
+            glm::vec3 rd = camera.Direction(x + 0.5f, y + 0.5f, width, height);
+            // The shader would divide 0 by 0 where a component is exactly zero
+            for (int axis = 0; axis < 3; axis++)
+                rd[axis] = rd[axis] < 0 ? std::min(rd[axis], -1e-30f) : std::max(rd[axis], 1e-30f);
+
+            size_t pixel = y * width + x;
+            iterations[pixel] = (uint16_t)loop.Run(origin, rd, frame.distance[pixel]);
+            frame.color[pixel] = PackColor(glm::vec3((float)iterations[pixel] / MaxShaderIterations));
+        }
+    });
+    return iterations;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vk_types.h>
+#include <filesystem>
+#include <svo.h>
+
+struct CpuCamera {
+    glm::vec3 position{ 0.f };
+    glm::vec3 forward{ 0.f, 0.f, 1.f }, right{ 1.f, 0.f, 0.f }, up{ 0.f, 1.f, 0.f };
+    float verticalFov = 1.f;    // radians
+
+    static CpuCamera LookAt(glm::vec3 position, glm::vec3 target, float verticalFov);
+
+    // Normalized direction through a point of the image, pixel centers are at +0.5
+    glm::vec3 Direction(float x, float y, int width, int height) const;
+    // Angle one pixel subtends at the center of the image
+    float PixelAngle(int height) const;
+};
+
+struct CpuRenderSettings {
+    // Stops at nodes smaller than a pixel and draws their filtered attributes, like raymarch.comp
+    bool lod = true;
+    // Renders tiles on every thread, otherwise only on the calling one
+    bool multithreaded = true;
+};
+
+struct CpuFrame {
+    int width = 0, height = 0;
+    std::vector<uint32_t> color;        // RGBA8, row by row from the top
+    std::vector<float> distance;        // world units to the first hit, INFINITY where the sky shows
+
+    bool WritePng(const std::filesystem::path& path) const;
+};
+
+struct CpuRenderStats {
+    double seconds = 0;
+    uint64_t rays = 0;
+    unsigned threads = 1;
+    uint64_t packets = 0;
+    uint64_t nodeTests = 0;     // child boxes tested, each against a whole packet
+
+    double RaysPerSecond() const { return rays / seconds; }
+    double RaysPerSecondPerThread() const { return rays / seconds / threads; }
+};
+
+// Reference implementation of raymarch.comp's traversal and shading over a serialized buffer, for
+// machines without a GPU and as a baseline to profile against. Rays are traced in packets as wide as
+// the instruction set the build targets: eight lanes with AVX2, four with SSE, one otherwise. A packet
+// descends into a child when any of its lanes still needs it and keeps the closest hit per lane, so
+// lanes may point in different directions; children are visited front to back for the packet's center
+// ray. Partially covered nodes are drawn opaque instead of composited. Bricks are stepped through
+// voxel by voxel, one lane at a time.
+//
+// CountShaderIterations runs a scalar port of the shader's own loop instead, to measure what it costs
+// per pixel.
+class CpuRaymarcher {
+public:
+    explicit CpuRaymarcher(const SparseVoxelOctree& tree);
+    CpuRaymarcher(std::span<const uint32_t> buffer, std::span<const uint32_t> far, std::span<const uint32_t> attributes, int size, int maxDepth,
+        std::span<const uint32_t> bricks = {}, int brickLevels = 0, std::span<const uint32_t> distances = {}, int distanceLevel = 0,
+        DescriptorFormat format = DescriptorFormat::Compact, AttributeFormat attributeFormat = AttributeFormat::RGBA8);
+
+    CpuRenderStats Render(const CpuCamera& camera, CpuFrame& frame, const CpuRenderSettings& settings = {}) const;
+    // MAX_ITERATIONS in raymarch.comp
+    static constexpr int MaxShaderIterations = 500;
+
+    // Iterations raymarch.comp's RayMarch loop takes for every pixel, row by row from the top, with LOD
+    // off. Leaves and brick roots end the ray. The frame gets the shader's iteration view as its color
+    // and where the loop stopped as its distance. distanceHints skips empty space with the distance
+    // field, if the buffer has one.
+    std::vector<uint16_t> CountShaderIterations(const CpuCamera& camera, CpuFrame& frame, bool distanceHints) const;
+
+    // "AVX2", "SSE" or "scalar", and how many rays a packet holds
+    static const char* GetInstructionSet();
+    static int GetPacketWidth();
+
+private:
+    std::span<const uint32_t> m_Buffer, m_Far, m_Attributes, m_Bricks, m_Distances;
+    int m_Size, m_MaxDepth, m_BrickLevels, m_DistanceLevel;
+    uint32_t m_SlotWords;
+    // Shades with the stored normals instead of the face the ray entered through
+    bool m_ColorNormals;
+};
@@ -0,0 +1,112 @@
+#include "raymarch_pipelines.h"
+
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+#include <cstddef>
+
+namespace {
+    constexpr uint32_t Tree = offsetof(RaymarchConstants, tree);
+    // raymarch.comp's constant_ids
+    const VkSpecializationMapEntry SpecializationEntries[] = {
+        { 0, Tree + offsetof(SvoShaderConstants, leafDepth), sizeof(SvoShaderConstants::leafDepth) },
+        { 1, Tree + offsetof(SvoShaderConstants, size), sizeof(SvoShaderConstants::size) },
+        { 2, Tree + offsetof(SvoShaderConstants, wideDescriptors), sizeof(SvoShaderConstants::wideDescriptors) },
+        { 3, Tree + offsetof(SvoShaderConstants, colorNormals), sizeof(SvoShaderConstants::colorNormals) },
+        { 4, offsetof(RaymarchConstants, esvo), sizeof(RaymarchConstants::esvo) },
+        { 5, offsetof(RaymarchConstants, maxIterations), sizeof(RaymarchConstants::maxIterations) },
+        { 6, offsetof(RaymarchConstants, heatmap), sizeof(RaymarchConstants::heatmap) },
+        { 7, offsetof(RaymarchConstants, lighting), sizeof(RaymarchConstants::lighting) },
+        { 8, Tree + offsetof(SvoShaderConstants, brickLevels), sizeof(SvoShaderConstants::brickLevels) },
+        { 9, Tree + offsetof(SvoShaderConstants, distanceLevel), sizeof(SvoShaderConstants::distanceLevel) },
+    };
+}
+
+RaymarchConstants RaymarchConstants::For(const SvoShaderConstants& tree, uint32_t features) {
+    RaymarchConstants constants;
+    constants.tree = tree;
+    constants.esvo = (features & RaymarchEsvo) != 0;
+    constants.heatmap = (features & RaymarchHeatmap) != 0;
+    constants.lighting = (features & RaymarchLighting) != 0;
+    return constants;
+}
+
+VkSpecializationInfo RaymarchPipelines::GetSpecializationInfo(const RaymarchConstants& constants) {
+    VkSpecializationInfo info{};
+    info.mapEntryCount = (uint32_t)std::size(SpecializationEntries);
+    info.pMapEntries = SpecializationEntries;
+    info.dataSize = sizeof(RaymarchConstants);
+    info.pData = &constants;
+    return info;
+}
+
+RaymarchPipelines::RaymarchPipelines(VkDevice device, VkDescriptorSetLayout layout, const char* shaderPath) : m_Device(device) {
+    VkPushConstantRange pushConstant{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants) };
+    VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &layout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstant;
+    VK_CHECK(vkCreatePipelineLayout(m_Device, &layoutInfo, nullptr, &m_Layout));
+
+    VkPipelineCacheCreateInfo cacheInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    VK_CHECK(vkCreatePipelineCache(m_Device, &cacheInfo, nullptr, &m_Cache));
+
+    if (!vkutil::load_shader_module(shaderPath, m_Device, &m_Shader)) {
+        fmt::println("Error when building the compute shader \n");
+        m_Shader = VK_NULL_HANDLE;
+    }
+}
+
+RaymarchPipelines::~RaymarchPipelines() {
+    Destroy();
+}
+
+void RaymarchPipelines::Destroy() {
+    for (auto& [features, pipeline] : m_Variants)
+        vkDestroyPipeline(m_Device, pipeline, nullptr);
+    m_Variants.clear();
+
+    if (m_Shader != VK_NULL_HANDLE)
+        vkDestroyShaderModule(m_Device, m_Shader, nullptr);
+    if (m_Cache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(m_Device, m_Cache, nullptr);
+    if (m_Layout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(m_Device, m_Layout, nullptr);
+    m_Shader = VK_NULL_HANDLE;
+    m_Cache = VK_NULL_HANDLE;
+    m_Layout = VK_NULL_HANDLE;
+}
+
+void RaymarchPipelines::SetTreeConstants(const SvoShaderConstants& tree, DeletionQueue& retired) {
+    if (tree == m_Tree)
+        return;
+
+    for (auto& [features, pipeline] : m_Variants) {
+        VkDevice device = m_Device;
+        VkPipeline old = pipeline;
+        retired.push_function([=]() { vkDestroyPipeline(device, old, nullptr); });
+    }
+    m_Variants.clear();
+    m_Tree = tree;
+}
+
+VkPipeline RaymarchPipelines::Get(uint32_t features) {
+    features &= RaymarchFeatureMask;
+    if (auto it = m_Variants.find(features); it != m_Variants.end())
+        return it->second;
+    if (m_Shader == VK_NULL_HANDLE)
+        return VK_NULL_HANDLE;
+
+    RaymarchConstants constants = RaymarchConstants::For(m_Tree, features);
+    VkSpecializationInfo specializationInfo = GetSpecializationInfo(constants);
+
+    VkComputePipelineCreateInfo pipelineInfo = { .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    pipelineInfo.layout = m_Layout;
+    pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, m_Shader);
+    pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+
+    VkPipeline pipeline;
+    VK_CHECK(vkCreateComputePipelines(m_Device, m_Cache, 1, &pipelineInfo, nullptr, &pipeline));
+    m_Variants.emplace(features, pipeline);
+    return pipeline;
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vk_types.h>
+#include <svo.h>
+#include <unordered_map>
+
+// Features a raymarch pipeline variant is built with, combined into a bitmask. Each one is a
+// specialization constant of raymarch.comp, so a variant without it has none of its code.
+enum RaymarchFeature : uint32_t {
+    RaymarchEsvo = 1 << 0,          // Laine and Karras' traversal instead of RayMarch's per-level stack
+    RaymarchHeatmap = 1 << 1,       // iterations per pixel as a fraction of RaymarchMaxIterations
+    RaymarchLighting = 1 << 2,      // sun diffuse on surfaces, flat colors without
+    RaymarchFeatureMask = (1 << 3) - 1,
+};
+
+// What the engine draws unless asked for something else
+constexpr uint32_t RaymarchProduction = RaymarchLighting;
+// Bound of the traversal loops
+constexpr int32_t RaymarchMaxIterations = 500;
+// The octree kernel, and the 64-ary tree's
+constexpr const char* RaymarchShader = "shaders/raymarch.comp.spv";
+constexpr const char* Raymarch64Shader = "shaders/raymarch64.comp.spv";
+
+// Everything a raymarch pipeline is specialized for
+struct RaymarchConstants {
+    SvoShaderConstants tree;
+    uint32_t esvo = 0;          // VkBool32
+    int32_t maxIterations = RaymarchMaxIterations;
+    uint32_t heatmap = 0;       // VkBool32
+    uint32_t lighting = 1;      // VkBool32
+
+    static RaymarchConstants For(const SvoShaderConstants& tree, uint32_t features);
+};
+
+// raymarch.comp's variants for one tree's constants, keyed by their RaymarchFeature mask. Each is
+// specialized from the same shader module the first time it is asked for, through a VkPipelineCache
+// shared by all of them, and kept until the tree's constants change. Variants share one pipeline
+// layout, with the push constants and the descriptor layout SvoResidency binds. Another kernel with
+// the same interface, such as raymarch64.comp, can be specialized instead; the constant_ids it does
+// not declare are ignored.
+class RaymarchPipelines {
+public:
+    RaymarchPipelines(VkDevice device, VkDescriptorSetLayout layout, const char* shaderPath = RaymarchShader);
+    ~RaymarchPipelines();
+
+    void Destroy();
+
+    // False if the shader could not be loaded, in which case Get has nothing to build
+    bool IsValid() const { return m_Shader != VK_NULL_HANDLE; }
+
+    // Retires the variants built for other constants into retired, which must outlive the frames in
+    // flight that may use them
+    void SetTreeConstants(const SvoShaderConstants& tree, DeletionQueue& retired);
+    const SvoShaderConstants& GetTreeConstants() const { return m_Tree; }
+
+    // The variant for features, built now if it was not yet. VK_NULL_HANDLE if the shader is missing.
+    VkPipeline Get(uint32_t features);
+    VkPipelineLayout GetLayout() const { return m_Layout; }
+    size_t GetVariantCount() const { return m_Variants.size(); }
+
+    // Specializes raymarch.comp for constants, which must outlive the returned info
+    static VkSpecializationInfo GetSpecializationInfo(const RaymarchConstants& constants);
+
+private:
+    VkDevice m_Device;
+    VkPipelineLayout m_Layout = VK_NULL_HANDLE;
+    VkPipelineCache m_Cache = VK_NULL_HANDLE;
+    VkShaderModule m_Shader = VK_NULL_HANDLE;
+    SvoShaderConstants m_Tree;
+    std::unordered_map<uint32_t, VkPipeline> m_Variants;
+};
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "svo_residency.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace {
+    // Storage buffers may not be empty, so absent arrays get the smallest buffer, zeroed
+    constexpr VkDeviceSize MinBufferBytes = 16;
+
+    void RecordBarrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess) {
+        VkMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+        barrier.srcStageMask = srcStage;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstStageMask = dstStage;
+        barrier.dstAccessMask = dstAccess;
+
+        VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+        depInfo.memoryBarrierCount = 1;
+        depInfo.pMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2(cmd, &depInfo);
+    }
+}
+
+VkDeviceSize SvoResidency::GetBeamBufferSize(VkExtent2D extent) {
+    VkDeviceSize columns = (extent.width + BeamTileSize - 1) / BeamTileSize + 1;
+    VkDeviceSize rows = (extent.height + BeamTileSize - 1) / BeamTileSize + 1;
+    return columns * rows * sizeof(float);
+}
+
+uint32_t SvoResidency::GetPersistentGroups(VkPhysicalDevice device) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, extensions.data());
+    auto supports = [&](const char* name) {
+        return std::any_of(extensions.begin(), extensions.end(), [&](const VkExtensionProperties& e) { return strcmp(e.extensionName, name) == 0; });
+    };
+
+    VkPhysicalDeviceProperties2 properties = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+    VkPhysicalDeviceShaderCorePropertiesAMD amd = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_CORE_PROPERTIES_AMD };
+    VkPhysicalDeviceShaderSMBuiltinsPropertiesNV nv = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_SM_BUILTINS_PROPERTIES_NV };
+    if (supports(VK_AMD_SHADER_CORE_PROPERTIES_EXTENSION_NAME)) {
+        amd.pNext = properties.pNext;
+        properties.pNext = &amd;
+    }
+    if (supports(VK_NV_SHADER_SM_BUILTINS_EXTENSION_NAME)) {
+        nv.pNext = properties.pNext;
+        properties.pNext = &nv;
+    }
+    vkGetPhysicalDeviceProperties2(device, &properties);
+
+    uint32_t units, threadsPerUnit;
+    if (amd.shaderEngineCount > 0) {
+        units = amd.shaderEngineCount * amd.shaderArraysPerEngineCount * amd.computeUnitsPerShaderArray;
+        threadsPerUnit = amd.simdPerComputeUnit * amd.wavefrontsPerSimd * amd.wavefrontSize;
+    }
+    else if (nv.shaderSMCount > 0) {
+        units = nv.shaderSMCount;
+        threadsPerUnit = nv.shaderWarpsPerSM * 32;
+    }
+    else if (properties.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+        units = std::max(std::thread::hardware_concurrency(), 1u);
+        threadsPerUnit = GroupSize * GroupSize;
+    }
+    else {
+        units = properties.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? 32 : 8;
+        threadsPerUnit = 2 * GroupSize * GroupSize;
+    }
+    return units * std::max(threadsPerUnit / (GroupSize * GroupSize), 1u);
+}
+
+SvoResidency::SvoResidency(VkDevice device, VmaAllocator allocator, VkDescriptorSetLayout layout, DescriptorAllocator& descriptors, uint32_t framesInFlight)
+    : m_Device(device), m_Allocator(allocator), m_FramesInFlight(framesInFlight) {
+    for (Slot& slot : m_Slots)
+        slot.set = descriptors.allocate(device, layout);
+
+    m_Queue = CreateBuffer(MinBufferBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    VkDescriptorBufferInfo queueInfo{ m_Queue.buffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet writes[2];
+    for (int i = 0; i < 2; i++) {
+        writes[i] = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        writes[i].dstSet = m_Slots[i].set;
+        writes[i].dstBinding = QueueBinding;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &queueInfo;
+    }
+    vkUpdateDescriptorSets(m_Device, 2, writes, 0, nullptr);
+}
+
+SvoResidency::~SvoResidency() {
+    Destroy();
+}
+
+void SvoResidency::Destroy() {
+    for (Slot& slot : m_Slots) {
+        for (uint32_t i = 0; i < ArrayCount; i++) {
+            DestroyBuffer(slot.arrays[i]);
+            slot.capacity[i] = 0;
+        }
+        slot.readUntil = 0;
+    }
+    DestroyBuffer(m_Staged.staging);
+    DestroyBuffer(m_Queue);
+    m_Active = NoSlot;
+}
+
+AllocatedBuffer SvoResidency::CreateBuffer(VkDeviceSize bytes, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage) const {
+    VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufferInfo.size = bytes;
+    bufferInfo.usage = usage;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = memoryUsage;
+    if (memoryUsage == VMA_MEMORY_USAGE_CPU_ONLY)
+        allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    AllocatedBuffer buffer;
+    VK_CHECK(vmaCreateBuffer(m_Allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &buffer.info));
+    return buffer;
+}
+
+void SvoResidency::DestroyBuffer(AllocatedBuffer& buffer) const {
+    if (buffer.buffer != VK_NULL_HANDLE)
+        vmaDestroyBuffer(m_Allocator, buffer.buffer, buffer.allocation);
+    buffer = {};
+}
+
+void SvoResidency::Stage(const SparseVoxelOctree& tree) {
+    const std::span<const uint32_t> arrays[ArrayCount] = { tree.m_Buffer, tree.m_Far, tree.m_Attributes, tree.m_Bricks, tree.m_Distances };
+    Stage(tree.GetShaderConstants(), arrays);
+}
+
+void SvoResidency::Stage(const SvoShaderConstants& constants, const std::span<const uint32_t> (&arrays)[ArrayCount]) {
+    // Nothing has read a staged version yet, so it can go right away
+    DestroyBuffer(m_Staged.staging);
+
+    VkDeviceSize total = 0;
+    for (uint32_t i = 0; i < ArrayCount; i++) {
+        m_Staged.offset[i] = total;
+        m_Staged.bytes[i] = std::max<VkDeviceSize>(arrays[i].size_bytes(), MinBufferBytes);
+        total += m_Staged.bytes[i];
+    }
+
+    m_Staged.staging = CreateBuffer(total, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    char* mapped = (char*)m_Staged.staging.info.pMappedData;
+    for (uint32_t i = 0; i < ArrayCount; i++) {
+        memset(mapped + m_Staged.offset[i], 0, m_Staged.bytes[i]);
+        memcpy(mapped + m_Staged.offset[i], arrays[i].data(), arrays[i].size_bytes());
+    }
+    vmaFlushAllocation(m_Allocator, m_Staged.staging.allocation, 0, total);
+
+    m_Staged.constants = constants;
+}
+
+// Buffers are only ever replaced in a slot no frame in flight reads, and get a quarter more room than
+// they need so edits can grow them in place
+void SvoResidency::Fit(Slot& slot) {
+    VkDescriptorBufferInfo infos[ArrayCount];
+    VkWriteDescriptorSet writes[ArrayCount];
+    for (uint32_t i = 0; i < ArrayCount; i++) {
+        VkDeviceSize bytes = m_Staged.bytes[i];
+        if (slot.capacity[i] < bytes) {
+            DestroyBuffer(slot.arrays[i]);
+            slot.capacity[i] = bytes + bytes / 4;
+            slot.arrays[i] = CreateBuffer(slot.capacity[i], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        }
+
+        infos[i] = { slot.arrays[i].buffer, 0, VK_WHOLE_SIZE };
+        writes[i] = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        writes[i].dstSet = slot.set;
+        writes[i].dstBinding = FirstBinding + i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &infos[i];
+    }
+
+    vkUpdateDescriptorSets(m_Device, ArrayCount, writes, 0, nullptr);
+}
+
+bool SvoResidency::Record(VkCommandBuffer cmd, uint64_t frame, DeletionQueue& frameDeletion) {
+    auto markRead = [&]() {
+        if (m_Active != NoSlot)
+            m_Slots[m_Active].readUntil = frame + 1;
+    };
+
+    uint32_t next = m_Active == NoSlot ? 0 : 1 - m_Active;
+    // The frame's fence wait covered every frame at least m_FramesInFlight before it
+    if (!HasStaged() || (m_Slots[next].readUntil != 0 && m_Slots[next].readUntil + m_FramesInFlight > frame + 1)) {
+        markRead();
+        return false;
+    }
+
+    Slot& slot = m_Slots[next];
+    Fit(slot);
+
+    m_UploadedBytes = 0;
+    for (uint32_t i = 0; i < ArrayCount; i++) {
+        VkBufferCopy copy{ m_Staged.offset[i], 0, m_Staged.bytes[i] };
+        vkCmdCopyBuffer(cmd, m_Staged.staging.buffer, slot.arrays[i].buffer, 1, &copy);
+        m_UploadedBytes += m_Staged.bytes[i];
+    }
+
+    VkMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+    VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    depInfo.memoryBarrierCount = 1;
+    depInfo.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+
+    AllocatedBuffer staging = m_Staged.staging;
+    VmaAllocator allocator = m_Allocator;
+    frameDeletion.push_function([=]() { vmaDestroyBuffer(allocator, staging.buffer, staging.allocation); });
+    m_Staged.staging = {};
+
+    slot.constants = m_Staged.constants;
+    m_Active = next;
+    m_Version++;
+    markRead();
+    return true;
+}
+
+void SvoResidency::SetTargets(VkImageView image, VkBuffer beam) {
+    VkDescriptorImageInfo imgInfo{};
+    imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imgInfo.imageView = image;
+    VkDescriptorBufferInfo beamInfo{ beam, 0, VK_WHOLE_SIZE };
+
+    VkWriteDescriptorSet writes[4];
+    for (int i = 0; i < 2; i++) {
+        writes[2 * i] = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        writes[2 * i].dstSet = m_Slots[i].set;
+        writes[2 * i].dstBinding = 0;
+        writes[2 * i].descriptorCount = 1;
+        writes[2 * i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[2 * i].pImageInfo = &imgInfo;
+
+        writes[2 * i + 1] = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        writes[2 * i + 1].dstSet = m_Slots[i].set;
+        writes[2 * i + 1].dstBinding = BeamBinding;
+        writes[2 * i + 1].descriptorCount = 1;
+        writes[2 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[2 * i + 1].pBufferInfo = &beamInfo;
+    }
+
+    vkUpdateDescriptorSets(m_Device, 4, writes, 0, nullptr);
+}
+
+// raymarch.comp runs 32x32 workgroups, the prepass one invocation per tile corner
+void SvoResidency::Dispatch(VkCommandBuffer cmd, VkPipeline pipeline, VkPipelineLayout layout, ComputePushConstants push, VkExtent2D extent, bool beam, uint32_t persistentGroups) const {
+    uint32_t groupsX = (extent.width + GroupSize - 1) / GroupSize;
+    uint32_t groupsY = (extent.height + GroupSize - 1) / GroupSize;
+    if (persistentGroups > 0) {
+        // The last persistent dispatch, of this frame's predecessor, has to be done with the counter first
+        RecordBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        vkCmdFillBuffer(cmd, m_Queue.buffer, 0, VK_WHOLE_SIZE, 0);
+        RecordBarrier(cmd, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    }
+
+    VkDescriptorSet set = GetDescriptorSet();
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+
+    push.data1.w = 0.f;
+    push.data3.w = beam ? (float)BeamTileSize : 0.f;
+    if (beam) {
+        uint32_t columns = (extent.width + BeamTileSize - 1) / BeamTileSize + 1;
+        uint32_t rows = (extent.height + BeamTileSize - 1) / BeamTileSize + 1;
+        push.data4.w = 1.f;
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &push);
+        vkCmdDispatch(cmd, (columns + GroupSize - 1) / GroupSize, (rows + GroupSize - 1) / GroupSize, 1);
+
+        RecordBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+    }
+
+    push.data4.w = 0.f;
+    if (persistentGroups > 0) {
+        // More groups than blocks would only find the queue empty
+        push.data1.w = 1.f;
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &push);
+        vkCmdDispatch(cmd, std::min(persistentGroups, groupsX * groupsY), 1, 1);
+    }
+    else {
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &push);
+        vkCmdDispatch(cmd, groupsX, groupsY, 1);
+    }
+}
+
+VkDeviceSize SvoResidency::GetResidentBytes() const {
+    VkDeviceSize bytes = 0;
+    for (const Slot& slot : m_Slots) {
+        for (VkDeviceSize capacity : slot.capacity)
+            bytes += capacity;
+    }
+    return bytes;
+}
+
+std::vector<SvoUploadTarget> SvoResidency::GetUpdateTargets(const SparseVoxelOctree& tree, const SvoBufferUpdate& update) const {
+    std::vector<SvoUploadTarget> targets;
+    if (update.full || HasStaged() || !HasVersion())
+        return targets;
+
+    const Slot& slot = m_Slots[m_Active];
+    auto add = [&](Array array, const std::vector<uint32_t>& words, const std::vector<SvoDirtyRange>& ranges) {
+        if (!ranges.empty())
+            targets.push_back({ words, ranges, slot.arrays[array].buffer, slot.capacity[array] });
+    };
+    add(Buffer, tree.m_Buffer, update.buffer);
+    add(Far, tree.m_Far, update.far);
+    add(Attributes, tree.m_Attributes, update.attributes);
+    add(Distances, tree.m_Distances, update.distances);
+    return targets;
+}
\ No newline at end of file
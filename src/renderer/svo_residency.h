@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_descriptors.h>
+#include <svo.h>
+#include <svo_upload.h>
+
+// A tree's serialized arrays in device-local buffers, bound at raymarch.comp's bindings 1-5 in the order
+// of SvoResidency::Array. Two versions are kept, each with its own buffers and descriptor set: frames
+// in flight keep reading the active one while the next is uploaded into the other, and the swap is
+// recorded into the frame that first draws it, so a new tree never waits for the device to go idle.
+//
+// Stage copies a tree into a staging buffer right away, so the tree may change afterwards. Record,
+// once per frame after its fence wait, swaps the staged version in as soon as the slot it goes to is no
+// longer read by any frame in flight. Edits to the active version are patched in place instead, through
+// SvoUploader and GetUpdateTargets.
+//
+// Dispatch records the raymarch, optionally after a beam prepass that traces one coarse ray per corner
+// of every BeamTileSize tile into the beam buffer at BeamBinding, so the full-resolution rays of a tile
+// start close to the first node any of them can hit. The full-resolution pass either covers the image
+// with one workgroup per 32x32 block, or with persistent workgroups that take 8x8 tiles in Morton order
+// from a counter at QueueBinding until none are left, so groups that drew cheap tiles take on more.
+class SvoResidency {
+public:
+    enum Array : uint32_t { Buffer, Far, Attributes, Bricks, Distances, ArrayCount };
+    static constexpr uint32_t FirstBinding = 1;
+    static constexpr uint32_t BeamBinding = FirstBinding + ArrayCount;
+    static constexpr uint32_t BeamTileSize = 8;
+    static constexpr uint32_t QueueBinding = BeamBinding + 1;
+    // raymarch.comp's workgroups are GroupSize pixels square, a persistent one draws QueueTileSize tiles
+    static constexpr uint32_t GroupSize = 32;
+    static constexpr uint32_t QueueTileSize = 8;
+
+    // layout must have the storage image at binding 0 and a storage buffer at every array's binding, at
+    // BeamBinding and at QueueBinding
+    SvoResidency(VkDevice device, VmaAllocator allocator, VkDescriptorSetLayout layout, DescriptorAllocator& descriptors, uint32_t framesInFlight);
+    ~SvoResidency();
+
+    void Destroy();
+
+    // The tree's last CreateBuffer result becomes the next version, replacing one staged earlier that
+    // was not swapped in yet
+    void Stage(const SparseVoxelOctree& tree);
+    // Stages arrays serialized elsewhere, such as by PagedSvo::Assemble, in the order of Array
+    void Stage(const SvoShaderConstants& constants, const std::span<const uint32_t> (&arrays)[ArrayCount]);
+    // Swaps the staged version in if its slot is free by frame, recording the copies into cmd and the
+    // staging buffer's release into frameDeletion. Marks the active version as read by frame either way.
+    // Returns true if it swapped.
+    bool Record(VkCommandBuffer cmd, uint64_t frame, DeletionQueue& frameDeletion);
+    // Writes the storage image and the beam buffer into both versions' sets. Only while no frame is in
+    // flight.
+    void SetTargets(VkImageView image, VkBuffer beam);
+    // Records raymarch.comp over extent with the active version bound, after the beam prepass if beam is
+    // set. persistentGroups workgroups pull tiles from the queue, 0 dispatches one per block instead.
+    // pipeline must be a RaymarchPipelines variant for GetShaderConstants and the image in the GENERAL
+    // layout.
+    void Dispatch(VkCommandBuffer cmd, VkPipeline pipeline, VkPipelineLayout layout, ComputePushConstants push, VkExtent2D extent, bool beam, uint32_t persistentGroups = 0) const;
+
+    bool HasVersion() const { return m_Active != NoSlot; }
+    bool HasStaged() const { return m_Staged.staging.buffer != VK_NULL_HANDLE; }
+    // Counts swaps, 0 before the first
+    uint64_t GetVersion() const { return m_Version; }
+    VkDescriptorSet GetDescriptorSet() const { return m_Slots[m_Active].set; }
+    // What the active version's pipeline must be specialized for
+    const SvoShaderConstants& GetShaderConstants() const { return m_Slots[m_Active].constants; }
+    // Device bytes of both versions' buffers
+    VkDeviceSize GetResidentBytes() const;
+    // Bytes the last swap copied
+    VkDeviceSize GetUploadedBytes() const { return m_UploadedBytes; }
+
+    // Size of the beam buffer for an image of extent, one float per tile corner
+    static VkDeviceSize GetBeamBufferSize(VkExtent2D extent);
+    // Persistent workgroups that keep every compute unit of device busy: the unit count and threads
+    // per unit come from VK_AMD_shader_core_properties or VK_NV_shader_sm_builtins, and are guessed
+    // from the device type without either
+    static uint32_t GetPersistentGroups(VkPhysicalDevice device);
+
+    // Upload targets that patch the active version with an UpdateBuffer result, for SvoUploader::Record.
+    // Empty if the update was full or something is staged, in which case the tree has to be staged whole.
+    std::vector<SvoUploadTarget> GetUpdateTargets(const SparseVoxelOctree& tree, const SvoBufferUpdate& update) const;
+
+private:
+    static constexpr uint32_t NoSlot = UINT32_MAX;
+
+    struct Slot {
+        AllocatedBuffer arrays[ArrayCount] = {};
+        VkDeviceSize capacity[ArrayCount] = {};    // bytes
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        SvoShaderConstants constants;
+        // One past the last frame that read this version, 0 if none did
+        uint64_t readUntil = 0;
+    };
+
+    struct Staged {
+        AllocatedBuffer staging = {};
+        VkDeviceSize offset[ArrayCount] = {}, bytes[ArrayCount] = {};
+        SvoShaderConstants constants;
+    };
+
+    VkDevice m_Device;
+    VmaAllocator m_Allocator;
+    uint32_t m_FramesInFlight;
+    Slot m_Slots[2];
+    uint32_t m_Active = NoSlot;
+    Staged m_Staged;
+    // The next tile of a persistent dispatch, bound at QueueBinding in both sets
+    AllocatedBuffer m_Queue = {};
+    uint64_t m_Version = 0;
+    VkDeviceSize m_UploadedBytes = 0;
+
+    AllocatedBuffer CreateBuffer(VkDeviceSize bytes, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage) const;
+    void DestroyBuffer(AllocatedBuffer& buffer) const;
+    // Grows the slot's buffers to fit the staged arrays and points its set at them
+    void Fit(Slot& slot);
+};
\ No newline at end of file
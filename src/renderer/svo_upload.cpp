@@ -0,0 +1,93 @@
+#include "svo_upload.h"
+
+#include <cstring>
+
+SvoUploader::SvoUploader(VmaAllocator allocator, uint32_t frames, VkDeviceSize stagingBytes)
+    : m_Allocator(allocator), m_StagingBytes(stagingBytes) {
+    for (uint32_t i = 0; i < frames; i++)
+        m_Staging.push_back(CreateStaging(stagingBytes));
+}
+
+SvoUploader::~SvoUploader() {
+    Destroy();
+}
+
+void SvoUploader::Destroy() {
+    for (const AllocatedBuffer& staging : m_Staging)
+        vmaDestroyBuffer(m_Allocator, staging.buffer, staging.allocation);
+    m_Staging.clear();
+}
+
+AllocatedBuffer SvoUploader::CreateStaging(VkDeviceSize bytes) const {
+    VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufferInfo.size = bytes;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    AllocatedBuffer staging;
+    VK_CHECK(vmaCreateBuffer(m_Allocator, &bufferInfo, &allocInfo, &staging.buffer, &staging.allocation, &staging.info));
+    return staging;
+}
+
+bool SvoUploader::Record(VkCommandBuffer cmd, uint32_t frame, std::span<const SvoUploadTarget> targets, DeletionQueue& frameDeletion) {
+    m_UploadedBytes = 0;
+    for (const SvoUploadTarget& target : targets) {
+        for (const SvoDirtyRange& range : target.ranges) {
+            VkDeviceSize end = ((VkDeviceSize)range.offset + range.count) * sizeof(uint32_t);
+            if (end > target.capacity || range.offset + range.count > target.words.size())
+                return false;
+            m_UploadedBytes += (VkDeviceSize)range.count * sizeof(uint32_t);
+        }
+    }
+    if (m_UploadedBytes == 0)
+        return true;
+
+    AllocatedBuffer staging = m_Staging[frame];
+    if (m_UploadedBytes > m_StagingBytes) {
+        staging = CreateStaging(m_UploadedBytes);
+        VmaAllocator allocator = m_Allocator;
+        frameDeletion.push_function([=]() { vmaDestroyBuffer(allocator, staging.buffer, staging.allocation); });
+    }
+
+    // The previous frame may still be raymarching the buffers about to be written
+    VkMemoryBarrier2 before = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+    before.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    before.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+
+    VkDependencyInfo beforeInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    beforeInfo.memoryBarrierCount = 1;
+    beforeInfo.pMemoryBarriers = &before;
+    vkCmdPipelineBarrier2(cmd, &beforeInfo);
+
+    // Ranges are packed back to back in the staging buffer, one copy command per target
+    char* mapped = (char*)staging.info.pMappedData;
+    VkDeviceSize offset = 0;
+    std::vector<VkBufferCopy> copies;
+    for (const SvoUploadTarget& target : targets) {
+        copies.clear();
+        for (const SvoDirtyRange& range : target.ranges) {
+            VkDeviceSize bytes = (VkDeviceSize)range.count * sizeof(uint32_t);
+            memcpy(mapped + offset, target.words.data() + range.offset, bytes);
+            copies.push_back({ offset, (VkDeviceSize)range.offset * sizeof(uint32_t), bytes });
+            offset += bytes;
+        }
+        if (!copies.empty())
+            vkCmdCopyBuffer(cmd, staging.buffer, target.buffer, (uint32_t)copies.size(), copies.data());
+    }
+    vmaFlushAllocation(m_Allocator, staging.allocation, 0, offset);
+
+    VkMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+    VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    depInfo.memoryBarrierCount = 1;
+    depInfo.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vk_types.h>
+#include <svo.h>
+
+// A device buffer mirroring one of a tree's serialized arrays, and the ranges of it to refresh
+struct SvoUploadTarget {
+    std::span<const uint32_t> words;
+    std::span<const SvoDirtyRange> ranges;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize capacity = 0;      // bytes
+};
+
+// Streams the ranges SparseVoxelOctree::UpdateBuffer reports to the GPU. Each frame in flight has its
+// own persistently mapped staging buffer, and the copies go into the frame's command buffer ahead of
+// the raymarch dispatch, so an edit made before draw() is on screen in that frame. Updates larger than
+// the staging buffer get a one-off buffer, freed with the frame.
+class SvoUploader {
+public:
+    SvoUploader(VmaAllocator allocator, uint32_t frames, VkDeviceSize stagingBytes);
+    ~SvoUploader();
+
+    void Destroy();
+
+    // Stages the targets' ranges for frame and records their copies, then a barrier before compute
+    // shader reads. Returns false without recording anything if a range ends beyond its target's
+    // capacity, in which case that buffer has to be recreated and uploaded whole.
+    bool Record(VkCommandBuffer cmd, uint32_t frame, std::span<const SvoUploadTarget> targets, DeletionQueue& frameDeletion);
+
+    // Bytes the last Record copied
+    VkDeviceSize GetUploadedBytes() const { return m_UploadedBytes; }
+
+private:
+    VmaAllocator m_Allocator;
+    std::vector<AllocatedBuffer> m_Staging;
+    VkDeviceSize m_StagingBytes;
+    VkDeviceSize m_UploadedBytes = 0;
+
+    AllocatedBuffer CreateStaging(VkDeviceSize bytes) const;
+};
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Swapchain.h"
+#include <svo_residency.h>
 
 Swapchain::Swapchain(VmaAllocator allocator, VkDevice device, SDL_Window* window, VkExtent2D& windowExtent)
     : m_Allocator(allocator), m_Device(device), m_Window(window), m_WindowExtent(windowExtent) {
@@ -74,6 +75,14 @@ void Swapchain::CreateDrawImage(uint32_t width, uint32_t height) {
     VkImageViewCreateInfo dview_info = vkinit::imageview_create_info(_depthImage.imageFormat, _depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
 
     VK_CHECK(vkCreateImageView(m_Device, &dview_info, nullptr, &_depthImage.imageView));
+
+    VkBufferCreateInfo beamInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    beamInfo.size = SvoResidency::GetBeamBufferSize({ width, height });
+    beamInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    VmaAllocationCreateInfo beamAllocInfo = {};
+    beamAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    VK_CHECK(vmaCreateBuffer(m_Allocator, &beamInfo, &beamAllocInfo, &_beamBuffer.buffer, &_beamBuffer.allocation, &_beamBuffer.info));
 }
 
 void Swapchain::Resize(VkPhysicalDevice chosenGPU, VkSurfaceKHR surface) {
@@ -92,6 +101,7 @@ void Swapchain::Destroy() {
     vmaDestroyImage(m_Allocator, _drawImage.image, _drawImage.allocation);
     vkDestroyImageView(m_Device, _depthImage.imageView, nullptr);
     vmaDestroyImage(m_Allocator, _depthImage.image, _depthImage.allocation);
+    vmaDestroyBuffer(m_Allocator, _beamBuffer.buffer, _beamBuffer.allocation);
 
     for (int i = 0; i < ImageViews.size(); i++) {
         vkDestroyImageView(m_Device, ImageViews[i], nullptr);
@@ -21,6 +21,8 @@ public:
 
     AllocatedImage _drawImage;
     AllocatedImage _depthImage;
+    // Tile start distances of the raymarch's beam prepass, sized for the draw image
+    AllocatedBuffer _beamBuffer;
     VkExtent2D _drawExtent;
 
 private:
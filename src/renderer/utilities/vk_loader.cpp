@@ -10,7 +10,7 @@
 #include <fastgltf/core.hpp>
 #include <fastgltf/tools.hpp>
 
-std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::string path) {
+std::optional<std::vector<MeshData>> loadGltfMeshData(std::string path) {
 #ifndef PROJECT_ROOT
     fmt::println("PROJECT_ROOT must be defined in src/CMakeLists.txt:\ntarget_compile_definitions(engine PRIVATE PROJECT_ROOT=\"${CMAKE_SOURCE_DIR}\")");
     return {};
@@ -36,16 +36,14 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngi
 
     gltf = std::move(asset.get());
 
-    std::vector<std::shared_ptr<MeshAsset>> meshes;
+    std::vector<MeshData> meshes;
 
-    std::vector<uint32_t> indices;
-    std::vector<Vertex> vertices;
     for (fastgltf::Mesh& mesh : gltf.meshes) {
-        MeshAsset newmesh;
+        MeshData newmesh;
         newmesh.name = mesh.name;
 
-        indices.clear();
-        vertices.clear();
+        std::vector<uint32_t>& indices = newmesh.indices;
+        std::vector<Vertex>& vertices = newmesh.vertices;
 
         for (auto&& p : mesh.primitives) {
             GeoSurface newSurface;
@@ -121,7 +119,24 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngi
                 vtx.color = glm::vec4(vtx.normal, 1.f);
             }
         }
-        newmesh.meshBuffers = engine->uploadMesh(indices, vertices);
+
+        meshes.push_back(std::move(newmesh));
+    }
+
+    return meshes;
+}
+
+std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::string path) {
+    std::optional<std::vector<MeshData>> data = loadGltfMeshData(path);
+    if (!data)
+        return {};
+
+    std::vector<std::shared_ptr<MeshAsset>> meshes;
+    for (MeshData& mesh : *data) {
+        MeshAsset newmesh;
+        newmesh.name = std::move(mesh.name);
+        newmesh.surfaces = std::move(mesh.surfaces);
+        newmesh.meshBuffers = engine->uploadMesh(mesh.indices, mesh.vertices);
 
         meshes.emplace_back(std::make_shared<MeshAsset>(std::move(newmesh)));
     }
@@ -9,6 +9,15 @@ struct GeoSurface {
     uint32_t count;
 };
 
+// CPU-side copy of a mesh, indices are relative to the mesh's own vertices
+struct MeshData {
+    std::string name;
+
+    std::vector<GeoSurface> surfaces;
+    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices;
+};
+
 struct MeshAsset {
     std::string name;
 
@@ -19,4 +28,5 @@ struct MeshAsset {
 //forward declaration
 class VulkanEngine;
 
+std::optional<std::vector<MeshData>> loadGltfMeshData(std::string path);
 std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::string path);
\ No newline at end of file
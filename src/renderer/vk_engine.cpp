@@ -18,6 +18,7 @@
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <iostream>
@@ -46,7 +47,9 @@ void VulkanEngine::init() {
     init_swapchain();
     init_commands();
     init_sync_structures();
+    init_svo_upload();
     init_descriptors();
+    init_svo();
     init_pipelines();
     init_imgui();
 
@@ -115,6 +118,147 @@ void VulkanEngine::init_swapchain() {
         });
 }
 
+void VulkanEngine::init_svo_upload() {
+    // Enough for brush strokes every frame, bigger updates get a staging buffer of their own
+    m_SvoUploader = new SvoUploader(_allocator, FRAME_OVERLAP, 8 * 1024 * 1024);
+
+    _mainDeletionQueue.push_function([=]() {
+        delete m_SvoUploader;
+        });
+}
+
+void VulkanEngine::init_svo() {
+    m_SvoResidency = new SvoResidency(_device, _allocator, _drawImageDescriptorLayout, globalDescriptorAllocator, FRAME_OVERLAP);
+    persistentGroups = SvoResidency::GetPersistentGroups(_chosenGPU);
+    update_descriptors();
+
+    _mainDeletionQueue.push_function([=]() {
+        delete m_SvoResidency;
+        });
+
+    if (!svoPath.empty() && load_svo(svoPath))
+        return;
+
+    if (!pagedSvoPath.empty()) {
+        m_PagedSvo = PagedSvo::Open(pagedSvoPath, pagedSvoBudget);
+        if (m_PagedSvo) {
+            _mainDeletionQueue.push_function([=]() {
+                m_PagedSvo.reset();
+                });
+
+            // The top tree alone until the first pages arrive
+            svoConstants = m_PagedSvo->GetShaderConstants();
+            m_PagedSvoChanges = UINT64_MAX;
+            update_paged_svo();
+            return;
+        }
+    }
+
+    // The mesh with the most triangles, scaled to fill 90% of the volume
+    std::optional<std::vector<MeshData>> meshes = loadGltfMeshData("assets/basicmesh.glb");
+    if (meshes && !meshes->empty()) {
+        const MeshData& mesh = *std::max_element(meshes->begin(), meshes->end(),
+            [](const MeshData& a, const MeshData& b) { return a.indices.size() < b.indices.size(); });
+
+        glm::vec3 min(INFINITY), max(-INFINITY);
+        for (const Vertex& v : mesh.vertices) {
+            min = glm::min(min, v.position);
+            max = glm::max(max, v.position);
+        }
+
+        float scale = 0.9f * svo.GetSize() / std::max({ max.x - min.x, max.y - min.y, max.z - min.z });
+        glm::mat4 transform(scale);
+        transform[3] = glm::vec4(-(min + max) / 2.f * scale, 1.f);
+        svo.Voxelize(mesh.vertices, mesh.indices, transform, false);
+    }
+
+    // Slack lets edit_svo patch the buffer in place instead of restaging it
+    svo.SetEditSlack(0.25f);
+    svo.CreateBuffer();
+    svoConstants = svo.GetShaderConstants();
+    set_svo(svo);
+}
+
+void VulkanEngine::set_svo(const SparseVoxelOctree& tree) {
+    // Patches queued for the version being replaced would be lost with it anyway
+    pendingSvoUpdate = {};
+    pendingSvoTree = nullptr;
+    m_SvoResidency->Stage(tree);
+}
+
+bool VulkanEngine::load_svo(const std::filesystem::path& path) {
+    std::optional<MappedSvo> mapped = MappedSvo::Open(path);
+    if (!mapped)
+        return false;
+
+    // Stage copies the arrays out, so the mapping can go right after
+    pendingSvoUpdate = {};
+    pendingSvoTree = nullptr;
+    svoConstants = mapped->GetShaderConstants();
+    const std::span<const uint32_t> arrays[SvoResidency::ArrayCount] = {
+        mapped->GetBuffer(), mapped->GetFar(), mapped->GetAttributes(), mapped->GetBricks(), mapped->GetDistances() };
+    m_SvoResidency->Stage(svoConstants, arrays);
+    return true;
+}
+
+void VulkanEngine::update_paged_svo() {
+    if (!m_PagedSvo)
+        return;
+
+    m_PagedSvo->Update(mainCamera.position);
+
+    // Pages landing every frame would otherwise restage the whole tree every frame
+    PagedSvo::Stats stats = m_PagedSvo->GetStats();
+    uint64_t changes = stats.loads + stats.evictions;
+    if (changes == m_PagedSvoChanges || m_SvoResidency->HasStaged())
+        return;
+    m_PagedSvoChanges = changes;
+
+    std::vector<uint32_t> buffer, far, attributes;
+    pagedSvoPages = m_PagedSvo->Assemble(buffer, far, attributes);
+    const std::span<const uint32_t> arrays[SvoResidency::ArrayCount] = { buffer, far, attributes, {}, {} };
+    m_SvoResidency->Stage(m_PagedSvo->GetShaderConstants(), arrays);
+}
+
+void VulkanEngine::update_svo(const SparseVoxelOctree& tree, const SvoBufferUpdate& update) {
+    if (update.Empty())
+        return;
+
+    if (update.full || (pendingSvoTree != nullptr && pendingSvoTree != &tree)) {
+        set_svo(tree);
+        return;
+    }
+    pendingSvoTree = &tree;
+    pendingSvoUpdate.Merge(update);
+}
+
+void VulkanEngine::edit_svo(bool add) {
+    if (!svo.IsEditable())
+        return;
+
+    glm::vec3 forward = -glm::vec3(mainCamera.getViewMatrix()[2]);
+    SvoQuery query(svo);
+    SvoRayHit hit = query.Raycast({ mainCamera.position, forward });
+    if (!hit.Hit())
+        return;
+
+    auto [min, max] = query.CellBounds(hit.cell);
+    glm::vec3 center = (min + max) / 2.f, cellSize = max - min;
+    if (add) {
+        // Nowhere to put it if the camera is inside the voxel
+        if (hit.normal == glm::vec3(0.f))
+            return;
+        svo.Insert(center + hit.normal * cellSize, glm::vec3(0.8f, 0.5f, 0.3f));
+    }
+    else {
+        for (int z = -1; z <= 1; z++)
+            for (int y = -1; y <= 1; y++)
+                for (int x = -1; x <= 1; x++)
+                    svo.Remove(center + glm::vec3(x, y, z) * cellSize);
+    }
+    update_svo(svo, svo.UpdateBuffer());
+}
+
 void VulkanEngine::init_commands() {
     VkCommandPoolCreateInfo commandPoolInfo = vkinit::command_pool_create_info(_graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
@@ -150,7 +294,8 @@ void VulkanEngine::init_sync_structures() {
 
 void VulkanEngine::init_descriptors() {
     std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SvoResidency::ArrayCount + 2 },
     };
 
     globalDescriptorAllocator.init_pool(_device, 10, sizes);
@@ -158,14 +303,12 @@ void VulkanEngine::init_descriptors() {
     auto builder = DescriptorLayoutBuilder();
 
     builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-    builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    builder.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    for (uint32_t i = 0; i < SvoResidency::ArrayCount; i++)
+        builder.add_binding(SvoResidency::FirstBinding + i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.add_binding(SvoResidency::BeamBinding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.add_binding(SvoResidency::QueueBinding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
     _drawImageDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
 
-    _drawImageDescriptors = globalDescriptorAllocator.allocate(_device, _drawImageDescriptorLayout);
-
-    update_descriptors();
-
     _mainDeletionQueue.push_function([&]() {
         globalDescriptorAllocator.destroy_pool(_device);
 
@@ -174,20 +317,7 @@ void VulkanEngine::init_descriptors() {
 }
 
 void VulkanEngine::update_descriptors() {
-    VkDescriptorImageInfo imgInfo{};
-    imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    imgInfo.imageView = m_Swapchain->_drawImage.imageView;
-
-    VkWriteDescriptorSet drawImageWrite = {};
-    drawImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    drawImageWrite.pNext = nullptr;
-    drawImageWrite.dstBinding = 0;
-    drawImageWrite.dstSet = _drawImageDescriptors;
-    drawImageWrite.descriptorCount = 1;
-    drawImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    drawImageWrite.pImageInfo = &imgInfo;
-
-    vkUpdateDescriptorSets(_device, 1, &drawImageWrite, 0, nullptr);
+    m_SvoResidency->SetTargets(m_Swapchain->_drawImage.imageView, m_Swapchain->_beamBuffer.buffer);
 }
 
 void VulkanEngine::init_pipelines() {
@@ -250,63 +380,15 @@ void VulkanEngine::init_mesh_pipeline() {
 }
 
 void VulkanEngine::init_background_pipelines() {
-    for (auto& effect : backgroundEffects) {
-        vkDestroyPipeline(_device, effect.pipeline, nullptr);
-        vkDestroyPipelineLayout(_device, effect.layout, nullptr);
-    }
-    backgroundEffects.clear();
-
-    VkPipelineLayoutCreateInfo computeLayout{};
-    computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    computeLayout.pNext = nullptr;
-    computeLayout.pSetLayouts = &_drawImageDescriptorLayout;
-    computeLayout.setLayoutCount = 1;
-
-    VkPushConstantRange pushConstant{};
-    pushConstant.offset = 0;
-    pushConstant.size = sizeof(ComputePushConstants);
-    pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    computeLayout.pPushConstantRanges = &pushConstant;
-    computeLayout.pushConstantRangeCount = 1;
+    m_RaymarchPipelines = new RaymarchPipelines(_device, _drawImageDescriptorLayout);
+    m_RaymarchPipelines->SetTreeConstants(svoConstants, _mainDeletionQueue);
 
-    VkPipelineLayout pipelineLayout;
+    // Built up front so switching traversals does not stall a frame, the debug variants on first use
+    m_RaymarchPipelines->Get(RaymarchProduction);
+    m_RaymarchPipelines->Get(RaymarchProduction | RaymarchEsvo);
 
-    VK_CHECK(vkCreatePipelineLayout(_device, &computeLayout, nullptr, &pipelineLayout));
-
-    VkShaderModule raymarchShader;
-    if (!vkutil::load_shader_module("shaders/raymarch.comp.spv", _device, &raymarchShader)) {
-        fmt::println("Error when building the compute shader \n");
-    }
-
-    VkPipelineShaderStageCreateInfo stageinfo{};
-    stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stageinfo.pNext = nullptr;
-    stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    stageinfo.module = raymarchShader;
-    stageinfo.pName = "main";
-
-    VkComputePipelineCreateInfo computePipelineCreateInfo{};
-    computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    computePipelineCreateInfo.pNext = nullptr;
-    computePipelineCreateInfo.layout = pipelineLayout;
-    computePipelineCreateInfo.stage = stageinfo;
-
-    ComputeEffect raymarch;
-    raymarch.layout = pipelineLayout;
-    raymarch.name = "raymarch";
-    raymarch.data = {};
-    raymarch.data.data1 = glm::vec4(mainCamera.position, 0);
-    raymarch.data.data2 = glm::vec4(mainCamera.yaw, mainCamera.pitch, 0, 0);
-
-    VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &raymarch.pipeline));
-
-    backgroundEffects.push_back(raymarch);
-
-    vkDestroyShaderModule(_device, raymarchShader, nullptr);
     _mainDeletionQueue.push_function([=]() {
-        vkDestroyPipelineLayout(_device, pipelineLayout, nullptr);
-        vkDestroyPipeline(_device, raymarch.pipeline, nullptr);
+        delete m_RaymarchPipelines;
         });
 }
 
@@ -488,14 +570,15 @@ void VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& f
 }
 
 void VulkanEngine::draw_background(VkCommandBuffer cmd) {
-    ComputeEffect& effect = backgroundEffects[currentBackgroundEffect];
-
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, effect.layout, 0, 1, &_drawImageDescriptors, 0, nullptr);
+    if (!m_SvoResidency->HasVersion())
+        return;
 
-    vkCmdPushConstants(cmd, effect.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
+    VkPipeline pipeline = m_RaymarchPipelines->Get(raymarchFeatures);
+    if (pipeline == VK_NULL_HANDLE)
+        return;
 
-    vkCmdDispatch(cmd, std::ceil(m_Swapchain->_drawExtent.width / 16.0), std::ceil(m_Swapchain->_drawExtent.height / 16.0), 1);
+    m_SvoResidency->Dispatch(cmd, pipeline, m_RaymarchPipelines->GetLayout(), raymarchPushConstants, m_Swapchain->_drawExtent, beamPrepass,
+        persistentThreads ? persistentGroups : 0);
 }
 
 void VulkanEngine::draw_geometry(VkCommandBuffer cmd) {
@@ -563,6 +646,7 @@ void VulkanEngine::draw() {
     FrameData& currentFrame = getCurrentFrame();
 
     update_scene();
+    update_paged_svo();
 
     vkWaitForFences(_device, 1, &currentFrame._renderFence, true, 1000000000);
 
@@ -590,6 +674,23 @@ void VulkanEngine::draw() {
     // we will overwrite it all so we dont care about what was the older layout
     vkutil::transition_image(cmd, m_Swapchain->_drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
+    // Edits made since the last frame are copied ahead of the raymarch dispatch that reads them. Ones
+    // that cannot be patched in, because a version is still staged or an array outgrew its buffer,
+    // restage the tree, which the residency swaps in below or in a later frame.
+    if (pendingSvoTree != nullptr) {
+        std::vector<SvoUploadTarget> targets = m_SvoResidency->GetUpdateTargets(*pendingSvoTree, pendingSvoUpdate);
+        if (targets.empty() || !m_SvoUploader->Record(cmd, _frameNumber % FRAME_OVERLAP, targets, currentFrame._deletionQueue))
+            set_svo(*pendingSvoTree);
+        pendingSvoUpdate = {};
+        pendingSvoTree = nullptr;
+    }
+
+    // A staged tree goes into the version no frame in flight reads, and may need its own pipelines
+    if (m_SvoResidency->Record(cmd, _frameNumber, currentFrame._deletionQueue) && m_SvoResidency->GetShaderConstants() != svoConstants) {
+        svoConstants = m_SvoResidency->GetShaderConstants();
+        m_RaymarchPipelines->SetTreeConstants(svoConstants, currentFrame._deletionQueue);
+    }
+
     draw_background(cmd);
 
     vkutil::transition_image(cmd, m_Swapchain->_drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -645,8 +746,6 @@ void VulkanEngine::draw() {
 }
 
 void VulkanEngine::update_scene() {
-    ComputeEffect& selected = backgroundEffects[0];
-
     mainCamera.update();
 
     glm::mat4 viewMatrix = mainCamera.getViewMatrix();
@@ -655,10 +754,11 @@ void VulkanEngine::update_scene() {
     glm::vec3 camRight = glm::vec3(viewMatrix[0]);    // Right is +X in view space
     glm::vec3 camUp = glm::vec3(viewMatrix[1]);       // Up is +Y in view space
 
-    selected.data.data1 = glm::vec4(mainCamera.position, currentView);
-    selected.data.data2 = glm::vec4(camForward, 0.0f);
-    selected.data.data3 = glm::vec4(camRight, 0.0f);
-    selected.data.data4 = glm::vec4(camUp, 0.0f);
+    raymarchPushConstants.data1 = glm::vec4(mainCamera.position, 0.0f);
+    // raymarch.comp looks through a 90 degree vertical field of view
+    raymarchPushConstants.data2 = glm::vec4(camForward, 2.0f / std::max(m_Swapchain->_drawExtent.height, 1u));
+    raymarchPushConstants.data3 = glm::vec4(camRight, 0.0f);
+    raymarchPushConstants.data4 = glm::vec4(camUp, 0.0f);
 }
 
 void VulkanEngine::run() {
@@ -681,9 +781,12 @@ void VulkanEngine::run() {
 
             mainCamera.processSDLEvent(e);
 
-            if (e.type == SDL_KEYDOWN)
+            if (e.type == SDL_KEYDOWN) {
                 if (e.key.keysym.sym == SDLK_g)
-                    currentView = (currentView + 1) % 2;
+                    raymarchFeatures ^= RaymarchHeatmap;
+                if (e.key.keysym.sym == SDLK_e || e.key.keysym.sym == SDLK_r)
+                    edit_svo(e.key.keysym.sym == SDLK_r);
+            }
 
             ImGui_ImplSDL2_ProcessEvent(&e);
         }
@@ -724,6 +827,18 @@ void VulkanEngine::run() {
         if (ImGui::Begin("background")) {
             ImGui::SliderFloat("Render Scale", &renderScale, 0.1f, 1.f);
             ImGui::InputFloat3("Position", (float*)&mainCamera.position);
+            ImGui::Checkbox("Beam Prepass", &beamPrepass);
+            ImGui::Checkbox("Persistent Threads", &persistentThreads);
+            ImGui::Text("Persistent groups: %u", persistentGroups);
+            if (m_PagedSvo) {
+                PagedSvo::Stats stats = m_PagedSvo->GetStats();
+                ImGui::Text("Pages: %u of %u on screen, %u resident (%.1f MB), %u queued", pagedSvoPages, m_PagedSvo->GetPageCount(),
+                    stats.residentPages, stats.residentBytes / 1048576.0, stats.queuedPages);
+            }
+            ImGui::CheckboxFlags("ESVO Traversal", &raymarchFeatures, RaymarchEsvo);
+            ImGui::CheckboxFlags("Heatmap", &raymarchFeatures, RaymarchHeatmap);
+            ImGui::CheckboxFlags("Lighting", &raymarchFeatures, RaymarchLighting);
+            ImGui::Text("Raymarch variants built: %zu", m_RaymarchPipelines->GetVariantCount());
         }
         ImGui::End();
         ImGui::Render();
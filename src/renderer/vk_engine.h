@@ -6,6 +6,13 @@
 #include <Swapchain.h>
 
 #include <camera.h>
+#include <svo.h>
+#include <svo_file.h>
+#include <svo_paged.h>
+#include <svo_query.h>
+#include <svo_upload.h>
+#include <svo_residency.h>
+#include <raymarch_pipelines.h>
 #include "vk_loader.h"
 
 
@@ -49,18 +56,40 @@ public:
 
 	DescriptorAllocator globalDescriptorAllocator;
 
-	VkDescriptorSet _drawImageDescriptors;
+	// The draw image at binding 0, the tree's arrays after it and the beam buffer last, see SvoResidency
 	VkDescriptorSetLayout _drawImageDescriptorLayout;
 
-	std::vector<ComputeEffect> backgroundEffects;
-	int currentBackgroundEffect = 0;
+	// RaymarchFeature bits of the raymarch variant draw_background uses, G toggles the heatmap
+	uint32_t raymarchFeatures = RaymarchProduction;
+	// The camera for raymarch.comp, written by update_scene
+	ComputePushConstants raymarchPushConstants{};
+	// What the raymarch pipelines are specialized for. draw() retires their variants when a tree with
+	// other constants is swapped in.
+	SvoShaderConstants svoConstants;
+	// Ranges of pendingSvoTree's arrays edited since the last draw(), which copies them to the GPU
+	// before raymarching. The words are read from the tree then, so its arrays may grow in between.
+	SvoBufferUpdate pendingSvoUpdate;
+	const SparseVoxelOctree* pendingSvoTree = nullptr;
+	// The tree on screen, voxelized from the test meshes at startup into an editable buffer
+	SparseVoxelOctree svo{ 20, 8 };
+	// A Save file to map and upload as is instead of voxelizing the test meshes, set before init()
+	std::filesystem::path svoPath;
+	// A SavePaged file to stream around the camera instead of the test meshes, set before init()
+	std::filesystem::path pagedSvoPath;
+	size_t pagedSvoBudget = 256ull << 20;
+	// Pages of it the version on screen was assembled from
+	uint32_t pagedSvoPages = 0;
 
 	GPUSceneData sceneData;
 	std::vector<std::shared_ptr<MeshAsset>> testMeshes;
 	Camera mainCamera;
 
 	float renderScale = 1.f;
-	int currentView = 0;
+	// Starts the raymarch from the distances a coarse beam pass finds for every tile
+	bool beamPrepass = true;
+	// Raymarches with persistentGroups workgroups that take tiles from a queue instead of one per block
+	bool persistentThreads = false;
+	uint32_t persistentGroups = 0;
 
 	static VulkanEngine& Get();
 
@@ -77,14 +106,37 @@ public:
 
 	void update_scene();
 
+	// Uploads the tree's last CreateBuffer result as a new version, swapped in by a later draw()
+	// without stalling the frames in flight
+	void set_svo(const SparseVoxelOctree& tree);
+	// Queues an UpdateBuffer result of the tree on screen for the next draw(), which stages the tree
+	// whole if the update cannot be patched in. tree must stay alive until then.
+	void update_svo(const SparseVoxelOctree& tree, const SvoBufferUpdate& update);
+	// Streams the paged tree's pages around the camera and stages it with the resident pages spliced
+	// in whenever they changed and the last version was swapped in
+	void update_paged_svo();
+	// Maps a Save file and stages its arrays without building a tree. False if it cannot be opened.
+	bool load_svo(const std::filesystem::path& path);
+	// Digs a 3x3x3 hole around the voxel under the crosshair, or adds one on the face it looks at, and
+	// queues the patched ranges with update_svo. E digs and R builds; only the voxelized tree is editable.
+	void edit_svo(bool add);
+
 private:
 	Swapchain* m_Swapchain = nullptr;
+	SvoUploader* m_SvoUploader = nullptr;
+	SvoResidency* m_SvoResidency = nullptr;
+	RaymarchPipelines* m_RaymarchPipelines = nullptr;
+	std::unique_ptr<PagedSvo> m_PagedSvo;
+	// Loads and evictions the staged paged tree reflects
+	uint64_t m_PagedSvoChanges = 0;
 	bool resize_requested = false;
 
 	void init_vulkan();
 	void init_swapchain();
 	void init_commands();
 	void init_sync_structures();
+	void init_svo_upload();
+	void init_svo();
 	void init_pipelines();
 	void init_background_pipelines();
 	void init_imgui();